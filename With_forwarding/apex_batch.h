@@ -0,0 +1,27 @@
+/*
+ * apex_batch.h
+ * Contains run option parsing, the single run driver and the parallel batch
+ * runner declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_BATCH_H_
+#define _APEX_BATCH_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+
+void APEX_config_init(APEX_Config *config);
+int APEX_config_option(APEX_Config *config, const char *option);
+int APEX_simulate(APEX_CPU *cpu, const APEX_Config *config, int num_of_cycles);
+int APEX_batch_run(const char *manifest, int num_threads, const APEX_Config *defaults,
+                   FILE *out);
+int APEX_batch_scaling(const char *manifest, int max_threads,
+                       const APEX_Config *defaults, FILE *out);
+int APEX_batch_bench(const char *manifest, int repeats, const APEX_Config *defaults,
+                     FILE *out);
+
+#endif
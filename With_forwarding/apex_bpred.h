@@ -0,0 +1,141 @@
+/*
+ * apex_bpred.h
+ * Contains the branch direction predictor declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_BPRED_H_
+#define _APEX_BPRED_H_
+
+#include <stdio.h>
+
+#include "apex_btb.h"
+#include "apex_macros.h"
+
+struct APEX_BPred;
+
+/* What a predictor remembers about one branch or register jump between
+ * fetch and execute */
+typedef struct APEX_BPredInfo
+{
+    int pc;
+    int btb_index;                 /* BTB entry of the branch, -1 if none */
+    unsigned long long history;    /* Global history before this branch */
+    int taken;                     /* Direction predicted */
+    int index[BPRED_TAGE_TABLES + 1]; /* Table rows read by the prediction */
+    unsigned short tag[BPRED_TAGE_TABLES];
+    int provider;                  /* TAGE table that provided, -1 for the base */
+    int alt_taken;                 /* TAGE prediction without the provider */
+    int component[2];              /* Tournament bimodal and gshare predictions */
+    int output;                    /* Perceptron dot product */
+    int ras_top;                   /* Return address stack before this instruction */
+    int ras_count;
+    int ras_value;                 /* Entry at ras_top, wrong-path pushes may overwrite it */
+    int call;                      /* JALR, pushed its return address */
+    int target;                    /* Predicted jump target, -1 if none */
+    int target_source;             /* One of TARGET_* */
+    int itp_index;                 /* Indirect target predictor row */
+} APEX_BPredInfo;
+
+/*
+ * Operations of one predictor kind. predict reads the tables for the branch
+ * in info and saves what update will need in it. spec_update shifts the
+ * prediction into the speculative state at fetch, recover rolls that state
+ * back to just before the branch when it or an older instruction redirects
+ * fetch, and update trains the tables once the branch resolves. Kinds that
+ * keep no speculative state leave spec_update and recover NULL.
+ */
+typedef struct APEX_BPredOps
+{
+    const char *name;
+    int (*predict)(struct APEX_BPred *bp, APEX_BPredInfo *info);
+    void (*update)(struct APEX_BPred *bp, const APEX_BPredInfo *info, int taken);
+    void (*spec_update)(struct APEX_BPred *bp, const APEX_BPredInfo *info, int taken);
+    void (*recover)(struct APEX_BPred *bp, const APEX_BPredInfo *info);
+} APEX_BPredOps;
+
+typedef struct APEX_BPredStats
+{
+    long long branches;            /* Conditional branches resolved */
+    long long mispredicts;         /* Fetched down the wrong path */
+    long long direction_mispredicts; /* Predictor direction wrong, BTB aside */
+} APEX_BPredStats;
+
+typedef struct APEX_TargetStats
+{
+    long long jumps;               /* JUMP and JALR resolved */
+    long long predicted;           /* Fetched at a predicted target */
+    long long correct;             /* Predicted target was right, no redirect */
+    long long ras_hits;            /* Correct targets from the return address stack */
+    long long itp_hits;            /* Correct targets from the indirect predictor */
+    long long ras_overflows;       /* Pushes that overwrote the oldest entry */
+    long long ras_underflows;      /* Returns that found the stack empty */
+} APEX_TargetStats;
+
+/* TAGE tagged table entry */
+typedef struct APEX_TageEntry
+{
+    unsigned short tag;
+    signed char ctr;               /* -4 .. 3, taken when >= 0 */
+    unsigned char useful;          /* 0 .. 3 */
+} APEX_TageEntry;
+
+typedef struct APEX_BPred
+{
+    int kind;                      /* One of BPRED_* */
+    const APEX_BPredOps *ops;
+    int entries;                   /* Rows per table, a power of two */
+    int index_bits;                /* log2(entries) */
+    int history_bits;              /* Global history length used */
+    int lengths[BPRED_TAGE_TABLES]; /* TAGE history length per tagged table */
+    int theta;                     /* Perceptron training threshold */
+    unsigned long long history;    /* Speculative global history, newest in bit 0 */
+    unsigned char *counters;       /* 2-bit counters */
+    APEX_TageEntry *tagged;        /* TAGE tagged tables, table major */
+    signed char *weights;          /* Perceptrons, history_bits + 1 weights each */
+    unsigned int tage_clock;       /* Updates since the useful bits were aged */
+    APEX_BTB *btb;                 /* Holds the 2-bit state of the btb kind */
+    APEX_BPredInfo inflight[APEX_BPRED_INFLIGHT];
+    int inflight_cursor;
+    APEX_BPredStats stats;
+
+    /* Register jump targets. JALR pushes its return address and sets its
+     * rd in link_mask, a JUMP through a register in link_mask is taken for
+     * a return and pops. Other jumps go to the indirect target predictor. */
+    int ras_entries;
+    int *ras;                      /* Circular, oldest entry overwritten when full */
+    int ras_top;
+    int ras_count;
+    unsigned int link_mask;
+    int itp_entries;               /* Power of two */
+    int *itp_tag;                  /* Jump address of each row, -1 if empty */
+    int *itp_target;
+    APEX_TargetStats target_stats;
+} APEX_BPred;
+
+int APEX_bpred_init(APEX_BPred *bp, int kind, int entries, int history_bits,
+                    APEX_BTB *btb);
+int APEX_bpred_init_targets(APEX_BPred *bp, int ras_entries, int itp_entries);
+void APEX_bpred_free(APEX_BPred *bp);
+APEX_BPredInfo *APEX_bpred_begin(APEX_BPred *bp, int pc, int btb_index, int *slot);
+APEX_BPredInfo *APEX_bpred_info(APEX_BPred *bp, int slot);
+int APEX_bpred_predict(APEX_BPred *bp, APEX_BPredInfo *info);
+void APEX_bpred_spec_update(APEX_BPred *bp, const APEX_BPredInfo *info, int taken);
+void APEX_bpred_update(APEX_BPred *bp, const APEX_BPredInfo *info, int taken,
+                       int mispredicted);
+void APEX_bpred_recover(APEX_BPred *bp, const APEX_BPredInfo *info);
+int APEX_bpred_predict_call(APEX_BPred *bp, APEX_BPredInfo *info, int rd);
+int APEX_bpred_predict_jump(APEX_BPred *bp, APEX_BPredInfo *info, int rs1, int imm);
+void APEX_bpred_resolve_target(APEX_BPred *bp, const APEX_BPredInfo *info,
+                               int target, int mispredicted);
+void APEX_bpred_report(const APEX_BPred *bp, int cycles, int instructions, FILE *out);
+void APEX_bpred_report_targets(const APEX_BPred *bp, FILE *out);
+int APEX_bpred_parse_kind(const char *name);
+const char *APEX_bpred_kind_name(int kind);
+int APEX_bpred_save(const APEX_BPred *bp, FILE *fp);
+long APEX_bpred_check(const APEX_BPred *bp, const void *data, long size);
+void APEX_bpred_load(APEX_BPred *bp, const void *data);
+
+#endif
@@ -0,0 +1,670 @@
+/*
+ * apex_btb.c
+ * Contains the set-associative branch target buffer with its replacement
+ * policies and hit/miss statistics
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "apex_btb.h"
+#include "apex_macros.h"
+
+#define BTB_EMPTY_TAG (-1)
+
+/*
+ * Replacement state in btb->repl, one word per entry:
+ *
+ *   LRU    - time stamp of the last access to the entry
+ *   PLRU   - word 1 .. ways-1 of a set are the nodes of its binary tree,
+ *            each pointing at the half to evict from next
+ *   FIFO   - word 0 of a set is the way that was filled longest ago
+ *   RANDOM - unused, victims come from btb->rng
+ *
+ * The shadow buffer for miss classification is a doubly linked LRU list over
+ * its entries with a chained hash of their tags, so finding a branch and
+ * picking the victim take constant time at any size.
+ */
+
+/* Fixed part of a saved BTB, followed by the entry, tag and replacement
+ * arrays, the shadow tags from most to least recently used and the set of
+ * branches seen */
+typedef struct APEX_BTBState
+{
+    int sets;
+    int ways;
+    int policy;
+    unsigned int rng;
+    unsigned long long tick;
+    int seen_capacity;
+    int seen_count;
+    APEX_BTBStats stats;
+} APEX_BTBState;
+
+static const char *const btb_policy_names[] = {
+    [BTB_REPLACE_LRU] = "lru",
+    [BTB_REPLACE_PLRU] = "plru",
+    [BTB_REPLACE_RANDOM] = "random",
+    [BTB_REPLACE_FIFO] = "fifo",
+};
+
+/*
+ * Returns the position of key in tags[0 .. count-1], or -1. Four tags are
+ * compared per instruction where SSE2 is available, which is what makes a
+ * large fully associative buffer affordable.
+ */
+static int
+APEX_btb_match(const int *tags, int count, int key)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128i needle = _mm_set1_epi32(key);
+    int mask;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        mask = _mm_movemask_epi8(
+            _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(tags + i)), needle));
+        if (mask)
+        {
+            return i + __builtin_ctz(mask) / 4;
+        }
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        if (tags[i] == key)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int
+APEX_btb_set(const APEX_BTB *btb, int pc)
+{
+    return ((unsigned int)pc >> 2) & (btb->sets - 1);
+}
+
+/* Hash of a branch address for the shadow and seen tables */
+static unsigned int
+APEX_btb_hash(int pc)
+{
+    return ((unsigned int)pc >> 2) * 2654435761u;
+}
+
+static int
+is_power_of_two(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+/* Marks a way of a set as just used */
+static void
+APEX_btb_touch(APEX_BTB *btb, int set, int way)
+{
+    unsigned long long *repl = btb->repl + set * btb->ways;
+    int node = 1;
+    int bit;
+    int level;
+
+    switch (btb->policy)
+    {
+        case BTB_REPLACE_LRU:
+        {
+            repl[way] = ++btb->tick;
+            break;
+        }
+
+        case BTB_REPLACE_PLRU:
+        {
+            /* Walk from the root, leaving each node pointing away */
+            for (level = btb->ways >> 1; level; level >>= 1)
+            {
+                bit = (way & level) != 0;
+                repl[node] = !bit;
+                node = 2 * node + bit;
+            }
+            break;
+        }
+    }
+}
+
+/* Picks the way of a full set to evict */
+static int
+APEX_btb_victim(APEX_BTB *btb, int set)
+{
+    unsigned long long *repl = btb->repl + set * btb->ways;
+    int node = 1;
+    int way = 0;
+    int i;
+
+    switch (btb->policy)
+    {
+        case BTB_REPLACE_PLRU:
+        {
+            while (node < btb->ways)
+            {
+                way = 2 * way + (int)repl[node];
+                node = 2 * node + (int)repl[node];
+            }
+            return way;
+        }
+
+        case BTB_REPLACE_RANDOM:
+        {
+            /* xorshift32 */
+            btb->rng ^= btb->rng << 13;
+            btb->rng ^= btb->rng >> 17;
+            btb->rng ^= btb->rng << 5;
+            return btb->rng % btb->ways;
+        }
+
+        case BTB_REPLACE_FIFO:
+        {
+            way = (int)repl[0];
+            repl[0] = (way + 1) % btb->ways;
+            return way;
+        }
+
+        default:
+        {
+            for (i = 1; i < btb->ways; ++i)
+            {
+                if (repl[i] < repl[way])
+                {
+                    way = i;
+                }
+            }
+            return way;
+        }
+    }
+}
+
+/* Adds a shadow entry to the hash chain of its tag */
+static void
+APEX_btb_shadow_insert(APEX_BTB *btb, int entry)
+{
+    int *bucket = &btb->shadow_buckets[APEX_btb_hash(btb->shadow_tags[entry]) &
+                                       btb->shadow_mask];
+
+    btb->shadow_chain[entry] = *bucket;
+    *bucket = entry;
+}
+
+/* Takes a shadow entry off the hash chain of its tag */
+static void
+APEX_btb_shadow_remove(APEX_BTB *btb, int entry)
+{
+    int *link = &btb->shadow_buckets[APEX_btb_hash(btb->shadow_tags[entry]) &
+                                     btb->shadow_mask];
+
+    while (*link != entry)
+    {
+        link = &btb->shadow_chain[*link];
+    }
+    *link = btb->shadow_chain[entry];
+}
+
+/* Returns the shadow entry holding pc, or -1 */
+static int
+APEX_btb_shadow_find(const APEX_BTB *btb, int pc)
+{
+    int entry = btb->shadow_buckets[APEX_btb_hash(pc) & btb->shadow_mask];
+
+    while (entry >= 0 && btb->shadow_tags[entry] != pc)
+    {
+        entry = btb->shadow_chain[entry];
+    }
+    return entry;
+}
+
+/* Moves a shadow entry to the most recently used end of the LRU list */
+static void
+APEX_btb_shadow_touch(APEX_BTB *btb, int entry)
+{
+    int prev = btb->shadow_prev[entry];
+    int next = btb->shadow_next[entry];
+
+    if (prev < 0)
+    {
+        return;
+    }
+
+    btb->shadow_next[prev] = next;
+    if (next < 0)
+    {
+        btb->shadow_tail = prev;
+    }
+    else
+    {
+        btb->shadow_prev[next] = prev;
+    }
+
+    btb->shadow_prev[entry] = -1;
+    btb->shadow_next[entry] = btb->shadow_head;
+    btb->shadow_prev[btb->shadow_head] = entry;
+    btb->shadow_head = entry;
+}
+
+/* Links the shadow entries into an LRU list in index order, entry 0 most
+ * recently used, and hashes the tags they hold */
+static void
+APEX_btb_shadow_link(APEX_BTB *btb)
+{
+    int size = APEX_btb_size(btb);
+    int i;
+
+    for (i = 0; i <= btb->shadow_mask; ++i)
+    {
+        btb->shadow_buckets[i] = -1;
+    }
+    for (i = 0; i < size; ++i)
+    {
+        btb->shadow_prev[i] = i - 1;
+        btb->shadow_next[i] = i + 1 < size ? i + 1 : -1;
+        if (btb->shadow_tags[i] != BTB_EMPTY_TAG)
+        {
+            APEX_btb_shadow_insert(btb, i);
+        }
+    }
+    btb->shadow_head = 0;
+    btb->shadow_tail = size - 1;
+}
+
+/*
+ * Sets up an empty BTB of sets x ways entries, returns 0 on success and -1
+ * if the geometry is invalid or memory runs out
+ */
+int
+APEX_btb_init(APEX_BTB *btb, int sets, int ways, int policy)
+{
+    int size = sets * ways;
+    int i;
+
+    memset(btb, 0, sizeof(*btb));
+    if (!is_power_of_two(sets) || ways <= 0 || size > (1 << 20))
+    {
+        fprintf(stderr, "APEX_Error: BTB needs a power of two sets and at least one way\n");
+        return -1;
+    }
+
+    if (policy < BTB_REPLACE_LRU || policy > BTB_REPLACE_FIFO)
+    {
+        fprintf(stderr, "APEX_Error: Unknown BTB replacement policy %d\n", policy);
+        return -1;
+    }
+
+    if (policy == BTB_REPLACE_PLRU && !is_power_of_two(ways))
+    {
+        fprintf(stderr, "APEX_Error: Tree PLRU needs a power of two BTB ways\n");
+        return -1;
+    }
+
+    btb->sets = sets;
+    btb->ways = ways;
+    btb->policy = policy;
+    btb->rng = 2463534242u;
+    btb->seen_capacity = 64;
+    while (btb->shadow_mask + 1 < size)
+    {
+        btb->shadow_mask = 2 * btb->shadow_mask + 1;
+    }
+    btb->entries = calloc(size, sizeof(BTBentry));
+    btb->tags = malloc(size * sizeof(int));
+    btb->repl = calloc(size, sizeof(unsigned long long));
+    btb->shadow_tags = malloc(size * sizeof(int));
+    btb->shadow_prev = malloc(size * sizeof(int));
+    btb->shadow_next = malloc(size * sizeof(int));
+    btb->shadow_chain = malloc(size * sizeof(int));
+    btb->shadow_buckets = malloc((btb->shadow_mask + 1) * sizeof(int));
+    btb->seen = malloc(btb->seen_capacity * sizeof(int));
+    if (!btb->entries || !btb->tags || !btb->repl || !btb->shadow_tags ||
+        !btb->shadow_prev || !btb->shadow_next || !btb->shadow_chain ||
+        !btb->shadow_buckets || !btb->seen)
+    {
+        APEX_btb_free(btb);
+        return -1;
+    }
+
+    for (i = 0; i < size; ++i)
+    {
+        btb->tags[i] = BTB_EMPTY_TAG;
+        btb->shadow_tags[i] = BTB_EMPTY_TAG;
+    }
+    for (i = 0; i < btb->seen_capacity; ++i)
+    {
+        btb->seen[i] = BTB_EMPTY_TAG;
+    }
+    APEX_btb_shadow_link(btb);
+    return 0;
+}
+
+void
+APEX_btb_free(APEX_BTB *btb)
+{
+    free(btb->entries);
+    free(btb->tags);
+    free(btb->repl);
+    free(btb->shadow_tags);
+    free(btb->shadow_prev);
+    free(btb->shadow_next);
+    free(btb->shadow_chain);
+    free(btb->shadow_buckets);
+    free(btb->seen);
+    memset(btb, 0, sizeof(*btb));
+}
+
+int
+APEX_btb_size(const APEX_BTB *btb)
+{
+    return btb->sets * btb->ways;
+}
+
+/*
+ * Looks up the branch at pc, returns the index of its entry or -1 on a miss.
+ * A hit counts as a use for the replacement policy.
+ */
+int
+APEX_btb_lookup(APEX_BTB *btb, int pc)
+{
+    int set = APEX_btb_set(btb, pc);
+    int way = APEX_btb_match(btb->tags + set * btb->ways, btb->ways, pc);
+
+    if (way < 0)
+    {
+        return -1;
+    }
+
+    APEX_btb_touch(btb, set, way);
+    return set * btb->ways + way;
+}
+
+/*
+ * Makes room for the branch at pc and returns the index of its entry. An
+ * empty way is filled first, otherwise the replacement policy picks the
+ * victim. The caller fills in the entry.
+ */
+int
+APEX_btb_allocate(APEX_BTB *btb, int pc)
+{
+    int set = APEX_btb_set(btb, pc);
+    int *tags = btb->tags + set * btb->ways;
+    int way = APEX_btb_match(tags, btb->ways, pc);
+
+    if (way < 0)
+    {
+        way = APEX_btb_match(tags, btb->ways, BTB_EMPTY_TAG);
+        if (way < 0)
+        {
+            way = APEX_btb_victim(btb, set);
+        }
+        else if (btb->policy == BTB_REPLACE_FIFO)
+        {
+            /* Sets fill in way order, so the oldest way stays next */
+            btb->repl[set * btb->ways] = (way + 1) % btb->ways;
+        }
+        tags[way] = pc;
+    }
+
+    APEX_btb_touch(btb, set, way);
+    return set * btb->ways + way;
+}
+
+/* Adds pc to the set of branches seen so far, returns TRUE if it was new */
+static int
+APEX_btb_first_sight(APEX_BTB *btb, int pc)
+{
+    unsigned int mask = btb->seen_capacity - 1;
+    unsigned int slot = APEX_btb_hash(pc);
+    int *grown;
+    int old_capacity;
+    int i;
+
+    for (slot &= mask; btb->seen[slot] != BTB_EMPTY_TAG; slot = (slot + 1) & mask)
+    {
+        if (btb->seen[slot] == pc)
+        {
+            return FALSE;
+        }
+    }
+    btb->seen[slot] = pc;
+
+    if (++btb->seen_count * 2 > btb->seen_capacity)
+    {
+        /* Rehash into twice the space, keep the old table if that fails */
+        grown = malloc(2 * btb->seen_capacity * sizeof(int));
+        if (!grown)
+        {
+            return TRUE;
+        }
+        old_capacity = btb->seen_capacity;
+        btb->seen_capacity *= 2;
+        mask = btb->seen_capacity - 1;
+        for (i = 0; i < btb->seen_capacity; ++i)
+        {
+            grown[i] = BTB_EMPTY_TAG;
+        }
+        for (i = 0; i < old_capacity; ++i)
+        {
+            if (btb->seen[i] == BTB_EMPTY_TAG)
+            {
+                continue;
+            }
+            slot = APEX_btb_hash(btb->seen[i]) & mask;
+            while (grown[slot] != BTB_EMPTY_TAG)
+            {
+                slot = (slot + 1) & mask;
+            }
+            grown[slot] = btb->seen[i];
+        }
+        free(btb->seen);
+        btb->seen = grown;
+    }
+    return TRUE;
+}
+
+/*
+ * Counts the lookup of the branch at pc and classifies it if it missed. The
+ * fully associative LRU shadow buffer is updated on every branch, so it
+ * tracks what the real buffer would hold with no set conflicts.
+ */
+void
+APEX_btb_account(APEX_BTB *btb, int pc, int hit)
+{
+    int entry = APEX_btb_shadow_find(btb, pc);
+    int shadow_hit = entry >= 0;
+
+    if (!shadow_hit)
+    {
+        entry = btb->shadow_tail;
+        if (btb->shadow_tags[entry] != BTB_EMPTY_TAG)
+        {
+            APEX_btb_shadow_remove(btb, entry);
+        }
+        btb->shadow_tags[entry] = pc;
+        APEX_btb_shadow_insert(btb, entry);
+    }
+    APEX_btb_shadow_touch(btb, entry);
+
+    btb->stats.lookups++;
+    if (hit)
+    {
+        btb->stats.hits++;
+        return;
+    }
+
+    btb->stats.misses++;
+    if (APEX_btb_first_sight(btb, pc))
+    {
+        btb->stats.compulsory_misses++;
+    }
+    else if (shadow_hit)
+    {
+        btb->stats.conflict_misses++;
+    }
+    else
+    {
+        btb->stats.capacity_misses++;
+    }
+}
+
+/*
+ * Prints the geometry and hit rate of the BTB with the breakdown of its
+ * misses
+ */
+void
+APEX_btb_report(const APEX_BTB *btb, FILE *out)
+{
+    const APEX_BTBStats *stats = &btb->stats;
+
+    fprintf(out, "APEX_CPU: BTB %d sets x %d ways %s, lookups = %lld hits = %lld "
+            "(%.2f%%) misses = %lld compulsory = %lld capacity = %lld conflict = %lld\n",
+            btb->sets, btb->ways, APEX_btb_policy_name(btb->policy), stats->lookups,
+            stats->hits, stats->lookups ? 100.0 * stats->hits / stats->lookups : 0.0,
+            stats->misses, stats->compulsory_misses, stats->capacity_misses,
+            stats->conflict_misses);
+}
+
+/*
+ * Maps the value of a --btb-replace=<policy> option to a BTB_REPLACE_*
+ * policy, returns -1 if the policy is unknown
+ */
+int
+APEX_btb_parse_policy(const char *name)
+{
+    int i;
+
+    for (i = 0; i < (int)(sizeof(btb_policy_names) / sizeof(btb_policy_names[0])); ++i)
+    {
+        if (strcmp(name, btb_policy_names[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *
+APEX_btb_policy_name(int policy)
+{
+    return btb_policy_names[policy];
+}
+
+/*
+ * Appends the complete BTB state to a checkpoint, returns 0 on success and
+ * -1 on failure
+ */
+int
+APEX_btb_save(const APEX_BTB *btb, FILE *fp)
+{
+    APEX_BTBState state;
+    size_t size = APEX_btb_size(btb);
+    int entry;
+
+    memset(&state, 0, sizeof(state));
+    state.sets = btb->sets;
+    state.ways = btb->ways;
+    state.policy = btb->policy;
+    state.tick = btb->tick;
+    state.rng = btb->rng;
+    state.seen_capacity = btb->seen_capacity;
+    state.seen_count = btb->seen_count;
+    state.stats = btb->stats;
+
+    if (fwrite(&state, sizeof(state), 1, fp) != 1 ||
+        fwrite(btb->entries, sizeof(BTBentry), size, fp) != size ||
+        fwrite(btb->tags, sizeof(int), size, fp) != size ||
+        fwrite(btb->repl, sizeof(unsigned long long), size, fp) != size)
+    {
+        return -1;
+    }
+
+    for (entry = btb->shadow_head; entry >= 0; entry = btb->shadow_next[entry])
+    {
+        if (fwrite(&btb->shadow_tags[entry], sizeof(int), 1, fp) != 1)
+        {
+            return -1;
+        }
+    }
+
+    if (fwrite(btb->seen, sizeof(int), btb->seen_capacity, fp) !=
+        (size_t)btb->seen_capacity)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Checks that data holds BTB state saved by APEX_btb_save from a BTB of the
+ * same geometry and policy, returns its length or -1
+ */
+long
+APEX_btb_check(const APEX_BTB *btb, const void *data, long size)
+{
+    const APEX_BTBState *state = data;
+    long length;
+
+    if (size < (long)sizeof(APEX_BTBState) || state->sets != btb->sets ||
+        state->ways != btb->ways || state->policy != btb->policy ||
+        !is_power_of_two(state->seen_capacity) ||
+        state->seen_count >= state->seen_capacity)
+    {
+        return -1;
+    }
+
+    length = sizeof(APEX_BTBState) +
+             APEX_btb_size(btb) * (long)(sizeof(BTBentry) + 2 * sizeof(int) +
+                                         sizeof(unsigned long long)) +
+             state->seen_capacity * (long)sizeof(int);
+    return size < length ? -1 : length;
+}
+
+/*
+ * Loads BTB state that passed APEX_btb_check. Returns 0 on success and -1
+ * if memory runs out, leaving the BTB untouched.
+ */
+int
+APEX_btb_load(APEX_BTB *btb, const void *data)
+{
+    const APEX_BTBState *state = data;
+    const char *arrays = (const char *)data + sizeof(APEX_BTBState);
+    long entries = APEX_btb_size(btb);
+    int *seen;
+
+    seen = malloc(state->seen_capacity * sizeof(int));
+    if (!seen)
+    {
+        return -1;
+    }
+
+    btb->tick = state->tick;
+    btb->rng = state->rng;
+    btb->stats = state->stats;
+    memcpy(btb->entries, arrays, entries * sizeof(BTBentry));
+    arrays += entries * sizeof(BTBentry);
+    memcpy(btb->tags, arrays, entries * sizeof(int));
+    arrays += entries * sizeof(int);
+    memcpy(btb->repl, arrays, entries * sizeof(unsigned long long));
+    arrays += entries * sizeof(unsigned long long);
+    memcpy(btb->shadow_tags, arrays, entries * sizeof(int));
+    arrays += entries * sizeof(int);
+    APEX_btb_shadow_link(btb);
+    memcpy(seen, arrays, state->seen_capacity * sizeof(int));
+    free(btb->seen);
+    btb->seen = seen;
+    btb->seen_capacity = state->seen_capacity;
+    btb->seen_count = state->seen_count;
+    return 0;
+}
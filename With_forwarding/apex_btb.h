@@ -0,0 +1,78 @@
+/*
+ * apex_btb.h
+ * Contains the set-associative branch target buffer declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_BTB_H_
+#define _APEX_BTB_H_
+
+#include <stdio.h>
+
+typedef struct BTBentry
+{
+    int i_address;
+    int h_bits[2];
+    int t_address;
+    int valid;
+}BTBentry;
+
+/* Branch lookups and how the misses split up. A miss is compulsory the first
+ * time a branch is seen, a conflict miss if a fully associative LRU buffer of
+ * the same size would have hit, and a capacity miss otherwise. */
+typedef struct APEX_BTBStats
+{
+    long long lookups;
+    long long hits;
+    long long misses;
+    long long compulsory_misses;
+    long long capacity_misses;
+    long long conflict_misses;
+} APEX_BTBStats;
+
+/* Branch target buffer of sets x ways entries. An entry lives in the set
+ * picked by the low bits of its word address and is found by comparing its
+ * full address, kept in a tag array of its own so a set is one contiguous
+ * run of ints. */
+typedef struct APEX_BTB
+{
+    int sets;                      /* Power of two */
+    int ways;
+    int policy;                    /* One of BTB_REPLACE_* */
+    BTBentry *entries;             /* sets * ways, set major */
+    int *tags;                     /* Branch address of each entry, -1 if empty */
+    unsigned long long *repl;      /* Replacement state, see apex_btb.c */
+    unsigned long long tick;       /* LRU time stamp */
+    unsigned int rng;              /* Random replacement state */
+    APEX_BTBStats stats;
+
+    /* Miss classification */
+    int *shadow_tags;              /* Fully associative LRU buffer of sets * ways */
+    int *shadow_prev;              /* LRU list through the shadow entries */
+    int *shadow_next;
+    int shadow_head;               /* Most recently used entry */
+    int shadow_tail;               /* Least recently used entry, the next victim */
+    int *shadow_buckets;           /* Hash of the shadow tags, first entry of each chain */
+    int *shadow_chain;             /* Next entry in the same bucket */
+    int shadow_mask;               /* Buckets - 1 */
+    int *seen;                     /* Open addressed set of branches seen so far */
+    int seen_capacity;
+    int seen_count;
+} APEX_BTB;
+
+int APEX_btb_init(APEX_BTB *btb, int sets, int ways, int policy);
+void APEX_btb_free(APEX_BTB *btb);
+int APEX_btb_size(const APEX_BTB *btb);
+int APEX_btb_lookup(APEX_BTB *btb, int pc);
+int APEX_btb_allocate(APEX_BTB *btb, int pc);
+void APEX_btb_account(APEX_BTB *btb, int pc, int hit);
+void APEX_btb_report(const APEX_BTB *btb, FILE *out);
+int APEX_btb_parse_policy(const char *name);
+const char *APEX_btb_policy_name(int policy);
+int APEX_btb_save(const APEX_BTB *btb, FILE *fp);
+long APEX_btb_check(const APEX_BTB *btb, const void *data, long size);
+int APEX_btb_load(APEX_BTB *btb, const void *data);
+
+#endif
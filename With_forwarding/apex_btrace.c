@@ -0,0 +1,161 @@
+/*
+ * apex_btrace.c
+ * Contains the branch stream writer used by the pipeline and the reader
+ * used by the predictor evaluator
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "apex_btrace.h"
+#include "apex_macros.h"
+
+/*
+ * Creates filename and starts a branch stream in it, returns 0 on success
+ * and -1 on failure
+ */
+int
+APEX_btrace_open(APEX_BranchTrace *bt, const char *filename)
+{
+    APEX_BranchTraceHeader header;
+
+    memset(bt, 0, sizeof(*bt));
+    bt->buffer = malloc(APEX_BTRACE_BUFFER * sizeof(APEX_BranchRecord));
+    if (!bt->buffer)
+    {
+        return -1;
+    }
+
+    bt->fp = fopen(filename, "wb");
+    if (!bt->fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to create branch trace %s\n", filename);
+        free(bt->buffer);
+        bt->buffer = NULL;
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = APEX_BTRACE_MAGIC;
+    header.version = APEX_BTRACE_VERSION;
+    fwrite(&header, sizeof(header), 1, bt->fp);
+    return 0;
+}
+
+static void
+APEX_btrace_flush(APEX_BranchTrace *bt)
+{
+    fwrite(bt->buffer, sizeof(APEX_BranchRecord), bt->buffered, bt->fp);
+    bt->buffered = 0;
+}
+
+void
+APEX_btrace_write(APEX_BranchTrace *bt, const APEX_BranchRecord *record)
+{
+    bt->buffer[bt->buffered++] = *record;
+    bt->records++;
+    if (bt->buffered == APEX_BTRACE_BUFFER)
+    {
+        APEX_btrace_flush(bt);
+    }
+}
+
+/*
+ * Writes out the buffered records and completes the header with the
+ * record count and the instructions retired since the stream started.
+ * Returns 0 on success and -1 if the stream could not be written.
+ */
+int
+APEX_btrace_close(APEX_BranchTrace *bt, int insn_completed)
+{
+    APEX_BranchTraceHeader header;
+    int ret = 0;
+
+    if (!bt->fp)
+    {
+        return 0;
+    }
+
+    APEX_btrace_flush(bt);
+    memset(&header, 0, sizeof(header));
+    header.magic = APEX_BTRACE_MAGIC;
+    header.version = APEX_BTRACE_VERSION;
+    header.records = bt->records;
+    header.instructions = insn_completed - bt->insn_base;
+    if (ferror(bt->fp) || fseek(bt->fp, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, bt->fp) != 1)
+    {
+        ret = -1;
+    }
+    if (fclose(bt->fp) != 0)
+    {
+        ret = -1;
+    }
+    free(bt->buffer);
+    memset(bt, 0, sizeof(*bt));
+    return ret;
+}
+
+/*
+ * Maps a branch stream read-only and returns its first record, with the
+ * header in *header and the length of the mapping in *map_size. Returns
+ * NULL if the file is not a complete stream of this version.
+ */
+const APEX_BranchRecord *
+APEX_btrace_map(const char *filename, APEX_BranchTraceHeader *header, size_t *map_size)
+{
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open branch trace %s\n", filename);
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(APEX_BranchTraceHeader))
+    {
+        fprintf(stderr, "APEX_Error: %s is not a branch trace\n", filename);
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "APEX_Error: Unable to map branch trace %s\n", filename);
+        return NULL;
+    }
+    memcpy(header, map, sizeof(*header));
+
+    if (header->magic != APEX_BTRACE_MAGIC || header->version != APEX_BTRACE_VERSION ||
+        header->records < 0 ||
+        (off_t)(sizeof(*header) + header->records * sizeof(APEX_BranchRecord)) != st.st_size)
+    {
+        fprintf(stderr, "APEX_Error: %s is not a complete branch trace of this build\n",
+                filename);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    /* The records are read once front to back */
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    *map_size = st.st_size;
+    return (const APEX_BranchRecord *)((const char *)map + sizeof(*header));
+}
+
+void
+APEX_btrace_unmap(const APEX_BranchRecord *records, size_t map_size)
+{
+    munmap((char *)records - sizeof(APEX_BranchTraceHeader), map_size);
+}
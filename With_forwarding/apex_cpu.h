@@ -9,61 +9,151 @@
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 
+#include "apex_bpred.h"
+#include "apex_btrace.h"
+#include "apex_cache.h"
+#include "apex_fu.h"
+#include "apex_ifetch.h"
+#include "apex_isa.h"
+#include "apex_lsq.h"
+#include "apex_memory.h"
+#include "apex_ooo.h"
+#include "apex_perf.h"
 #include "apex_macros.h"
 
-/* Format of an APEX instruction  */
+struct APEX_CPU;
+struct APEX_OpHandler;
+
+/* Format of an APEX instruction, decoded once when the program is loaded */
 typedef struct APEX_Instruction
 {
-    char opcode_str[128];
-    int opcode;
-    int rd;
-    int rs1;
-    int rs2;
+    unsigned char opcode;
+    unsigned char mnemonic;        /* Entry in the instruction set table */
+    unsigned char rd;
+    unsigned char rs1;
+    unsigned char rs2;
     int imm;
+    unsigned int src_mask;         /* Registers read, one bit per register */
+    unsigned int dst_mask;         /* Registers written */
+    const struct APEX_OpHandler *ops; /* Stage handlers bound at load time */
 } APEX_Instruction;
 
-typedef struct BTBentry
-{
-    int i_address;
-    int h_bits[2];
-    int t_address;
-    int valid;
-}BTBentry;
-
 
-/* Model of CPU stage latch */
+/* Micro-op held in a pipeline latch. Register numbers and flags are packed
+ * in front of the values so a whole micro-op fits in 56 bytes, inside one
+ * cache line. */
 typedef struct CPU_Stage
 {
+    unsigned char opcode;
+    unsigned char mnemonic;
+    unsigned char rd;
+    unsigned char rs1;
+    unsigned char rs2;
+    unsigned char btb_hit_bit;
+    unsigned char predict_taken;
+    unsigned char bp_slot;         /* Predictor record of a conditional branch */
     int pc;
-    char opcode_str[128];
-    int opcode;
-    int rs1;
-    int rs2;
-    int rd;
     int imm;
     int rs1_value;
     int rs2_value;
     int result_buffer;
     int memory_address;
-    int has_insn;
-    int btb_hit_bit;
     int btb_index;
-    int predict_taken;
+    int target_pc;                 /* Predicted target of a register jump */
+    unsigned int src_mask;
+    unsigned int dst_mask;
+    const struct APEX_OpHandler *ops;
 } CPU_Stage;
 
+/* Per-opcode behaviour. Instructions are bound to one of these when the
+ * program is loaded and every stage calls through it. */
+typedef struct APEX_OpHandler
+{
+    void (*execute)(struct APEX_CPU *cpu, CPU_Stage *stage);
+    void (*memory)(struct APEX_CPU *cpu, CPU_Stage *stage);
+    void (*writeback)(struct APEX_CPU *cpu, CPU_Stage *stage);
+    int operands;                  /* OPERAND_* flags */
+    int (*taken)(const struct APEX_CPU *cpu); /* Branch condition, NULL otherwise */
+} APEX_OpHandler;
+
 
+/* Simulator options, filled in from the command line or a batch manifest */
+typedef struct APEX_Config
+{
+    int trace_level;               /* One of TRACE_OFF .. TRACE_FULL */
+    int fast_forward;              /* Run the functional model before the pipeline */
+    int ff_insns;                  /* Instructions to fast-forward, 0 for no limit */
+    int ff_until;                  /* PC to stop fast-forwarding at, -1 for none */
+    const char *restore_file;      /* Checkpoint to start from */
+    const char *checkpoint_file;   /* Checkpoint to save when the run stops */
+    int btb_sets;                  /* BTB sets, a power of two */
+    int btb_ways;                  /* BTB entries per set */
+    int btb_policy;                /* One of BTB_REPLACE_* */
+    int bpred_kind;                /* One of BPRED_* */
+    int bpred_entries;             /* Predictor table rows, 0 for the default */
+    int bpred_history;             /* Global history bits, 0 for the default */
+    int ras_entries;               /* Return address stack entries, 0 for none */
+    int itp_entries;               /* Indirect target predictor rows, 0 for none */
+    const char *branch_trace_file; /* Branch stream to write, NULL for none */
+    const char *perf_report_file;  /* Counter report to write, NULL for none */
+    int perf_format;               /* One of PERF_FORMAT_* */
+    int backend;                   /* One of BACKEND_* */
+    int rob_entries;               /* Out-of-order backend sizes */
+    int iq_entries;
+    int prf_entries;
+    APEX_FUConfig units[FU_CLASS_COUNT]; /* Functional units of each FU_* class */
+    int lsq_entries;               /* Store buffer entries */
+    int width;                     /* Instructions fetched, decoded and retired per cycle */
+    APEX_CacheConfig dcache[CACHE_LEVELS]; /* L1D and L2, a size of 0 leaves a level out */
+    int dcache_write;              /* One of CACHE_WRITE_* */
+    int dcache_policy;             /* One of BTB_REPLACE_* */
+    int memory_latency;            /* Cycles of data memory behind the cache */
+    APEX_CacheConfig icache;       /* L1I, a size of 0 leaves it out */
+    int icache_miss_latency;       /* Cycles of code memory behind the L1I */
+    int icache_prefetch;           /* Lines after a miss to prefetch */
+    int fetch_buffer;              /* Fetch buffer entries */
+    int data_memory_size;          /* Words of data memory */
+    int huge_pages;                /* One of MEMORY_HUGE_OFF and MEMORY_HUGE_TLB */
+    const char *data_image_file;   /* Initial data memory, NULL for all zero */
+    const char *data_dump_file;    /* Final data memory to write, NULL for none */
+    int code_cache;                /* Keep assembled programs next to their sources */
+    int memory_checksum;           /* One of MEMORY_CHECKSUM_* */
+    unsigned int expected_checksum;
+    const char *bench_variant;     /* Build the bench mode reports for */
+    const char *bench_baseline;    /* CSV of an earlier bench run, NULL for none */
+    int bench_tolerance;           /* Percent slowdown flagged against the baseline */
+    int idle_skip;                 /* Jump over cycles in which nothing can change */
+} APEX_Config;
 
-/* Model of APEX CPU */
+/* Registers with a write in flight, one bit per register */
+typedef struct Scoreboard
+{
+    unsigned int busy;
+    unsigned int loads;            /* Of those, the ones a load is reading from memory */
+} Scoreboard;
+
+/* Instructions moving through a stage side by side in one cycle, oldest
+ * first */
+typedef struct APEX_Group
+{
+    CPU_Stage *lanes[APEX_MAX_WIDTH];
+    int count;
+} APEX_Group;
+
+/* Model of APEX CPU. Every piece of simulator state lives here, so any
+ * number of CPUs can run side by side in one process. */
 typedef struct APEX_CPU
 {
     int pc;                        /* Current program counter */
     int clock;                     /* Clock cycles elapsed */
     int insn_completed;            /* Instructions retired */
+    int insn_fast_forwarded;       /* Instructions run by the functional model */
     int regs[REG_FILE_SIZE];       /* Integer register file */
     int code_memory_size;          /* Number of instruction in the input file */
     APEX_Instruction *code_memory; /* Code Memory */
-    int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
+    APEX_Memory data_memory;       /* Data Memory, paged in on first touch */
     int single_step;               /* Wait for user input after every cycle */
+    int trace_level;               /* One of TRACE_OFF .. TRACE_FULL */
     int zero_flag;                 /* {TRUE, FALSE} Used by BZ and BNZ to branch */
     int positive_flag;
     int negative_flag;
@@ -74,23 +164,63 @@ typedef struct APEX_CPU
     int stall_at_decode;
     int target_address;
     int actual_taken;
-    BTBentry BTBentry[BTB_SIZE];
+    APEX_BTB btb;                  /* Branch target buffer */
+    APEX_BPred bpred;              /* Branch direction and jump target predictors */
+    APEX_BranchTrace branch_trace; /* Resolved branches, written with --branch-trace */
+    APEX_PerfCounters perf;        /* Pipeline events, reported with --perf-report */
+    APEX_OoO ooo;                  /* Out-of-order backend, rob is NULL when in-order */
+    APEX_FUnits units;             /* Execute stage functional units */
+    APEX_LSQ lsq;                  /* Store buffer in front of data_memory */
+    APEX_Cache dcache;             /* Data cache timing, count is 0 when it is off */
+    APEX_IFetch ifetch;            /* L1I and fetch buffer, off with the L1I */
+
+    /* Pipeline stages. Each latch points at one of the micro-op slots and an
+     * instruction moves to the next stage by handing over its slot pointer. */
+    CPU_Stage slots[APEX_LATCH_SLOTS];
+    CPU_Stage *fetch;
+    CPU_Stage *decode;
+    CPU_Stage *execute;
+    CPU_Stage *memory;
+    CPU_Stage *writeback;
+    int fetch_has_insn;
+    int decode_has_insn;
+    int execute_has_insn;
+    int memory_has_insn;
+    int writeback_has_insn;
+    int slot_cursor;               /* Last slot handed out by APEX_free_slot */
 
-    /* Pipeline stages */
-    CPU_Stage fetch;
-    CPU_Stage decode;
-    CPU_Stage execute;
-    CPU_Stage memory;
-    CPU_Stage writeback;
+    /* Lanes of each latch, live while its *_has_insn is TRUE. A stage works
+     * through its lanes in order with its latch pointer on the lane in hand;
+     * fetch fills the decode lanes. */
+    int width;
+    APEX_Group decode_group;
+    APEX_Group execute_group;
+    APEX_Group memory_group;
+    APEX_Group writeback_group;
+    int memory_wait;               /* Cycles the memory lanes still spend in the cache */
+    Scoreboard scoreboard;
+    int stall_flag;                /* Decode is holding its instruction */
+    int idle_skip;                 /* Jump over cycles in which nothing can change */
+    long long idle_cycles;         /* Cycles jumped over */
 } APEX_CPU;
 
 APEX_Instruction *create_code_memory(const char *filename, int *size);
-APEX_CPU *APEX_cpu_init(const char *filename);
-void APEX_cpu_run(APEX_CPU *cpu, int num_of_cycles);
+APEX_Instruction *APEX_load_program(const char *filename, int code_cache, int *size);
+int APEX_assemble(const char *source, const char *object);
+unsigned int APEX_fnv1a(unsigned int hash, const void *data, size_t size);
+int APEX_hash_file(const char *filename, unsigned int *hash);
+APEX_CPU *APEX_cpu_init(const char *filename, const APEX_Config *config);
+int APEX_cpu_run(APEX_CPU *cpu, int num_of_cycles);
+int APEX_cpu_fast_forward(APEX_CPU *cpu, int num_insns, int stop_pc);
+int APEX_cpu_checkpoint(const APEX_CPU *cpu, const char *filename);
+int APEX_cpu_restore(APEX_CPU *cpu, const char *filename);
 void APEX_cpu_stop(APEX_CPU *cpu);
+int APEX_cpu_execute(APEX_CPU *cpu, CPU_Stage *stage);
+void APEX_cpu_redirect(APEX_CPU *cpu, const CPU_Stage *stage);
+void APEX_cpu_count_branch(APEX_CPU *cpu, const CPU_Stage *stage, int taken, int redirected);
+void APEX_decode_advance(APEX_CPU *cpu, int n);
 void display(APEX_CPU *cpu);
 int BTBHit(APEX_CPU *cpu, int pc);
-void flipbits(int index, int a_taken);
 void actual(APEX_CPU *cpu, int actual_taken, int predict_taken, int btb_hit_bit, int index);
 
 #endif
\ No newline at end of file
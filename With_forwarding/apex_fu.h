@@ -0,0 +1,55 @@
+/*
+ * apex_fu.h
+ * Contains the execute stage functional unit declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_FU_H_
+#define _APEX_FU_H_
+
+#include <stdio.h>
+
+#include "apex_macros.h"
+
+/* Units of one class. A unit takes a new instruction every interval cycles
+ * and finishes each one latency cycles after it started. */
+typedef struct APEX_FUConfig
+{
+    int count;
+    int latency;
+    int interval;
+} APEX_FUConfig;
+
+/* Functional units of the execute stage. Instructions issue into a unit in
+ * program order and leave for memory in program order once their latency
+ * has passed, from a queue of the latch slots they occupy. */
+typedef struct APEX_FUnits
+{
+    APEX_FUConfig config[FU_CLASS_COUNT];
+    int next_issue[FU_CLASS_COUNT][FU_MAX_UNITS]; /* Clock each unit is free again */
+    int queue_slot[FU_MAX_INFLIGHT];  /* Latch slots in flight, a ring from queue_head */
+    int queue_done[FU_MAX_INFLIGHT];  /* Clock each one finishes in */
+    int queue_head;
+    int queue_count;
+    unsigned long long slot_mask;  /* Slots in the queue, one bit per slot */
+    long long issued[FU_CLASS_COUNT];
+    long long busy[FU_CLASS_COUNT]; /* Unit cycles spent not accepting an instruction */
+} APEX_FUnits;
+
+void APEX_fu_defaults(APEX_FUConfig *config);
+int APEX_fu_parse(APEX_FUConfig *config, const char *spec);
+int APEX_fu_init(APEX_FUnits *fu, const APEX_FUConfig *config);
+void APEX_fu_reset(APEX_FUnits *fu);
+int APEX_fu_class(int opcode);
+const char *APEX_fu_name(int fu_class);
+int APEX_fu_free(const APEX_FUnits *fu, int fu_class, int clock);
+int APEX_fu_accepts(const APEX_FUnits *fu, int fu_class, int clock, int claimed, int total);
+int APEX_fu_reserve(APEX_FUnits *fu, int fu_class, int clock);
+void APEX_fu_issue(APEX_FUnits *fu, int fu_class, int slot, int clock);
+int APEX_fu_complete(APEX_FUnits *fu, int clock);
+int APEX_fu_next_event(const APEX_FUnits *fu, int clock);
+void APEX_fu_report(const APEX_FUnits *fu, long long clock, long long stalls, FILE *out);
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * apex_ifetch.h
+ * Contains the instruction cache and fetch buffer declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_IFETCH_H_
+#define _APEX_IFETCH_H_
+
+#include <stdio.h>
+
+#include "apex_cache.h"
+#include "apex_macros.h"
+
+/* Sequential instructions from head_pc on whose lines have been asked for,
+ * oldest first in a ring from head. Each one can go to decode from the
+ * cycle its line arrives in. */
+typedef struct APEX_FetchBuffer
+{
+    int entries;                   /* Capacity, from --fetch-buffer */
+    int head;
+    int count;
+    int head_pc;                   /* Address of the instruction at head */
+    int ready[IFETCH_MAX_BUFFER];  /* Clock each instruction's line arrives in */
+} APEX_FetchBuffer;
+
+/* Front end in front of code memory. Fetch asks the L1I for one line a
+ * cycle ahead of decode into the fetch buffer, so the instructions already
+ * buffered keep decode busy while a miss is outstanding. */
+typedef struct APEX_IFetch
+{
+    APEX_Cache icache;             /* One level, off when --l1i is not given */
+    int prefetch;                  /* Lines after a miss brought in with it */
+    APEX_FetchBuffer buffer;
+} APEX_IFetch;
+
+int APEX_ifetch_init(APEX_IFetch *ifetch, const APEX_CacheConfig *config, int policy,
+                     int miss_latency, int prefetch, int entries);
+void APEX_ifetch_free(APEX_IFetch *ifetch);
+void APEX_ifetch_flush(APEX_IFetch *ifetch);
+void APEX_ifetch_fill(APEX_IFetch *ifetch, int pc, int last_pc, int clock);
+int APEX_ifetch_ready(const APEX_IFetch *ifetch, int pc, int clock);
+void APEX_ifetch_advance(APEX_IFetch *ifetch);
+int APEX_ifetch_next_event(const APEX_IFetch *ifetch, int clock);
+void APEX_ifetch_report(const APEX_IFetch *ifetch, long long stalls, FILE *out);
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * apex_lsq.h
+ * Contains the load/store queue declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_LSQ_H_
+#define _APEX_LSQ_H_
+
+#include <stdio.h>
+
+#include "apex_memory.h"
+#include "apex_macros.h"
+
+typedef struct APEX_StoreEntry
+{
+    int address;
+    int data;
+} APEX_StoreEntry;
+
+/* Stores that have left the memory stage but not yet written data memory,
+ * oldest first in a ring from head. Loads take their value from the
+ * youngest buffered store to the same address before data memory. */
+typedef struct APEX_LSQ
+{
+    APEX_StoreEntry stores[LSQ_MAX_ENTRIES];
+    int entries;                   /* Capacity, from --lsq-entries */
+    int head;
+    int count;
+    int port_busy;                 /* Data memory was accessed this cycle */
+    long long loads;
+    long long stores_buffered;
+    long long forwarded;           /* Loads served by a buffered store */
+    long long full_drains;         /* Stores that found the buffer full */
+} APEX_LSQ;
+
+int APEX_lsq_init(APEX_LSQ *lsq, int entries);
+int APEX_lsq_find(const APEX_LSQ *lsq, int address);
+int APEX_lsq_load(APEX_LSQ *lsq, int address, APEX_Memory *memory);
+void APEX_lsq_store(APEX_LSQ *lsq, int address, int data, APEX_Memory *memory);
+void APEX_lsq_cycle(APEX_LSQ *lsq, APEX_Memory *memory);
+void APEX_lsq_idle(APEX_LSQ *lsq, APEX_Memory *memory, int cycles);
+void APEX_lsq_flush(APEX_LSQ *lsq, APEX_Memory *memory);
+void APEX_lsq_report(const APEX_LSQ *lsq, long long load_use, FILE *out);
+
+#endif
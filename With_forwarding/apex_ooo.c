@@ -0,0 +1,748 @@
+/*
+ * apex_ooo.c
+ * Contains the out-of-order backend. Instructions are renamed onto a
+ * physical register file, issue from an issue queue oldest-ready first, run
+ * through the same stage handlers as the in-order pipeline and commit from
+ * a reorder buffer in program order.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_ooo.h"
+#include "apex_macros.h"
+
+/* An instruction from rename until it commits */
+typedef struct APEX_ROBEntry
+{
+    CPU_Stage uop;
+    int state;                     /* One of OOO_* */
+    int done_cycle;                /* Clock an executing instruction completes at */
+    int taken;                     /* A conditional branch went taken */
+    int redirected;                /* It redirected fetch, counted at commit */
+    int src[3];                    /* Physical rs1, rs2 and flags, -1 if not read */
+    int num_dst;
+    int dst_arch[OOO_MAX_DESTS];   /* Architectural registers written */
+    int dst_phys[OOO_MAX_DESTS];   /* Physical registers they are renamed to */
+    int prev_phys[OOO_MAX_DESTS];  /* Previous mappings, freed at commit */
+    int dst_value[OOO_MAX_DESTS];
+} APEX_ROBEntry;
+
+/*
+ * Allocates a backend with the given sizes. Returns 0 on success and -1 if
+ * a size is out of range.
+ */
+int
+APEX_ooo_init(APEX_OoO *ooo, int rob_entries, int iq_entries, int prf_entries)
+{
+    memset(ooo, 0, sizeof(*ooo));
+
+    if (rob_entries < 1 || rob_entries > APEX_BPRED_INFLIGHT - 8)
+    {
+        fprintf(stderr, "APEX_Error: Reorder buffer entries must be 1 to %d\n",
+                APEX_BPRED_INFLIGHT - 8);
+        return -1;
+    }
+
+    if (iq_entries < 1 || iq_entries > rob_entries)
+    {
+        fprintf(stderr, "APEX_Error: Issue queue entries must be 1 to the reorder buffer "
+                "entries\n");
+        return -1;
+    }
+
+    /* Every architectural register keeps a mapping, plus enough to rename
+     * the widest instruction into while the reorder buffer is empty */
+    if (prf_entries < OOO_ARCH_REGS + OOO_MAX_DESTS || prf_entries > 4096)
+    {
+        fprintf(stderr, "APEX_Error: Physical registers must be %d to 4096\n",
+                OOO_ARCH_REGS + OOO_MAX_DESTS);
+        return -1;
+    }
+
+    ooo->rob_entries = rob_entries;
+    ooo->iq_entries = iq_entries;
+    ooo->prf_entries = prf_entries;
+    ooo->rob = calloc(rob_entries, sizeof(APEX_ROBEntry));
+    ooo->iq = calloc(iq_entries, sizeof(int));
+    ooo->prf = calloc(prf_entries, sizeof(int));
+    ooo->prf_ready = calloc(prf_entries, sizeof(unsigned char));
+    ooo->free_list = calloc(prf_entries, sizeof(int));
+    if (!ooo->rob || !ooo->iq || !ooo->prf || !ooo->prf_ready || !ooo->free_list)
+    {
+        APEX_ooo_free(ooo);
+        return -1;
+    }
+    return 0;
+}
+
+void
+APEX_ooo_free(APEX_OoO *ooo)
+{
+    free(ooo->rob);
+    free(ooo->iq);
+    free(ooo->prf);
+    free(ooo->prf_ready);
+    free(ooo->free_list);
+    memset(ooo, 0, sizeof(*ooo));
+}
+
+/*
+ * Maps the value of a --backend=<kind> option to a BACKEND_* value,
+ * returns -1 if the backend is unknown
+ */
+int
+APEX_ooo_parse_backend(const char *name)
+{
+    if (strcmp(name, "inorder") == 0)
+    {
+        return BACKEND_INORDER;
+    }
+
+    if (strcmp(name, "ooo") == 0)
+    {
+        return BACKEND_OOO;
+    }
+
+    return -1;
+}
+
+/* Condition flags packed into one physical register */
+static int
+APEX_ooo_get_flags(const APEX_CPU *cpu)
+{
+    return (cpu->zero_flag != 0) | (cpu->positive_flag != 0) << 1 |
+           (cpu->negative_flag != 0) << 2;
+}
+
+static void
+APEX_ooo_set_flags(APEX_CPU *cpu, int flags)
+{
+    cpu->zero_flag = flags & 1;
+    cpu->positive_flag = (flags >> 1) & 1;
+    cpu->negative_flag = (flags >> 2) & 1;
+}
+
+/*
+ * Starts the backend from the architectural state when nothing is in
+ * flight, as after initialization, fast-forward or a previous run that
+ * drained. Every architectural register maps to the physical register of
+ * the same number and the rest are free.
+ */
+void
+APEX_ooo_sync(APEX_CPU *cpu)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    int i;
+
+    if (!ooo->rob || ooo->rob_count)
+    {
+        return;
+    }
+
+    for (i = 0; i < OOO_ARCH_REGS; ++i)
+    {
+        ooo->map[i] = i;
+        ooo->prf[i] = i == OOO_FLAGS_REG ? APEX_ooo_get_flags(cpu) : cpu->regs[i];
+        ooo->prf_ready[i] = TRUE;
+    }
+
+    ooo->free_head = 0;
+    ooo->free_count = 0;
+    for (i = OOO_ARCH_REGS; i < ooo->prf_entries; ++i)
+    {
+        ooo->free_list[ooo->free_count++] = i;
+    }
+    ooo->rob_head = 0;
+    ooo->stores = 0;
+    ooo->iq_count = 0;
+}
+
+static void
+APEX_ooo_release(APEX_OoO *ooo, int phys)
+{
+    ooo->free_list[(ooo->free_head + ooo->free_count) % ooo->prf_entries] = phys;
+    ooo->free_count++;
+}
+
+static int
+APEX_ooo_allocate(APEX_OoO *ooo)
+{
+    int phys = ooo->free_list[ooo->free_head];
+
+    ooo->free_head = (ooo->free_head + 1) % ooo->prf_entries;
+    ooo->free_count--;
+    ooo->prf_ready[phys] = FALSE;
+    return phys;
+}
+
+static int
+APEX_ooo_is_store(const CPU_Stage *uop)
+{
+    return uop->ops->operands & OPERAND_STORES;
+}
+
+static int
+APEX_ooo_is_load(const CPU_Stage *uop)
+{
+    return uop->ops->operands & OPERAND_LOADS;
+}
+
+/* Position of a reorder buffer entry counted from the oldest */
+static int
+APEX_ooo_age(const APEX_OoO *ooo, int index)
+{
+    return (index - ooo->rob_head + ooo->rob_entries) % ooo->rob_entries;
+}
+
+static void
+print_uop(const char *name, const CPU_Stage *uop)
+{
+    printf("%-15s: pc(%d) ", name, uop->pc);
+    APEX_isa_print(uop->mnemonic, uop->rd, uop->rs1, uop->rs2, uop->imm);
+    printf("\n");
+}
+
+/*
+ * Works out the architectural registers an instruction writes, the flags
+ * included. A LOADP with rd equal to rs1 renames that register once.
+ */
+static int
+APEX_ooo_destinations(const CPU_Stage *uop, int *dst)
+{
+    int operands = uop->ops->operands;
+    int n = 0;
+
+    if (operands & OPERAND_WRITES_RD)
+    {
+        dst[n++] = uop->rd;
+    }
+    if (operands & OPERAND_WRITES_RS1)
+    {
+        dst[n++] = uop->rs1;
+    }
+    if (operands & OPERAND_WRITES_RS2)
+    {
+        dst[n++] = uop->rs2;
+    }
+    if (n == 2 && dst[0] == dst[1])
+    {
+        n = 1;
+    }
+    if (operands & OPERAND_WRITES_FLAGS)
+    {
+        dst[n++] = OOO_FLAGS_REG;
+    }
+    return n;
+}
+
+/*
+ * Removes every instruction younger than the one at index after it
+ * redirected fetch, walking the reorder buffer back from the youngest and
+ * undoing its renames
+ */
+static void
+APEX_ooo_squash(APEX_CPU *cpu, int index)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    APEX_ROBEntry *e;
+    int keep = APEX_ooo_age(ooo, index) + 1;
+    int tail;
+    int i;
+    int n;
+
+    while (ooo->rob_count > keep)
+    {
+        tail = (ooo->rob_head + ooo->rob_count - 1) % ooo->rob_entries;
+        e = &ooo->rob[tail];
+        for (i = e->num_dst - 1; i >= 0; --i)
+        {
+            ooo->map[e->dst_arch[i]] = e->prev_phys[i];
+            APEX_ooo_release(ooo, e->dst_phys[i]);
+        }
+        if (APEX_ooo_is_store(&e->uop))
+        {
+            ooo->stores--;
+        }
+        ooo->rob_count--;
+        cpu->perf.events[PERF_FLUSH_SQUASHED]++;
+    }
+
+    for (i = 0, n = 0; i < ooo->iq_count; ++i)
+    {
+        if (APEX_ooo_age(ooo, ooo->iq[i]) < keep)
+        {
+            ooo->iq[n++] = ooo->iq[i];
+        }
+    }
+    ooo->iq_count = n;
+
+    /* Fetch restarts on the correct path, even past a wrong-path HALT */
+    cpu->fetch_has_insn = TRUE;
+    cpu->stall_flag = 0;
+}
+
+/*
+ * Commits the oldest instruction, which is done: stores write memory, the
+ * writeback handler updates the architectural registers and the mappings
+ * it replaced are freed. Returns TRUE if it is HALT.
+ */
+static int
+APEX_ooo_retire(APEX_CPU *cpu, const int trace)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    APEX_ROBEntry *e = &ooo->rob[ooo->rob_head];
+    int i;
+
+    if (APEX_ooo_is_store(&e->uop))
+    {
+        /* The store buffer takes the store, so commit does not wait on the
+         * data cache */
+        if (cpu->dcache.count)
+        {
+            APEX_cache_access(&cpu->dcache, e->uop.memory_address, TRUE);
+        }
+        e->uop.ops->memory(cpu, &e->uop);
+        ooo->stores--;
+        cpu->perf.events[PERF_MEMORY_BUSY]++;
+    }
+    e->uop.ops->writeback(cpu, &e->uop);
+    if (e->redirected || e->uop.ops->taken)
+    {
+        APEX_cpu_count_branch(cpu, &e->uop, e->taken, e->redirected);
+    }
+
+    for (i = 0; i < e->num_dst; ++i)
+    {
+        if (e->dst_arch[i] == OOO_FLAGS_REG)
+        {
+            APEX_ooo_set_flags(cpu, e->dst_value[i]);
+        }
+        APEX_ooo_release(ooo, e->prev_phys[i]);
+    }
+
+    cpu->insn_completed++;
+    cpu->perf.retired[e->uop.opcode]++;
+    ooo->rob_head = (ooo->rob_head + 1) % ooo->rob_entries;
+    ooo->rob_count--;
+
+    if (trace >= TRACE_STAGE)
+    {
+        print_uop("Commit", &e->uop);
+    }
+    return e->uop.opcode == OPCODE_HALT;
+}
+
+/* Commits up to width instructions in program order once they are done,
+ * returns TRUE once HALT commits */
+static int
+APEX_ooo_commit(APEX_CPU *cpu, const int trace)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    int n;
+
+    for (n = 0; n < cpu->width && ooo->rob_count; ++n)
+    {
+        if (ooo->rob[ooo->rob_head].state != OOO_DONE)
+        {
+            break;
+        }
+        cpu->perf.events[PERF_WRITEBACK_BUSY] += n == 0;
+        if (APEX_ooo_retire(cpu, trace))
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Writes the results of instructions completing this cycle to the physical
+ * registers, which wakes up the instructions waiting on them */
+static void
+APEX_ooo_complete(APEX_CPU *cpu)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    APEX_ROBEntry *e;
+    int i;
+    int j;
+
+    for (i = 0; i < ooo->rob_count; ++i)
+    {
+        e = &ooo->rob[(ooo->rob_head + i) % ooo->rob_entries];
+        if (e->state != OOO_EXECUTING || e->done_cycle > cpu->clock)
+        {
+            continue;
+        }
+        for (j = 0; j < e->num_dst; ++j)
+        {
+            ooo->prf[e->dst_phys[j]] = e->dst_value[j];
+            ooo->prf_ready[e->dst_phys[j]] = TRUE;
+        }
+        e->state = OOO_DONE;
+    }
+}
+
+/*
+ * Takes the data of a load at index from the youngest older store to the
+ * same address, which has executed as every older store has once the load
+ * issues. Returns FALSE if no older store writes the address.
+ */
+static int
+APEX_ooo_forward(const APEX_OoO *ooo, int index, CPU_Stage *uop)
+{
+    const CPU_Stage *store;
+    int i;
+
+    for (i = APEX_ooo_age(ooo, index) - 1; ooo->stores && i >= 0; --i)
+    {
+        store = &ooo->rob[(ooo->rob_head + i) % ooo->rob_entries].uop;
+        if (APEX_ooo_is_store(store) && store->memory_address == uop->memory_address)
+        {
+            uop->result_buffer = store->rs1_value;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Runs an issued instruction through its stage handlers with its source
+ * values from the physical registers. Loads read memory here, taking the
+ * data of an older store still in the reorder buffer, and stores wait for
+ * commit. The results are taken from what the writeback handler would
+ * write, with the architectural registers put back afterwards.
+ */
+static void
+APEX_ooo_execute(APEX_CPU *cpu, int index)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    APEX_ROBEntry *e = &ooo->rob[index];
+    CPU_Stage *uop = &e->uop;
+    int flags = APEX_ooo_get_flags(cpu);
+    int saved[OOO_MAX_DESTS];
+    int memory_latency = OOO_MEMORY_LATENCY;
+    int i;
+
+    if (e->src[0] >= 0)
+    {
+        uop->rs1_value = ooo->prf[e->src[0]];
+    }
+    if (e->src[1] >= 0)
+    {
+        uop->rs2_value = ooo->prf[e->src[1]];
+    }
+    if (e->src[2] >= 0)
+    {
+        APEX_ooo_set_flags(cpu, ooo->prf[e->src[2]]);
+    }
+
+    e->redirected = APEX_cpu_execute(cpu, uop);
+    e->taken = cpu->actual_taken;
+    if (e->redirected)
+    {
+        /* There is no memory stage to wait for, a JALR redirects at once */
+        APEX_cpu_redirect(cpu, uop);
+        if (uop->opcode == OPCODE_JALR)
+        {
+            cpu->pc = uop->memory_address;
+        }
+        APEX_ooo_squash(cpu, index);
+    }
+    if (APEX_ooo_is_load(uop) && APEX_ooo_forward(ooo, index, uop))
+    {
+        cpu->lsq.loads++;
+        cpu->lsq.forwarded++;
+    }
+    else if (!APEX_ooo_is_store(uop))
+    {
+        /* Loads, and JALR redirecting fetch. A load the store buffer
+         * cannot serve takes the time of the data cache. */
+        if (cpu->dcache.count && APEX_ooo_is_load(uop) &&
+            APEX_lsq_find(&cpu->lsq, uop->memory_address) < 0)
+        {
+            memory_latency = APEX_cache_access(&cpu->dcache, uop->memory_address, FALSE);
+        }
+        uop->ops->memory(cpu, uop);
+    }
+    if (APEX_ooo_is_load(uop))
+    {
+        cpu->perf.events[PERF_MEMORY_BUSY]++;
+    }
+
+    for (i = 0; i < e->num_dst; ++i)
+    {
+        if (e->dst_arch[i] != OOO_FLAGS_REG)
+        {
+            saved[i] = cpu->regs[e->dst_arch[i]];
+        }
+    }
+    uop->ops->writeback(cpu, uop);
+    for (i = 0; i < e->num_dst; ++i)
+    {
+        if (e->dst_arch[i] == OOO_FLAGS_REG)
+        {
+            e->dst_value[i] = APEX_ooo_get_flags(cpu);
+        }
+        else
+        {
+            e->dst_value[i] = cpu->regs[e->dst_arch[i]];
+        }
+    }
+    for (i = 0; i < e->num_dst; ++i)
+    {
+        if (e->dst_arch[i] != OOO_FLAGS_REG)
+        {
+            cpu->regs[e->dst_arch[i]] = saved[i];
+        }
+    }
+    APEX_ooo_set_flags(cpu, flags);
+
+    e->state = OOO_EXECUTING;
+    e->done_cycle = cpu->clock +
+                    APEX_fu_reserve(&cpu->units, APEX_fu_class(uop->opcode), cpu->clock) +
+                    (APEX_ooo_is_load(uop) ? memory_latency : 0);
+}
+
+/* TRUE if a store older than the instruction at index has not executed yet,
+ * so its address is still unknown */
+static int
+APEX_ooo_store_ahead(const APEX_OoO *ooo, int index)
+{
+    const APEX_ROBEntry *e;
+    int age = APEX_ooo_age(ooo, index);
+    int i;
+
+    if (!ooo->stores)
+    {
+        return FALSE;
+    }
+    for (i = 0; i < age; ++i)
+    {
+        e = &ooo->rob[(ooo->rob_head + i) % ooo->rob_entries];
+        if (APEX_ooo_is_store(&e->uop) && e->state == OOO_WAITING)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Selects the oldest instruction in the issue queue whose sources are all
+ * ready and a unit of its class free, and issues it. A load also waits for
+ * the address of every older store, to forward from the youngest match.
+ * Returns FALSE if nothing could issue.
+ */
+static int
+APEX_ooo_issue_one(APEX_CPU *cpu, const int trace)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    APEX_ROBEntry *e;
+    int structural = FALSE;
+    int index;
+    int i;
+    int j;
+
+    for (i = 0; i < ooo->iq_count; ++i)
+    {
+        index = ooo->iq[i];
+        e = &ooo->rob[index];
+        for (j = 0; j < 3; ++j)
+        {
+            if (e->src[j] >= 0 && !ooo->prf_ready[e->src[j]])
+            {
+                break;
+            }
+        }
+        if (j < 3 || (APEX_ooo_is_load(&e->uop) && APEX_ooo_store_ahead(ooo, index)))
+        {
+            continue;
+        }
+        if (APEX_fu_free(&cpu->units, APEX_fu_class(e->uop.opcode), cpu->clock) < 0)
+        {
+            structural = TRUE;
+            continue;
+        }
+
+        memmove(&ooo->iq[i], &ooo->iq[i + 1], (ooo->iq_count - i - 1) * sizeof(int));
+        ooo->iq_count--;
+        if (trace >= TRACE_STAGE)
+        {
+            print_uop("Issue", &e->uop);
+        }
+        APEX_ooo_execute(cpu, index);
+        return TRUE;
+    }
+
+    /* Nothing issued although a ready instruction was waiting for a unit */
+    cpu->perf.events[PERF_STALL_STRUCTURAL] += structural;
+    return FALSE;
+}
+
+/* Issues up to width instructions, oldest ready first */
+static void
+APEX_ooo_issue(APEX_CPU *cpu, const int trace)
+{
+    int n = 0;
+
+    while (n < cpu->width && APEX_ooo_issue_one(cpu, trace))
+    {
+        n++;
+    }
+    cpu->perf.events[PERF_EXECUTE_BUSY] += n > 0;
+}
+
+/*
+ * Renames the instruction in the decode latch into the reorder buffer and
+ * issue queue. Returns FALSE, leaving it in decode, while either is full or
+ * the free list runs short.
+ */
+static int
+APEX_ooo_rename_one(APEX_CPU *cpu, const int trace)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    CPU_Stage *uop = cpu->decode;
+    APEX_ROBEntry *e;
+    int dst[OOO_MAX_DESTS];
+    int index;
+    int slot;
+    int n;
+    int i;
+
+    n = APEX_ooo_destinations(uop, dst);
+    if (ooo->rob_count == ooo->rob_entries)
+    {
+        cpu->perf.events[PERF_STALL_ROB_FULL]++;
+        return FALSE;
+    }
+    if (ooo->iq_count == ooo->iq_entries)
+    {
+        cpu->perf.events[PERF_STALL_IQ_FULL]++;
+        return FALSE;
+    }
+    if (ooo->free_count < n)
+    {
+        cpu->perf.events[PERF_STALL_FREE_LIST]++;
+        return FALSE;
+    }
+
+    /* A branch that missed in the BTB gets an entry, as in decode */
+    if (uop->ops->taken && !uop->btb_hit_bit)
+    {
+        slot = APEX_btb_allocate(&cpu->btb, uop->pc);
+        cpu->perf.events[PERF_BTB_ALLOCATIONS]++;
+        cpu->btb.entries[slot].valid = 1;
+        cpu->btb.entries[slot].i_address = uop->pc;
+        cpu->btb.entries[slot].t_address = uop->pc + uop->imm;
+        cpu->btb.entries[slot].h_bits[0] = cpu->btb.entries[slot].h_bits[1] =
+            uop->opcode == OPCODE_BNZ || uop->opcode == OPCODE_BP;
+        uop->btb_index = slot;
+    }
+
+    index = (ooo->rob_head + ooo->rob_count) % ooo->rob_entries;
+    e = &ooo->rob[index];
+    e->uop = *uop;
+    e->state = OOO_WAITING;
+    e->src[0] = uop->ops->operands & OPERAND_READS_RS1 ? ooo->map[uop->rs1] : -1;
+    e->src[1] = uop->ops->operands & OPERAND_READS_RS2 ? ooo->map[uop->rs2] : -1;
+    e->src[2] = uop->ops->operands & OPERAND_READS_FLAGS ? ooo->map[OOO_FLAGS_REG] : -1;
+    e->num_dst = n;
+    for (i = 0; i < n; ++i)
+    {
+        e->dst_arch[i] = dst[i];
+        e->prev_phys[i] = ooo->map[dst[i]];
+        e->dst_phys[i] = APEX_ooo_allocate(ooo);
+        ooo->map[dst[i]] = e->dst_phys[i];
+    }
+    if (APEX_ooo_is_store(uop))
+    {
+        ooo->stores++;
+    }
+    ooo->rob_count++;
+    ooo->iq[ooo->iq_count++] = index;
+
+    if (uop->opcode == OPCODE_HALT)
+    {
+        cpu->fetch_has_insn = FALSE;
+    }
+    if (trace >= TRACE_STAGE)
+    {
+        print_uop("Rename", uop);
+    }
+    return TRUE;
+}
+
+/*
+ * Renames the decode lanes in order. The first one that cannot go on holds
+ * the rest, and with them fetch.
+ */
+static void
+APEX_ooo_rename(APEX_CPU *cpu, const int trace)
+{
+    int n = 0;
+
+    cpu->stall_flag = 0;
+    if (!cpu->decode_has_insn)
+    {
+        return;
+    }
+
+    while (n < cpu->decode_group.count)
+    {
+        cpu->decode = cpu->decode_group.lanes[n];
+        if (!APEX_ooo_rename_one(cpu, trace))
+        {
+            break;
+        }
+        n++;
+    }
+    APEX_decode_advance(cpu, n);
+}
+
+/*
+ * Simulates one clock cycle of the backend, fetch excluded. Commit runs
+ * first and rename last, so an instruction spends at least a cycle in each
+ * of rename, issue, complete and commit. Returns TRUE once HALT commits.
+ */
+int
+APEX_ooo_cycle(APEX_CPU *cpu, const int trace)
+{
+    if (APEX_ooo_commit(cpu, trace))
+    {
+        return TRUE;
+    }
+    APEX_ooo_complete(cpu);
+    APEX_ooo_issue(cpu, trace);
+    APEX_ooo_rename(cpu, trace);
+
+    cpu->perf.events[PERF_ROB_OCCUPANCY] += cpu->ooo.rob_count;
+    cpu->perf.events[PERF_IQ_OCCUPANCY] += cpu->ooo.iq_count;
+    if (trace >= TRACE_FULL)
+    {
+        printf("ROB: %d of %d, IQ: %d of %d, free registers: %d\n", cpu->ooo.rob_count,
+               cpu->ooo.rob_entries, cpu->ooo.iq_count, cpu->ooo.iq_entries,
+               cpu->ooo.free_count);
+    }
+    return FALSE;
+}
+
+void
+APEX_ooo_report(const APEX_CPU *cpu, FILE *out)
+{
+    const APEX_OoO *ooo = &cpu->ooo;
+    const long long *events = cpu->perf.events;
+
+    fprintf(out, "APEX_CPU: Out-of-order ROB %d entries, IQ %d entries, PRF %d registers, "
+            "average ROB = %.2f IQ = %.2f, stalls rob = %lld iq = %lld free list = %lld, "
+            "squashed = %lld\n",
+            ooo->rob_entries, ooo->iq_entries, ooo->prf_entries,
+            cpu->clock ? (double)events[PERF_ROB_OCCUPANCY] / cpu->clock : 0.0,
+            cpu->clock ? (double)events[PERF_IQ_OCCUPANCY] / cpu->clock : 0.0,
+            events[PERF_STALL_ROB_FULL], events[PERF_STALL_IQ_FULL],
+            events[PERF_STALL_FREE_LIST], events[PERF_FLUSH_SQUASHED]);
+}
@@ -0,0 +1,50 @@
+/*
+ * apex_ooo.h
+ * Contains the out-of-order backend declarations: rename table, physical
+ * register file, free list, issue queue and reorder buffer
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_OOO_H_
+#define _APEX_OOO_H_
+
+#include <stdio.h>
+
+#include "apex_macros.h"
+
+struct APEX_CPU;
+struct APEX_ROBEntry;
+
+/* Out-of-order backend. Fetch hands instructions to rename through the
+ * decode latch, they issue from the issue queue once their sources are
+ * ready and commit from the reorder buffer in program order. rob is NULL
+ * when the in-order pipeline is used. */
+typedef struct APEX_OoO
+{
+    int rob_entries;
+    int iq_entries;
+    int prf_entries;
+    struct APEX_ROBEntry *rob;     /* Reorder buffer, a ring from rob_head */
+    int rob_head;                  /* Oldest instruction */
+    int rob_count;
+    int stores;                    /* Stores in the reorder buffer */
+    int *iq;                       /* Issue queue, reorder buffer indices oldest first */
+    int iq_count;
+    int map[OOO_ARCH_REGS];        /* Rename table, architectural to physical */
+    int *prf;                      /* Physical register file */
+    unsigned char *prf_ready;      /* Set when a value is written, wakes up its readers */
+    int *free_list;                /* Ring of free physical registers */
+    int free_head;
+    int free_count;
+} APEX_OoO;
+
+int APEX_ooo_init(APEX_OoO *ooo, int rob_entries, int iq_entries, int prf_entries);
+void APEX_ooo_free(APEX_OoO *ooo);
+int APEX_ooo_parse_backend(const char *name);
+void APEX_ooo_sync(struct APEX_CPU *cpu);
+int APEX_ooo_cycle(struct APEX_CPU *cpu, const int trace);
+void APEX_ooo_report(const struct APEX_CPU *cpu, FILE *out);
+
+#endif
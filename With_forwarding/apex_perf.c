@@ -0,0 +1,345 @@
+/*
+ * apex_perf.c
+ * Contains the registry of pipeline event counters and the end-of-run
+ * report written with --perf-report
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_perf.h"
+
+/* Report name of every event, as group and counter */
+static const struct
+{
+    const char *group;
+    const char *name;
+} perf_events[PERF_COUNT] = {
+    [PERF_FETCH_BUSY] = {"occupancy", "fetch"},
+    [PERF_DECODE_BUSY] = {"occupancy", "decode"},
+    [PERF_EXECUTE_BUSY] = {"occupancy", "execute"},
+    [PERF_MEMORY_BUSY] = {"occupancy", "memory"},
+    [PERF_WRITEBACK_BUSY] = {"occupancy", "writeback"},
+    [PERF_STALL_SCOREBOARD] = {"stalls", "scoreboard"},
+    [PERF_STALL_LOAD_USE] = {"stalls", "load_use"},
+    [PERF_STALL_REDIRECT] = {"stalls", "fetch_redirect"},
+    [PERF_BTB_ALLOCATIONS] = {"btb", "allocations"},
+    [PERF_PREDICTED_TAKEN] = {"branches", "predicted_taken"},
+    [PERF_ACTUAL_TAKEN] = {"branches", "taken"},
+    [PERF_FLUSH_BRANCH] = {"flushes", "branch"},
+    [PERF_FLUSH_JUMP] = {"flushes", "jump"},
+    [PERF_STALL_ROB_FULL] = {"stalls", "rob_full"},
+    [PERF_STALL_IQ_FULL] = {"stalls", "iq_full"},
+    [PERF_STALL_FREE_LIST] = {"stalls", "free_list_empty"},
+    [PERF_FLUSH_SQUASHED] = {"flushes", "squashed"},
+    [PERF_ROB_OCCUPANCY] = {"ooo", "rob_occupancy"},
+    [PERF_IQ_OCCUPANCY] = {"ooo", "iq_occupancy"},
+    [PERF_STALL_STRUCTURAL] = {"stalls", "structural"},
+    [PERF_STALL_UNIT_RESULT] = {"stalls", "unit_result"},
+    [PERF_STALL_DCACHE] = {"stalls", "dcache"},
+    [PERF_STALL_ICACHE] = {"stalls", "icache"},
+};
+
+/* Report names of the retire_width counters */
+static const char *const perf_widths[APEX_MAX_WIDTH + 1] = {"0", "1", "2", "3", "4"};
+
+/* One line of the report. Counts are exact, derived metrics are ratios. */
+typedef struct APEX_PerfMetric
+{
+    const char *group;
+    const char *name;
+    long long count;
+    double ratio;
+    int derived;
+} APEX_PerfMetric;
+
+#define PERF_MAX_METRICS (PERF_COUNT * 2 + OPCODE_COUNT + FU_CLASS_COUNT * 2 + \
+                          APEX_MAX_WIDTH + (CACHE_LEVELS + 1) * 6 + 32)
+
+/*
+ * Maps the value of a --perf-format=<format> option to a PERF_FORMAT_*
+ * value, returns -1 if the format is unknown
+ */
+int
+APEX_perf_parse_format(const char *format)
+{
+    if (strcmp(format, "json") == 0)
+    {
+        return PERF_FORMAT_JSON;
+    }
+
+    if (strcmp(format, "csv") == 0)
+    {
+        return PERF_FORMAT_CSV;
+    }
+
+    return -1;
+}
+
+static void
+APEX_perf_count(APEX_PerfMetric *metrics, int *n, const char *group, const char *name,
+                long long count)
+{
+    APEX_PerfMetric *m = &metrics[(*n)++];
+
+    m->group = group;
+    m->name = name;
+    m->count = count;
+    m->ratio = 0.0;
+    m->derived = FALSE;
+}
+
+static void
+APEX_perf_ratio(APEX_PerfMetric *metrics, int *n, const char *name, long long num,
+                long long den)
+{
+    APEX_PerfMetric *m = &metrics[(*n)++];
+
+    m->group = "derived";
+    m->name = name;
+    m->count = 0;
+    m->ratio = den ? (double)num / den : 0.0;
+    m->derived = TRUE;
+}
+
+/* Adds one group per modeled level of a cache, named after the level */
+static void
+APEX_perf_cache(APEX_PerfMetric *metrics, int *n, const APEX_Cache *cache)
+{
+    const APEX_CacheStats *stats;
+    const char *name;
+    int i;
+
+    for (i = 0; i < cache->count; ++i)
+    {
+        stats = &cache->levels[i].stats;
+        name = APEX_cache_name(cache, i);
+        APEX_perf_count(metrics, n, name, "reads", stats->reads);
+        APEX_perf_count(metrics, n, name, "writes", stats->writes);
+        APEX_perf_count(metrics, n, name, "hits", stats->hits);
+        APEX_perf_count(metrics, n, name, "misses", stats->misses);
+        APEX_perf_count(metrics, n, name, "evictions", stats->evictions);
+        APEX_perf_count(metrics, n, name, "writebacks", stats->writebacks);
+    }
+}
+
+/*
+ * Gathers the pipeline events together with the BTB and predictor
+ * statistics into one list, returns the number of metrics
+ */
+static int
+APEX_perf_collect(const APEX_CPU *cpu, APEX_PerfMetric *metrics)
+{
+    const APEX_PerfCounters *perf = &cpu->perf;
+    long long misses;
+    const char *name;
+    int n = 0;
+    int i;
+
+    APEX_perf_count(metrics, &n, "run", "cycles", cpu->clock);
+    APEX_perf_count(metrics, &n, "run", "instructions", cpu->insn_completed);
+    APEX_perf_count(metrics, &n, "run", "fast_forwarded", cpu->insn_fast_forwarded);
+
+    for (i = PERF_FETCH_BUSY; i <= PERF_WRITEBACK_BUSY; ++i)
+    {
+        APEX_perf_count(metrics, &n, perf_events[i].group, perf_events[i].name,
+                        perf->events[i]);
+    }
+
+    /* A stage bubbles in every cycle it starts without an instruction */
+    for (i = PERF_FETCH_BUSY; i <= PERF_WRITEBACK_BUSY; ++i)
+    {
+        APEX_perf_count(metrics, &n, "bubbles", perf_events[i].name,
+                        cpu->clock - perf->events[i]);
+    }
+
+    for (i = PERF_WRITEBACK_BUSY + 1; i < PERF_COUNT; ++i)
+    {
+        APEX_perf_count(metrics, &n, perf_events[i].group, perf_events[i].name,
+                        perf->events[i]);
+    }
+
+    APEX_perf_count(metrics, &n, "btb", "lookups", cpu->btb.stats.lookups);
+    APEX_perf_count(metrics, &n, "btb", "hits", cpu->btb.stats.hits);
+    APEX_perf_count(metrics, &n, "branches", "resolved", cpu->bpred.stats.branches);
+    APEX_perf_count(metrics, &n, "branches", "mispredicts", cpu->bpred.stats.mispredicts);
+    APEX_perf_count(metrics, &n, "branches", "direction_mispredicts",
+                    cpu->bpred.stats.direction_mispredicts);
+    APEX_perf_count(metrics, &n, "jumps", "resolved", cpu->bpred.target_stats.jumps);
+    APEX_perf_count(metrics, &n, "jumps", "predicted", cpu->bpred.target_stats.predicted);
+    APEX_perf_count(metrics, &n, "jumps", "correct", cpu->bpred.target_stats.correct);
+
+    for (i = 0; i < FU_CLASS_COUNT; ++i)
+    {
+        APEX_perf_count(metrics, &n, "fu_issued", APEX_fu_name(i), cpu->units.issued[i]);
+        APEX_perf_count(metrics, &n, "fu_busy", APEX_fu_name(i), cpu->units.busy[i]);
+    }
+    APEX_perf_count(metrics, &n, "lsq", "loads", cpu->lsq.loads);
+    APEX_perf_count(metrics, &n, "lsq", "forwarded", cpu->lsq.forwarded);
+    APEX_perf_count(metrics, &n, "lsq", "stores", cpu->lsq.stores_buffered);
+    APEX_perf_count(metrics, &n, "lsq", "full_drains", cpu->lsq.full_drains);
+
+    APEX_perf_cache(metrics, &n, &cpu->dcache);
+    APEX_perf_cache(metrics, &n, &cpu->ifetch.icache);
+    if (cpu->ifetch.icache.count)
+    {
+        APEX_perf_count(metrics, &n, APEX_cache_name(&cpu->ifetch.icache, 0), "prefetches",
+                        cpu->ifetch.icache.levels[0].stats.prefetches);
+    }
+    APEX_perf_count(metrics, &n, "memory", "pages_touched", cpu->data_memory.pages_touched);
+    APEX_perf_count(metrics, &n, "memory", "out_of_range", cpu->data_memory.out_of_range);
+
+    for (i = 0; i < OPCODE_COUNT; ++i)
+    {
+        name = APEX_opcode_name(i);
+        if (name)
+        {
+            APEX_perf_count(metrics, &n, "retired", name, perf->retired[i]);
+        }
+    }
+
+    for (i = 0; i <= cpu->width; ++i)
+    {
+        APEX_perf_count(metrics, &n, "retire_width", perf_widths[i], perf->retire_width[i]);
+    }
+
+    /* Wrong-path fetches of branches plus jumps fetched at a wrong target */
+    misses = cpu->bpred.stats.mispredicts + cpu->bpred.target_stats.jumps -
+             cpu->bpred.target_stats.correct;
+    APEX_perf_ratio(metrics, &n, "ipc", cpu->insn_completed, cpu->clock);
+    APEX_perf_ratio(metrics, &n, "cpi", cpu->clock, cpu->insn_completed);
+    APEX_perf_ratio(metrics, &n, "mpki", misses * 1000, cpu->insn_completed);
+    return n;
+}
+
+static void
+APEX_perf_print_value(FILE *fp, const APEX_PerfMetric *m)
+{
+    if (m->derived)
+    {
+        fprintf(fp, "%.6f", m->ratio);
+    }
+    else
+    {
+        fprintf(fp, "%lld", m->count);
+    }
+}
+
+/*
+ * Moves the metrics of each group together, keeping the groups in the order
+ * they first appear and the metrics of a group in their own order
+ */
+static void
+APEX_perf_group(APEX_PerfMetric *metrics, int n)
+{
+    APEX_PerfMetric m;
+    int i;
+    int j;
+    int k;
+
+    for (i = 1; i < n; ++i)
+    {
+        /* Last metric of the same group before i */
+        j = i - 1;
+        while (j >= 0 && strcmp(metrics[j].group, metrics[i].group) != 0)
+        {
+            --j;
+        }
+        if (j < 0 || j == i - 1)
+        {
+            continue;
+        }
+        m = metrics[i];
+        for (k = i; k > j + 1; --k)
+        {
+            metrics[k] = metrics[k - 1];
+        }
+        metrics[j + 1] = m;
+    }
+}
+
+/* One JSON object per group, mapping counter names to values */
+static void
+APEX_perf_write_json(FILE *fp, const APEX_PerfMetric *metrics, int n)
+{
+    int i;
+
+    fprintf(fp, "{");
+    for (i = 0; i < n; ++i)
+    {
+        if (i == 0 || strcmp(metrics[i].group, metrics[i - 1].group) != 0)
+        {
+            fprintf(fp, "%s\n  \"%s\": {\n", i ? "\n  }," : "", metrics[i].group);
+        }
+        else
+        {
+            fprintf(fp, ",\n");
+        }
+        fprintf(fp, "    \"%s\": ", metrics[i].name);
+        APEX_perf_print_value(fp, &metrics[i]);
+    }
+    fprintf(fp, "%s\n}\n", n ? "\n  }" : "");
+}
+
+static void
+APEX_perf_write_csv(FILE *fp, const APEX_PerfMetric *metrics, int n)
+{
+    int i;
+
+    fprintf(fp, "group,counter,value\n");
+    for (i = 0; i < n; ++i)
+    {
+        fprintf(fp, "%s,%s,", metrics[i].group, metrics[i].name);
+        APEX_perf_print_value(fp, &metrics[i]);
+        fprintf(fp, "\n");
+    }
+}
+
+/*
+ * Writes the counters of a run to filename in one of the PERF_FORMAT_*
+ * formats, returns 0 on success and -1 on failure
+ */
+int
+APEX_perf_write(const APEX_CPU *cpu, const char *filename, int format)
+{
+    APEX_PerfMetric metrics[PERF_MAX_METRICS];
+    FILE *fp;
+    int ret = 0;
+    int n;
+
+    fp = fopen(filename, "w");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to create performance report %s\n", filename);
+        return -1;
+    }
+
+    n = APEX_perf_collect(cpu, metrics);
+    APEX_perf_group(metrics, n);
+    if (format == PERF_FORMAT_CSV)
+    {
+        APEX_perf_write_csv(fp, metrics, n);
+    }
+    else
+    {
+        APEX_perf_write_json(fp, metrics, n);
+    }
+
+    if (ferror(fp))
+    {
+        ret = -1;
+    }
+    if (fclose(fp) != 0)
+    {
+        ret = -1;
+    }
+    if (ret != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write performance report %s\n", filename);
+    }
+    return ret;
+}
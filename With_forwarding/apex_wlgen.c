@@ -0,0 +1,276 @@
+/*
+ * apex_wlgen.c
+ * Writes a synthetic APEX program to standard output, a loop whose trip
+ * count, branch behaviour, dependency distance, memory streams, MUL/DIV mix
+ * and code footprint are chosen on the command line
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_macros.h"
+
+/* Registers of the generated program */
+#define WL_ONE 1                   /* Constant 1, the other operand of the body */
+#define WL_TRIPS 2                 /* Trips left */
+#define WL_RANDOM 3                /* LCG state the block branches test */
+#define WL_MULTIPLIER 4
+#define WL_MASK 5
+#define WL_BYTE 6
+#define WL_SOURCE 7                /* LOADP pointer */
+#define WL_DEST 8                  /* STOREP pointer */
+#define WL_TEST 9
+#define WL_FALLS 10                /* Block branches not taken */
+#define WL_LOADED 11
+#define WL_RESULT 12               /* Base of the result area */
+#define WL_CHAIN 16                /* First of the dependency chains */
+#define WL_MAX_DISTANCE (REG_FILE_SIZE - WL_CHAIN)
+
+/* Shape of the workload */
+typedef struct APEX_WorkloadConfig
+{
+    unsigned int seed;
+    int trips;                     /* Iterations of the loop */
+    int entropy;                   /* 0 always falls through, 100 is a coin toss */
+    int distance;                  /* Instructions between a result and its use */
+    int body;                      /* Dependent instructions per block */
+    int mul;                       /* Percent of the body that is MUL */
+    int div;                       /* Percent of the body that is DIV */
+    int stream;                    /* LOADP/STOREP pairs per block */
+    int blocks;                    /* Blocks per trip, one branch each */
+} APEX_WorkloadConfig;
+
+static int
+APEX_wl_option(APEX_WorkloadConfig *config, const char *option)
+{
+    if (strncmp(option, "--seed=", 7) == 0)
+    {
+        config->seed = strtoul(option + 7, NULL, 0);
+        return 0;
+    }
+
+    if (strncmp(option, "--trips=", 8) == 0)
+    {
+        config->trips = atoi(option + 8);
+        return 0;
+    }
+
+    if (strncmp(option, "--entropy=", 10) == 0)
+    {
+        config->entropy = atoi(option + 10);
+        return 0;
+    }
+
+    if (strncmp(option, "--dep-distance=", 15) == 0)
+    {
+        config->distance = atoi(option + 15);
+        return 0;
+    }
+
+    if (strncmp(option, "--body=", 7) == 0)
+    {
+        config->body = atoi(option + 7);
+        return 0;
+    }
+
+    if (strncmp(option, "--mul=", 6) == 0)
+    {
+        config->mul = atoi(option + 6);
+        return 0;
+    }
+
+    if (strncmp(option, "--div=", 6) == 0)
+    {
+        config->div = atoi(option + 6);
+        return 0;
+    }
+
+    if (strncmp(option, "--stream=", 9) == 0)
+    {
+        config->stream = atoi(option + 9);
+        return 0;
+    }
+
+    if (strncmp(option, "--blocks=", 9) == 0)
+    {
+        config->blocks = atoi(option + 9);
+        return 0;
+    }
+
+    fprintf(stderr, "APEX_Error: Unknown option %s\n", option);
+    return -1;
+}
+
+static int
+APEX_wl_check(const APEX_WorkloadConfig *config)
+{
+    if (config->trips < 1)
+    {
+        fprintf(stderr, "APEX_Error: The trip count must be at least 1\n");
+        return -1;
+    }
+    if (config->entropy < 0 || config->entropy > 100)
+    {
+        fprintf(stderr, "APEX_Error: The branch entropy must be from 0 to 100\n");
+        return -1;
+    }
+    if (config->distance < 1 || config->distance > WL_MAX_DISTANCE)
+    {
+        fprintf(stderr, "APEX_Error: The dependency distance must be from 1 to %d\n",
+                WL_MAX_DISTANCE);
+        return -1;
+    }
+    if (config->body < 0 || config->stream < 0 || config->blocks < 1)
+    {
+        fprintf(stderr, "APEX_Error: The body and stream can not be negative and "
+                "there must be at least one block\n");
+        return -1;
+    }
+    if (config->mul < 0 || config->div < 0 || config->mul + config->div > 100)
+    {
+        fprintf(stderr, "APEX_Error: The MUL and DIV shares must add up to at most 100\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Host side generator, so a seed gives the same program everywhere */
+static unsigned int
+APEX_wl_random(unsigned int *state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return (*state >> 16) & 0x7fff;
+}
+
+/*
+ * Block k: advance the LCG, skip an increment of the fall-through count
+ * when the low byte of the LCG is above a threshold, then the body and the
+ * streams. The threshold makes the block branch taken with probability
+ * entropy/200, so 100 is the hardest to predict.
+ */
+static void
+APEX_wl_block(const APEX_WorkloadConfig *config, unsigned int *state, int k)
+{
+    const int threshold = 255 - (256 * config->entropy + 100) / 200;
+    int chain;
+    int pick;
+    int i;
+
+    printf("; block %d\n", k);
+    printf("        MUL R%d,R%d,R%d\n", WL_RANDOM, WL_RANDOM, WL_MULTIPLIER);
+    printf("        ADDL R%d,R%d,#74\n", WL_RANDOM, WL_RANDOM);
+    printf("        AND R%d,R%d,R%d\n", WL_RANDOM, WL_RANDOM, WL_MASK);
+    printf("        AND R%d,R%d,R%d\n", WL_TEST, WL_RANDOM, WL_BYTE);
+    printf("        SUBL R%d,R%d,#%d\n", WL_TEST, WL_TEST, threshold);
+    printf("        BP skip%d\n", k);
+    printf("        ADDL R%d,R%d,#1\n", WL_FALLS, WL_FALLS);
+    printf("skip%d:\n", k);
+
+    for (i = 0; i < config->body; ++i)
+    {
+        chain = WL_CHAIN + i % config->distance;
+        pick = APEX_wl_random(state) % 100;
+        printf("        %s R%d,R%d,R%d\n",
+               pick < config->mul ? "MUL" : pick < config->mul + config->div ? "DIV" : "ADD",
+               chain, chain, WL_ONE);
+    }
+
+    for (i = 0; i < config->stream; ++i)
+    {
+        printf("        LOADP R%d,R%d,#0\n", WL_LOADED, WL_SOURCE);
+        printf("        STOREP R%d,R%d,#0\n", WL_CHAIN + i % config->distance, WL_DEST);
+    }
+}
+
+static void
+APEX_wl_program(const APEX_WorkloadConfig *config)
+{
+    /* LOADP and STOREP step their pointers by 4 words */
+    const long span = 4L * config->stream * config->blocks;
+    unsigned int state = config->seed;
+    int i;
+
+    if (2 * span + WL_MAX_DISTANCE + 1 > DATA_MEMORY_SIZE)
+    {
+        fprintf(stderr, "APEX_Warning: The streams need --data-memory=%ld or more\n",
+                2 * span + WL_MAX_DISTANCE + 1);
+    }
+
+    printf("; apex_wlgen --seed=%u --trips=%d --entropy=%d --dep-distance=%d --body=%d "
+           "--mul=%d --div=%d --stream=%d --blocks=%d\n",
+           config->seed, config->trips, config->entropy, config->distance, config->body,
+           config->mul, config->div, config->stream, config->blocks);
+    printf("        MOVC R%d,#1\n", WL_ONE);
+    printf("        MOVC R%d,#%d\n", WL_TRIPS, config->trips);
+    printf("        MOVC R%d,#%u\n", WL_RANDOM, config->seed & 0xffff);
+    printf("        MOVC R%d,#75\n", WL_MULTIPLIER);
+    printf("        MOVC R%d,#65535\n", WL_MASK);
+    printf("        MOVC R%d,#255\n", WL_BYTE);
+    printf("        MOVC R%d,#0\n", WL_FALLS);
+    printf("        MOVC R%d,#%ld\n", WL_RESULT, 2 * span);
+    for (i = 0; i < config->distance; ++i)
+    {
+        printf("        MOVC R%d,#0\n", WL_CHAIN + i);
+    }
+    printf("loop:\n");
+    printf("        MOVC R%d,#0\n", WL_SOURCE);
+    printf("        MOVC R%d,#%ld\n", WL_DEST, span);
+
+    for (i = 0; i < config->blocks; ++i)
+    {
+        APEX_wl_block(config, &state, i);
+    }
+
+    printf("; close the loop\n");
+    printf("        SUBL R%d,R%d,#1\n", WL_TRIPS, WL_TRIPS);
+    printf("        BNZ loop\n");
+    printf("; results: the fall-through count, then the chains\n");
+    printf("        STORE R%d,R%d,#0\n", WL_FALLS, WL_RESULT);
+    for (i = 0; i < config->distance; ++i)
+    {
+        printf("        STORE R%d,R%d,#%d\n", WL_CHAIN + i, WL_RESULT, i + 1);
+    }
+    printf("        HALT\n");
+}
+
+int
+main(int argc, char const *argv[])
+{
+    APEX_WorkloadConfig config;
+    int i;
+
+    memset(&config, 0, sizeof(config));
+    config.seed = 1;
+    config.trips = 1000;
+    config.entropy = 0;
+    config.distance = 4;
+    config.body = 8;
+    config.blocks = 1;
+
+    for (i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--help") == 0)
+        {
+            fprintf(stderr, "APEX_Help: Usage %s [--seed=<seed>] [--trips=<trips>] "
+                    "[--entropy=<0-100>] [--dep-distance=<1-%d>] [--body=<insns>] "
+                    "[--mul=<percent>] [--div=<percent>] [--stream=<pairs>] "
+                    "[--blocks=<blocks>]\n", argv[0], WL_MAX_DISTANCE);
+            exit(0);
+        }
+        if (APEX_wl_option(&config, argv[i]) != 0)
+        {
+            exit(1);
+        }
+    }
+    if (APEX_wl_check(&config) != 0)
+    {
+        exit(1);
+    }
+
+    APEX_wl_program(&config);
+    return 0;
+}
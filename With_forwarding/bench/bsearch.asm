@@ -0,0 +1,49 @@
+; Binary search: 256 ascending words at 0, then 64 keys drawn from an LCG
+; are looked up and the index found, or -1, stored from 512 on.
+        MOVC R1,#0              ; value
+        MOVC R4,#0              ; fill pointer
+        MOVC R5,#256            ; words to fill
+fill:
+        STORE R1,R4,#0
+        ADDL R1,R1,#3           ; every third value is present
+        ADDL R4,R4,#1
+        SUBL R5,R5,#1
+        BNZ fill
+        MOVC R2,#75
+        MOVC R3,#65535
+        MOVC R6,#1023
+        MOVC R10,#2024          ; LCG state
+        MOVC R11,#64            ; keys left
+        MOVC R12,#512           ; result pointer
+        MOVC R13,#2
+key:
+        MUL R10,R10,R2
+        ADDL R10,R10,#74
+        AND R10,R10,R3
+        AND R14,R10,R6          ; key from 0 to 1023
+        MOVC R15,#0             ; low
+        MOVC R16,#255           ; high
+        MOVC R20,#-1            ; not found
+search:
+        SUB R17,R16,R15
+        ADDL R17,R17,#1
+        BNP done                ; low > high
+        ADD R18,R15,R16
+        DIV R18,R18,R13         ; middle
+        LOAD R19,R18,#0
+        CMP R19,R14
+        BZ found
+        BP above
+        ADDL R15,R18,#1         ; a[middle] < key
+        JUMP R0,search
+above:
+        SUBL R16,R18,#1
+        JUMP R0,search
+found:
+        ADD R20,R18,R0
+done:
+        STORE R20,R12,#0
+        ADDL R12,R12,#1
+        SUBL R11,R11,#1
+        BNZ key
+        HALT
@@ -0,0 +1,32 @@
+; Bubble sort of 48 words filled with an LCG, in place at 0.
+        MOVC R1,#31337          ; LCG state
+        MOVC R2,#75
+        MOVC R3,#65535
+        MOVC R4,#0              ; fill pointer
+        MOVC R5,#48             ; words to fill
+fill:
+        MUL R1,R1,R2
+        ADDL R1,R1,#74
+        AND R1,R1,R3
+        STORE R1,R4,#0
+        ADDL R4,R4,#1
+        SUBL R5,R5,#1
+        BNZ fill
+        MOVC R6,#47             ; compares in this pass
+pass:
+        MOVC R4,#0
+        ADD R7,R6,R0            ; compares left
+compare:
+        LOAD R8,R4,#0
+        LOAD R9,R4,#1
+        CMP R8,R9
+        BNP ordered             ; a[i] <= a[i+1]
+        STORE R9,R4,#0
+        STORE R8,R4,#1
+ordered:
+        ADDL R4,R4,#1
+        SUBL R7,R7,#1
+        BNZ compare
+        SUBL R6,R6,#1
+        BNZ pass
+        HALT
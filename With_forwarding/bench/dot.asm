@@ -0,0 +1,31 @@
+; Dot product of two 128 word vectors filled with an LCG, the sum stored at
+; word 512. Vector a is at 0 and vector b at 128.
+        MOVC R1,#4242           ; LCG state
+        MOVC R2,#75
+        MOVC R3,#255            ; keeps the products small
+        MOVC R4,#0              ; fill pointer
+        MOVC R5,#256            ; words to fill
+        MOVC R10,#65535
+fill:
+        MUL R1,R1,R2
+        ADDL R1,R1,#74
+        AND R1,R1,R10
+        AND R6,R1,R3
+        STORE R6,R4,#0
+        ADDL R4,R4,#1
+        SUBL R5,R5,#1
+        BNZ fill
+        MOVC R4,#0              ; index
+        MOVC R5,#128            ; elements left
+        MOVC R7,#0              ; sum
+dot:
+        LOAD R8,R4,#0
+        LOAD R9,R4,#128
+        MUL R8,R8,R9
+        ADD R7,R7,R8
+        ADDL R4,R4,#1
+        SUBL R5,R5,#1
+        BNZ dot
+        MOVC R11,#512
+        STORE R7,R11,#0
+        HALT
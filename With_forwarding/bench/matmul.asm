@@ -0,0 +1,46 @@
+; C = A x B for 12x12 matrices filled with an LCG, row major. A is at 0,
+; B at 256 and C at 512.
+        MOVC R1,#777            ; LCG state
+        MOVC R2,#75
+        MOVC R3,#65535
+        MOVC R4,#0              ; fill pointer
+        MOVC R5,#400            ; words to fill, A and the pad up to B and B
+        MOVC R6,#15             ; keeps the products small
+fill:
+        MUL R1,R1,R2
+        ADDL R1,R1,#74
+        AND R1,R1,R3
+        AND R7,R1,R6
+        STORE R7,R4,#0
+        ADDL R4,R4,#1
+        SUBL R5,R5,#1
+        BNZ fill
+        MOVC R20,#12            ; n
+        MOVC R10,#0             ; i * n
+        MOVC R11,#12            ; rows left
+row:
+        MOVC R12,#0             ; j
+        MOVC R13,#12            ; columns left
+column:
+        MOVC R14,#0             ; sum
+        ADD R15,R10,R0          ; &A[i][0]
+        ADDL R16,R12,#256       ; &B[0][j]
+        MOVC R17,#12            ; k left
+inner:
+        LOAD R18,R15,#0
+        LOAD R19,R16,#0
+        MUL R18,R18,R19
+        ADD R14,R14,R18
+        ADDL R15,R15,#1
+        ADD R16,R16,R20
+        SUBL R17,R17,#1
+        BNZ inner
+        ADD R21,R10,R12
+        STORE R14,R21,#512
+        ADDL R12,R12,#1
+        SUBL R13,R13,#1
+        BNZ column
+        ADD R10,R10,R20
+        SUBL R11,R11,#1
+        BNZ row
+        HALT
@@ -0,0 +1,25 @@
+; memcpy: fills 256 words with an LCG, then copies them with LOADP and
+; STOREP, whose pointers step by 4 words, so 64 words are copied.
+; Source at 0, destination at 1024.
+        MOVC R1,#12345          ; LCG state
+        MOVC R2,#75
+        MOVC R3,#65535
+        MOVC R4,#0              ; fill pointer
+        MOVC R5,#256            ; words to fill
+fill:
+        MUL R1,R1,R2
+        ADDL R1,R1,#74
+        AND R1,R1,R3
+        STORE R1,R4,#0
+        ADDL R4,R4,#1
+        SUBL R5,R5,#1
+        BNZ fill
+        MOVC R6,#0              ; source
+        MOVC R7,#1024           ; destination
+        MOVC R8,#64             ; words to copy
+copy:
+        LOADP R9,R6,#0
+        STOREP R9,R7,#0
+        SUBL R8,R8,#1
+        BNZ copy
+        HALT
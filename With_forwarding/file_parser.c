@@ -1,360 +1,930 @@
 /*
  * file_parser.c
- * Contains functions to parse input file and create code memory, you can edit
- * this file to add new instructions
+ * Contains functions to parse input file and create code memory, the
+ * instructions themselves are described in apex_isa.def
  *
  * Author:
  * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
  * State University of New York at Binghamton
  */
-#include <assert.h>
+#include <limits.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "apex_cpu.h"
 #include "apex_macros.h"
 
-/*
- * This function is related to parsing input file
- *
- * Note : You are not supposed to edit this function
- */
+/* Span of the source text, pointing into the input buffer */
+typedef struct APEX_Token
+{
+    const char *text;
+    int len;
+} APEX_Token;
 
+/* Label and the index of the instruction it names */
+typedef struct APEX_Label
+{
+    APEX_Token name;               /* len 0 for an empty slot */
+    int index;
+} APEX_Label;
 
-static int
-get_num_from_string(const char *buffer)
+/* Operand naming a label that may not be defined yet, patched at the end */
+typedef struct APEX_Fixup
 {
-    char str[16];
-    int i, j = 0;
+    APEX_Token name;
+    int index;                     /* Instruction to patch */
+    int line;
+    int relative;                  /* TRUE for a branch offset, else an address */
+} APEX_Fixup;
+
+/* State of one pass over a program. The whole input is read into one
+ * buffer, so tokens, labels and fixups all point into it and nothing is
+ * copied. */
+typedef struct APEX_Parser
+{
+    const char *filename;
+    int line;                      /* Of the instruction being parsed */
+    APEX_Instruction *code;        /* Grows as instructions are parsed */
+    int count;
+    int capacity;
+    APEX_Label *labels;            /* Open addressing, power of two slots */
+    int label_count;
+    int label_slots;
+    APEX_Fixup *fixups;
+    int fixup_count;
+    int fixup_capacity;
+    APEX_Token operands[ISA_MAX_OPERANDS + 1]; /* One more shows there are too many */
+    int operand_count;
+} APEX_Parser;
 
-    for (i = 1; buffer[i] != '\0'; ++i)
-    {
-        str[j] = buffer[i];
-        j++;
-    }
-    str[j] = '\0';
+static void
+parse_error(const APEX_Parser *parser, const char *format, ...)
+{
+    va_list args;
 
-    return atoi(str);
+    fprintf(stderr, "APEX_Error: %s:%d: ", parser->filename, parser->line);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, "\n");
 }
 
-/*
- * This function sets the numeric opcode to an instruction based on string value
- *
- * Note : you can edit this function to add new instructions
- */
+/* Makes room for one more element of size bytes in a growable array,
+ * doubling it when full. Returns 0 on success and -1 if memory runs out. */
 static int
-set_opcode_str(const char *opcode_str)
+grow_array(void **array, int *capacity, int count, size_t size)
 {
-    if (strcmp(opcode_str, "ADD") == 0)
+    void *grown;
+    int wanted;
+
+    if (count < *capacity)
     {
-        return OPCODE_ADD;
+        return 0;
     }
-
-    if (strcmp(opcode_str, "SUB") == 0)
+    wanted = *capacity ? *capacity * 2 : 256;
+    grown = realloc(*array, wanted * size);
+    if (!grown)
     {
-        return OPCODE_SUB;
+        return -1;
     }
+    *array = grown;
+    *capacity = wanted;
+    return 0;
+}
 
-    if (strcmp(opcode_str, "MUL") == 0)
-    {
-        return OPCODE_MUL;
+/* Reads all of fp into a NUL terminated buffer, so a pipe works as well as
+ * a file. A file is read in one go into a buffer of its size. Returns NULL
+ * if memory runs out or the read fails. */
+static char *
+read_source(FILE *fp, size_t *size)
+{
+    char *buffer = NULL;
+    char *grown;
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t got;
+    struct stat st;
+
+    if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode))
+    {
+        capacity = st.st_size + 65536;
+        buffer = malloc(capacity + 1);
+        if (!buffer)
+        {
+            return NULL;
+        }
     }
 
-    if (strcmp(opcode_str, "DIV") == 0)
+    do
+    {
+        if (capacity - used < 65536)
+        {
+            capacity = capacity ? capacity * 2 : 1 << 20;
+            grown = realloc(buffer, capacity + 1);
+            if (!grown)
+            {
+                free(buffer);
+                return NULL;
+            }
+            buffer = grown;
+        }
+        got = fread(buffer + used, 1, capacity - used, fp);
+        used += got;
+    } while (got > 0);
+
+    if (ferror(fp))
     {
-        return OPCODE_DIV;
+        free(buffer);
+        return NULL;
     }
+    buffer[used] = '\0';
+    *size = used;
+    return buffer;
+}
 
-    if (strcmp(opcode_str, "AND") == 0)
+static unsigned int
+hash_token(APEX_Token token)
+{
+    unsigned int hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < token.len; ++i)
     {
-        return OPCODE_AND;
+        hash = (hash ^ (unsigned char)token.text[i]) * 16777619u;
     }
+    return hash;
+}
+
+static int
+token_equals(APEX_Token a, APEX_Token b)
+{
+    return a.len == b.len && memcmp(a.text, b.text, a.len) == 0;
+}
+
+/* Slot of a label, or of the empty slot it would go in */
+static APEX_Label *
+find_label(const APEX_Parser *parser, APEX_Token name)
+{
+    unsigned int slot = hash_token(name) & (parser->label_slots - 1);
 
-    if (strcmp(opcode_str, "OR") == 0)
+    while (parser->labels[slot].name.len &&
+           !token_equals(parser->labels[slot].name, name))
     {
-        return OPCODE_OR;
+        slot = (slot + 1) & (parser->label_slots - 1);
     }
+    return &parser->labels[slot];
+}
+
+/* Names the next instruction. Returns 0 on success and -1 on failure. */
+static int
+define_label(APEX_Parser *parser, APEX_Token name)
+{
+    APEX_Label *old = parser->labels;
+    APEX_Label *label;
+    int slots = parser->label_slots;
+    int i;
 
-    if (strcmp(opcode_str, "EX-OR") == 0)
+    /* Keep the table at most half full */
+    if ((parser->label_count + 1) * 2 > parser->label_slots)
     {
-        return OPCODE_XOR;
+        parser->label_slots = slots ? slots * 2 : 64;
+        parser->labels = calloc(parser->label_slots, sizeof(APEX_Label));
+        if (!parser->labels)
+        {
+            parser->labels = old;
+            parser->label_slots = slots;
+            return -1;
+        }
+        for (i = 0; i < slots; ++i)
+        {
+            if (old[i].name.len)
+            {
+                *find_label(parser, old[i].name) = old[i];
+            }
+        }
+        free(old);
     }
 
-    if (strcmp(opcode_str, "MOVC") == 0)
+    label = find_label(parser, name);
+    if (label->name.len)
     {
-        return OPCODE_MOVC;
+        parse_error(parser, "label %.*s is defined twice", name.len, name.text);
+        return -1;
     }
+    label->name = name;
+    label->index = parser->count;
+    parser->label_count++;
+    return 0;
+}
+
+static int
+is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/* TRUE where a token ends: white space, a comma, a comment or the line end */
+static int
+is_token_end(char c)
+{
+    return is_space(c) || c == ',' || c == ';' || c == '\n' || c == '\0';
+}
+
+static int
+is_label_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_' || c == '.';
+}
+
+/* Parses a whole token as a decimal number with an optional sign. Returns
+ * 0 on success and -1 if it is not one. */
+static int
+token_number(APEX_Token token, int *value)
+{
+    const int negative = token.len && (token.text[0] == '-' || token.text[0] == '+');
+    long long number = 0;
+    int i;
 
-    if (strcmp(opcode_str, "LOAD") == 0)
+    if (token.len == negative)
     {
-        return OPCODE_LOAD;
+        return -1;
     }
-    if(strcmp(opcode_str,"LOADP")==0)
+    for (i = negative; i < token.len; ++i)
     {
-        return OPCODE_LOADP;
+        if (token.text[i] < '0' || token.text[i] > '9' || number > INT_MAX)
+        {
+            return -1;
+        }
+        number = number * 10 + token.text[i] - '0';
     }
-    if(strcmp(opcode_str,"STOREP") == 0)
+    if (token.text[0] == '-')
     {
-        return OPCODE_STOREP;
+        number = -number;
     }
+    if (number < INT_MIN || number > INT_MAX)
+    {
+        return -1;
+    }
+    *value = (int)number;
+    return 0;
+}
 
-    if (strcmp(opcode_str, "STORE") == 0)
+/* Register operand n, R0 to R31 */
+static int
+parse_register(APEX_Parser *parser, int n, unsigned char *reg)
+{
+    APEX_Token token = parser->operands[n];
+    APEX_Token digits = {token.text + 1, token.len - 1};
+    int value;
+
+    if (token.len < 2 || (token.text[0] != 'R' && token.text[0] != 'r') ||
+        token_number(digits, &value) != 0 || value < 0 || value >= REG_FILE_SIZE)
     {
-        return OPCODE_STORE;
+        parse_error(parser, "expected a register R0 to R%d, found %.*s",
+                    REG_FILE_SIZE - 1, token.len, token.text);
+        return -1;
     }
+    *reg = value;
+    return 0;
+}
+
+/*
+ * Immediate operand n, a number after '#' or a label. A label in a
+ * PC-relative branch becomes the offset to it, and anywhere else its
+ * address. Labels are resolved once the whole program has been read.
+ */
+static int
+parse_immediate(APEX_Parser *parser, int n, int relative, int *imm)
+{
+    APEX_Token token = parser->operands[n];
+    APEX_Token number = token;
+    APEX_Fixup *fixup;
+    int i;
 
-    if(strcmp(opcode_str, "ADDL") == 0)
+    if (token.len && token.text[0] == '#')
+    {
+        number.text++;
+        number.len--;
+    }
+    if (token_number(number, imm) == 0)
     {
-        return OPCODE_ADDL;
+        return 0;
     }
 
-    if(strcmp(opcode_str,"SUBL") == 0)
+    for (i = 0; i < token.len && is_label_char(token.text[i]); ++i)
+        ;
+    if (token.text[0] == '#' || i < token.len || (token.text[0] >= '0' && token.text[0] <= '9'))
     {
-        return OPCODE_SUBL;
+        parse_error(parser, "expected #<number> or a label, found %.*s", token.len,
+                    token.text);
+        return -1;
     }
 
-    if(strcmp(opcode_str,"CMP") == 0)
+    if (grow_array((void **)&parser->fixups, &parser->fixup_capacity, parser->fixup_count,
+                   sizeof(APEX_Fixup)) != 0)
     {
-        return OPCODE_CMP;
+        return -1;
     }
+    fixup = &parser->fixups[parser->fixup_count++];
+    fixup->name = token;
+    fixup->index = parser->count;
+    fixup->line = parser->line;
+    fixup->relative = relative;
+    *imm = 0;
+    return 0;
+}
+
+/*
+ * Fills in the operands of an instruction from the tokens after its
+ * mnemonic, in the order its format in apex_isa.def gives. Returns 0 on
+ * success and -1 on failure.
+ */
+static int
+parse_operands(APEX_Parser *parser, APEX_Instruction *ins)
+{
+    const APEX_IsaEntry *entry = APEX_isa_entry(ins->mnemonic);
+    int ret = 0;
+    int i;
 
-    if(strcmp(opcode_str,"CML") == 0)
+    if (parser->operand_count != entry->operand_count)
+    {
+        parse_error(parser, "%s takes %d operands, found %d", entry->mnemonic,
+                    entry->operand_count, parser->operand_count);
+        return -1;
+    }
+    for (i = 0; i < entry->operand_count && ret == 0; ++i)
     {
-        return OPCODE_CML;
+        switch (entry->operands[i])
+        {
+            case ISA_OPERAND_RD:
+                ret = parse_register(parser, i, &ins->rd);
+                break;
+            case ISA_OPERAND_RS1:
+                ret = parse_register(parser, i, &ins->rs1);
+                break;
+            case ISA_OPERAND_RS2:
+                ret = parse_register(parser, i, &ins->rs2);
+                break;
+            case ISA_OPERAND_IMM:
+                ret = parse_immediate(parser, i, FALSE, &ins->imm);
+                break;
+            case ISA_OPERAND_OFFSET:
+                ret = parse_immediate(parser, i, TRUE, &ins->imm);
+                break;
+        }
     }
+    return ret;
+}
 
-    if(strcmp(opcode_str,"JUMP") == 0)
+/*
+ * Parses the line at *cursor, which may hold a label, an instruction and a
+ * comment, each of them optional, and moves *cursor to the next line.
+ * Returns 0 on success and -1 on failure.
+ */
+static int
+parse_line(APEX_Parser *parser, const char **cursor)
+{
+    const char *p = *cursor;
+    APEX_Instruction *ins;
+    APEX_Token word;
+    int i;
+
+    while (is_space(*p))
+    {
+        p++;
+    }
+    word.text = p;
+    while (!is_token_end(*p) && *p != ':')
     {
-        return OPCODE_JUMP;
+        p++;
     }
+    word.len = p - word.text;
 
-    if(strcmp(opcode_str,"JALR") == 0)
+    if (*p == ':')
     {
-        return OPCODE_JALR;
+        for (i = 0; i < word.len && is_label_char(word.text[i]); ++i)
+            ;
+        if (word.len == 0 || i < word.len || (word.text[0] >= '0' && word.text[0] <= '9'))
+        {
+            parse_error(parser, "bad label %.*s", word.len, word.text);
+            return -1;
+        }
+        if (define_label(parser, word) != 0)
+        {
+            return -1;
+        }
+        for (p++; is_space(*p); p++)
+            ;
+        word.text = p;
+        while (!is_token_end(*p))
+        {
+            p++;
+        }
+        word.len = p - word.text;
     }
 
-    if (strcmp(opcode_str, "BZ") == 0)
+    if (word.len == 0)
     {
-        return OPCODE_BZ;
+        if (*p == ',')
+        {
+            parse_error(parser, "operands without an instruction");
+            return -1;
+        }
     }
+    else
+    {
+        if (grow_array((void **)&parser->code, &parser->capacity, parser->count,
+                       sizeof(APEX_Instruction)) != 0)
+        {
+            return -1;
+        }
+        ins = &parser->code[parser->count];
+        memset(ins, 0, sizeof(APEX_Instruction));
 
-    if (strcmp(opcode_str, "BNZ") == 0)
+        i = APEX_isa_lookup(word.text, word.len);
+        if (i < 0)
+        {
+            parse_error(parser, "unknown instruction %.*s", word.len, word.text);
+            return -1;
+        }
+        ins->mnemonic = i;
+        ins->opcode = APEX_isa_entry(i)->opcode;
+
+        /* Operands are separated by commas, with optional white space */
+        parser->operand_count = 0;
+        for (;;)
+        {
+            while (is_space(*p))
+            {
+                p++;
+            }
+            if (*p == ';' || *p == '\n' || *p == '\0')
+            {
+                break;
+            }
+            if (parser->operand_count && *p++ != ',')
+            {
+                parse_error(parser, "expected a comma between operands");
+                return -1;
+            }
+            while (is_space(*p))
+            {
+                p++;
+            }
+            if (parser->operand_count == ISA_MAX_OPERANDS + 1)
+            {
+                parse_error(parser, "too many operands");
+                return -1;
+            }
+            word.text = p;
+            while (!is_token_end(*p))
+            {
+                p++;
+            }
+            word.len = p - word.text;
+            if (word.len == 0)
+            {
+                parse_error(parser, "missing operand");
+                return -1;
+            }
+            parser->operands[parser->operand_count++] = word;
+        }
+
+        if (parse_operands(parser, ins) != 0)
+        {
+            return -1;
+        }
+        parser->count++;
+    }
+
+    while (is_space(*p))
     {
-        return OPCODE_BNZ;
+        p++;
+    }
+    if (*p != ';' && *p != '\n' && *p != '\0')
+    {
+        parse_error(parser, "unexpected %c", *p);
+        return -1;
     }
 
-    if (strcmp(opcode_str, "BP") == 0)
+    /* Skip the comment, if any */
+    while (*p != '\n' && *p != '\0')
     {
-        return OPCODE_BP;
+        p++;
     }
+    *cursor = *p == '\n' ? p + 1 : p;
+    return 0;
+}
+
+/* Patches every operand that names a label. Returns 0 on success and -1 if
+ * a label is never defined. */
+static int
+resolve_labels(APEX_Parser *parser)
+{
+    const APEX_Fixup *fixup;
+    const APEX_Label *label;
+    int i;
 
-    if (strcmp(opcode_str, "BNP") == 0)
+    for (i = 0; i < parser->fixup_count; ++i)
     {
-        return OPCODE_BNP;
+        fixup = &parser->fixups[i];
+        label = parser->label_slots ? find_label(parser, fixup->name) : NULL;
+        if (!label || !label->name.len)
+        {
+            parser->line = fixup->line;
+            parse_error(parser, "undefined label %.*s", fixup->name.len, fixup->name.text);
+            return -1;
+        }
+        parser->code[fixup->index].imm =
+            fixup->relative ? (label->index - fixup->index) * 4 : 4000 + label->index * 4;
     }
+    return 0;
+}
+
+/*
+ * Assembles the program in filename, or on standard input when it is "-",
+ * into code memory in a single pass. Each line holds an optional label
+ * ending in ':', an optional instruction and an optional comment starting
+ * with ';'. Returns NULL after printing the line at fault on failure.
+ */
+APEX_Instruction *
+create_code_memory(const char *filename, int *size)
+{
+    APEX_Parser parser;
+    const char *p;
+    char *source;
+    size_t length;
+    FILE *fp;
+    int ret = 0;
 
-    if (strcmp(opcode_str, "BN") == 0)
+    if (!filename)
     {
-        return OPCODE_BN;
+        return NULL;
     }
 
-    if (strcmp(opcode_str, "BNN") == 0)
+    fp = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open program %s\n", filename);
+        return NULL;
+    }
+    source = read_source(fp, &length);
+    if (fp != stdin)
+    {
+        fclose(fp);
+    }
+    if (!source)
     {
-        return OPCODE_BNN;
+        fprintf(stderr, "APEX_Error: Unable to read program %s\n", filename);
+        return NULL;
     }
 
-    if (strcmp(opcode_str, "HALT") == 0 || strcmp(opcode_str, "HALT\n")  == 0)
+    memset(&parser, 0, sizeof(parser));
+    parser.filename = filename;
+    p = source;
+    while (*p && ret == 0)
+    {
+        parser.line++;
+        ret = parse_line(&parser, &p);
+    }
+    if (ret == 0 && parser.count == 0)
+    {
+        fprintf(stderr, "APEX_Error: %s holds no instructions\n", filename);
+        ret = -1;
+    }
+    if (ret == 0)
     {
-        return OPCODE_HALT;
+        ret = resolve_labels(&parser);
     }
 
-    if (strcmp(opcode_str, "NOP") == 0 ||  strcmp(opcode_str, "NOP\n") == 0)
+    free(parser.labels);
+    free(parser.fixups);
+    free(source);
+    if (ret != 0)
     {
-        return OPCODE_NOP;
+        free(parser.code);
+        return NULL;
     }
-    printf("%s",opcode_str);
-    assert(0 && "Invalid opcode");
-    return 0;
+    *size = parser.count;
+    return parser.code;
 }
 
-static void
-split_opcode_from_insn_string(char *buffer, char tokens[2][128])
+/* Start of an assembled program, followed by count records */
+typedef struct APEX_ObjectHeader
 {
-    int token_num = 0;
+    unsigned int magic;            /* APEX_OBJECT_MAGIC */
+    unsigned int version;          /* APEX_OBJECT_VERSION */
+    unsigned int count;            /* Instructions */
+    unsigned int source_hash;      /* Of the source text it was assembled from */
+    unsigned int checksum;         /* Of the records */
+    unsigned int reserved;
+} APEX_ObjectHeader;
+
+/* One instruction, fixed width. The mnemonic follows from the opcode. */
+typedef struct APEX_ObjectInsn
+{
+    unsigned char opcode;
+    unsigned char rd;
+    unsigned char rs1;
+    unsigned char rs2;
+    int imm;
+} APEX_ObjectInsn;
+
+/* Continues the FNV-1a hash with size bytes of data, start from 2166136261 */
+unsigned int
+APEX_fnv1a(unsigned int hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    size_t i;
 
-    char *token = strtok(buffer, " ");
+    for (i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/* FNV-1a hash of the contents of a file, returns 0 on success and -1 if it
+ * cannot be read */
+int
+APEX_hash_file(const char *filename, unsigned int *hash)
+{
+    char buffer[65536];
+    size_t got;
+    FILE *fp = fopen(filename, "rb");
 
-    while (token != NULL)
+    if (!fp)
+    {
+        return -1;
+    }
+    *hash = 2166136261u;
+    while ((got = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    {
+        *hash = APEX_fnv1a(*hash, buffer, got);
+    }
+    if (ferror(fp))
     {
-        strcpy(tokens[token_num], token);
-        token_num++;
-        token = strtok(NULL, " ");
+        fclose(fp);
+        return -1;
     }
+    fclose(fp);
+    return 0;
 }
 
 /*
- * This function is related to parsing input file
- *
- * Note : you can edit this function to add new instructions
+ * Writes size instructions as an object file tagged with the hash of their
+ * source. The file is written under a temporary name and renamed, so
+ * concurrent runs never see half of one. Returns 0 on success and -1 on
+ * failure.
  */
-static void
-create_APEX_instruction(APEX_Instruction *ins, char *buffer)
+static int
+APEX_write_object(const APEX_Instruction *code, int size, unsigned int source_hash,
+                  const char *filename)
 {
-    int i, token_num = 0;
-    char tokens[6][128];
-    char top_level_tokens[2][128];
+    APEX_ObjectHeader header;
+    APEX_ObjectInsn *records;
+    char *temp;
+    FILE *fp;
+    int fd;
+    int ret = 0;
+    int i;
 
-    for (i = 0; i < 2; ++i)
+    records = calloc(size, sizeof(APEX_ObjectInsn));
+    temp = malloc(strlen(filename) + 8);
+    if (!records || !temp)
     {
-        strcpy(top_level_tokens[i], "");
+        free(records);
+        free(temp);
+        return -1;
     }
-
-    split_opcode_from_insn_string(buffer, top_level_tokens);
-
-    char *token = strtok(top_level_tokens[1], ",");
-
-    while (token != NULL)
+    for (i = 0; i < size; ++i)
     {
-        strcpy(tokens[token_num], token);
-        token_num++;
-        token = strtok(NULL, ",");
+        records[i].opcode = code[i].opcode;
+        records[i].rd = code[i].rd;
+        records[i].rs1 = code[i].rs1;
+        records[i].rs2 = code[i].rs2;
+        records[i].imm = code[i].imm;
     }
 
-    strcpy(ins->opcode_str, top_level_tokens[0]);
-    ins->opcode = set_opcode_str(ins->opcode_str);
+    memset(&header, 0, sizeof(header));
+    header.magic = APEX_OBJECT_MAGIC;
+    header.version = APEX_OBJECT_VERSION;
+    header.count = size;
+    header.source_hash = source_hash;
+    header.checksum = APEX_fnv1a(2166136261u, records, size * sizeof(APEX_ObjectInsn));
 
-    switch (ins->opcode)
+    sprintf(temp, "%s.XXXXXX", filename);
+    fd = mkstemp(temp);
+    if (fd >= 0)
+    {
+        fchmod(fd, 0644);
+    }
+    fp = fd < 0 ? NULL : fdopen(fd, "wb");
+    if (!fp)
     {
-        case OPCODE_ADD:
-        case OPCODE_SUB:
-        case OPCODE_MUL:
-        case OPCODE_DIV:
-        case OPCODE_AND:
-        case OPCODE_OR:
-        case OPCODE_XOR:
+        if (fd >= 0)
         {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->rs2 = get_num_from_string(tokens[2]);
-            break;
-        }
-        case OPCODE_ADDL:
-        case OPCODE_SUBL:
-        {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
-            break;
+            close(fd);
+            unlink(temp);
         }
+        free(records);
+        free(temp);
+        return -1;
+    }
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(records, sizeof(APEX_ObjectInsn), size, fp) != (size_t)size)
+    {
+        ret = -1;
+    }
+    if (fclose(fp) != 0 || ret != 0 || rename(temp, filename) != 0)
+    {
+        unlink(temp);
+        ret = -1;
+    }
+    free(records);
+    free(temp);
+    return ret;
+}
 
-        case OPCODE_MOVC:
+/*
+ * Maps an object file and decodes it into code memory. Unless any_source
+ * is set, it must have been assembled from a source with source_hash.
+ * Returns NULL, quietly unless report is set, if the file is missing,
+ * stale or corrupt.
+ */
+static APEX_Instruction *
+APEX_load_object(const char *filename, int any_source, unsigned int source_hash,
+                 int report, int *size)
+{
+    const APEX_ObjectHeader *header;
+    const APEX_ObjectInsn *records;
+    APEX_Instruction *code_memory = NULL;
+    struct stat st;
+    void *map;
+    int fd;
+    int i;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(APEX_ObjectHeader))
+    {
+        if (fd >= 0)
         {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->imm = get_num_from_string(tokens[1]);
-            break;
+            close(fd);
         }
-
-        case OPCODE_LOAD:
-        case OPCODE_LOADP:
-        case OPCODE_JALR:
+        if (report)
         {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
-            break;
+            fprintf(stderr, "APEX_Error: Unable to read program %s\n", filename);
         }
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return NULL;
+    }
 
-        case OPCODE_STORE:
-        case OPCODE_STOREP:
+    header = map;
+    records = (const APEX_ObjectInsn *)(header + 1);
+    if (header->magic != APEX_OBJECT_MAGIC || header->version != APEX_OBJECT_VERSION ||
+        header->count == 0 ||
+        st.st_size != (off_t)(sizeof(APEX_ObjectHeader) +
+                              header->count * (off_t)sizeof(APEX_ObjectInsn)) ||
+        header->checksum != APEX_fnv1a(2166136261u, records,
+                                       header->count * sizeof(APEX_ObjectInsn)) ||
+        (!any_source && header->source_hash != source_hash))
+    {
+        if (report)
         {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->rs2 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
-            break;
+            fprintf(stderr, "APEX_Error: %s is not a program object of this build\n",
+                    filename);
         }
+        munmap(map, st.st_size);
+        return NULL;
+    }
 
-        case OPCODE_CML:
-        case OPCODE_JUMP:
-        {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->imm = get_num_from_string(tokens[1]);
-            break;
-        }
-        case OPCODE_CMP:
+    code_memory = calloc(header->count, sizeof(APEX_Instruction));
+    for (i = 0; code_memory && i < (int)header->count; ++i)
+    {
+        if (APEX_isa_find(records[i].opcode) < 0 ||
+            records[i].rd >= REG_FILE_SIZE || records[i].rs1 >= REG_FILE_SIZE ||
+            records[i].rs2 >= REG_FILE_SIZE)
         {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->rs2 = get_num_from_string(tokens[1]);
+            fprintf(stderr, "APEX_Error: %s holds an invalid instruction\n", filename);
+            free(code_memory);
+            code_memory = NULL;
             break;
         }
+        code_memory[i].opcode = records[i].opcode;
+        code_memory[i].mnemonic = APEX_isa_find(records[i].opcode);
+        code_memory[i].rd = records[i].rd;
+        code_memory[i].rs1 = records[i].rs1;
+        code_memory[i].rs2 = records[i].rs2;
+        code_memory[i].imm = records[i].imm;
+    }
+    if (code_memory)
+    {
+        *size = header->count;
+    }
+    munmap(map, st.st_size);
+    return code_memory;
+}
 
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
-        case OPCODE_BP:
-        case OPCODE_BNP:
-        case OPCODE_BN:
-        case OPCODE_BNN:
-        {
-            ins->imm = get_num_from_string(tokens[0]);
-            break;
-        }
+/* TRUE if filename starts like an object file */
+static int
+APEX_is_object(const char *filename)
+{
+    unsigned int magic = 0;
+    FILE *fp = fopen(filename, "rb");
+
+    if (!fp)
+    {
+        return FALSE;
     }
-    /* Fill in rest of the instructions accordingly */
+    if (fread(&magic, sizeof(magic), 1, fp) != 1)
+    {
+        magic = 0;
+    }
+    fclose(fp);
+    return magic == APEX_OBJECT_MAGIC;
 }
 
 /*
- * This function is related to parsing input file
- *
- * Note : You are not supposed to edit this function
+ * Assembles the source program into an object file the simulator loads
+ * without parsing. Returns 0 on success and -1 on failure.
  */
-APEX_Instruction *
-create_code_memory(const char *filename, int *size)
+int
+APEX_assemble(const char *source, const char *object)
 {
-    FILE *fp;
-    ssize_t nread;
-    size_t len = 0;
-    char *line = NULL;
-    int code_memory_size = 0;
-    int current_instruction = 0;
     APEX_Instruction *code_memory;
+    unsigned int hash;
+    int size = 0;
+    int ret;
 
-    if (!filename)
+    if (APEX_hash_file(source, &hash) != 0 ||
+        !(code_memory = create_code_memory(source, &size)))
     {
-        return NULL;
+        fprintf(stderr, "APEX_Error: Unable to assemble %s\n", source);
+        return -1;
+    }
+    ret = APEX_write_object(code_memory, size, hash, object);
+    if (ret != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", object);
     }
+    free(code_memory);
+    return ret;
+}
 
-    fp = fopen(filename, "r");
-    if (!fp)
+/*
+ * Creates code memory from a source or object file. With code_cache set, a
+ * source is assembled once into an object next to it, named after it with
+ * APEX_OBJECT_SUFFIX, and later runs load that object for as long as the
+ * hash of the source still matches.
+ */
+APEX_Instruction *
+APEX_load_program(const char *filename, int code_cache, int *size)
+{
+    APEX_Instruction *code_memory;
+    unsigned int hash;
+    char *cache;
+
+    if (!filename)
     {
         return NULL;
     }
-
-    while ((nread = getline(&line, &len, fp)) != -1)
+    if (APEX_is_object(filename))
     {
-        code_memory_size++;
+        return APEX_load_object(filename, TRUE, 0, TRUE, size);
     }
-    *size = code_memory_size;
-    if (!code_memory_size)
+    if (!code_cache || APEX_hash_file(filename, &hash) != 0)
     {
-        fclose(fp);
-        return NULL;
+        return create_code_memory(filename, size);
     }
 
-    code_memory = calloc(code_memory_size, sizeof(APEX_Instruction));
-    if (!code_memory)
+    cache = malloc(strlen(filename) + sizeof(APEX_OBJECT_SUFFIX));
+    if (!cache)
     {
-        fclose(fp);
         return NULL;
     }
-
-    rewind(fp);
-    while ((nread = getline(&line, &len, fp)) != -1)
+    sprintf(cache, "%s%s", filename, APEX_OBJECT_SUFFIX);
+    code_memory = APEX_load_object(cache, FALSE, hash, FALSE, size);
+    if (!code_memory)
     {
-        create_APEX_instruction(&code_memory[current_instruction], line);
-        current_instruction++;
+        code_memory = create_code_memory(filename, size);
+        /* A cache that cannot be written only costs the next run a parse */
+        if (code_memory)
+        {
+            APEX_write_object(code_memory, *size, hash, cache);
+        }
     }
-
-    free(line);
-    fclose(fp);
+    free(cache);
     return code_memory;
 }
\ No newline at end of file
@@ -0,0 +1,1150 @@
+/*
+ * apex_batch.c
+ * Contains run option parsing, the single run driver and a batch runner
+ * that simulates many programs in parallel on a work-stealing thread pool
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "apex_batch.h"
+#include "apex_macros.h"
+
+/* One line of a batch manifest */
+typedef struct APEX_Job
+{
+    char *line;                    /* Owned copy of the line, fields point into it */
+    const char *program;
+    int num_of_cycles;
+    APEX_Config config;
+} APEX_Job;
+
+typedef struct APEX_JobResult
+{
+    int status;                    /* 0 once the job ran, -1 if it failed */
+    int halted;
+    int cycles;
+    int instructions;
+    int ff_instructions;
+    APEX_BTBStats btb;
+    APEX_BPredStats bpred;
+    APEX_TargetStats targets;
+    double seconds;
+    double sim_seconds;            /* Of APEX_simulate alone, without loading */
+    int worker;
+} APEX_JobResult;
+
+/*
+ * Job queue of one worker. The owner takes jobs from the tail, idle workers
+ * steal from the head, so they mostly touch opposite ends.
+ */
+typedef struct APEX_WorkQueue
+{
+    pthread_mutex_t lock;
+    int *jobs;
+    int head;
+    int tail;
+} APEX_WorkQueue;
+
+typedef struct APEX_Batch
+{
+    const APEX_Job *jobs;
+    int num_jobs;
+    APEX_JobResult *results;
+    APEX_WorkQueue *queues;
+    int num_workers;
+} APEX_Batch;
+
+typedef struct APEX_Worker
+{
+    APEX_Batch *batch;
+    int id;
+    pthread_t thread;
+} APEX_Worker;
+
+static double
+APEX_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Maps the value of a --trace=<level> option to a TRACE_* level, returns -1
+ * if the level is unknown
+ */
+static int
+parse_trace_level(const char *level)
+{
+    if (strcmp(level, "off") == 0)
+    {
+        return TRACE_OFF;
+    }
+
+    if (strcmp(level, "summary") == 0)
+    {
+        return TRACE_SUMMARY;
+    }
+
+    if (strcmp(level, "stage") == 0)
+    {
+        return TRACE_STAGE;
+    }
+
+    if (strcmp(level, "full") == 0)
+    {
+        return TRACE_FULL;
+    }
+
+    return -1;
+}
+
+/*
+ * Fills in the default run options
+ */
+void
+APEX_config_init(APEX_Config *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->trace_level = DEFAULT_TRACE_LEVEL;
+    config->ff_until = -1;
+    config->btb_sets = BTB_DEFAULT_SETS;
+    config->btb_ways = BTB_DEFAULT_WAYS;
+    config->btb_policy = BTB_REPLACE_LRU;
+    config->bpred_kind = BPRED_BTB;
+    config->ras_entries = RAS_DEFAULT_ENTRIES;
+    config->itp_entries = ITP_DEFAULT_ENTRIES;
+    config->perf_format = PERF_FORMAT_JSON;
+    config->backend = BACKEND_INORDER;
+    config->rob_entries = OOO_DEFAULT_ROB_ENTRIES;
+    config->iq_entries = OOO_DEFAULT_IQ_ENTRIES;
+    config->prf_entries = OOO_DEFAULT_PRF_ENTRIES;
+    APEX_fu_defaults(config->units);
+    config->lsq_entries = LSQ_DEFAULT_ENTRIES;
+    config->width = 1;
+    config->dcache_write = CACHE_WRITE_BACK;
+    config->dcache_policy = BTB_REPLACE_LRU;
+    config->memory_latency = CACHE_DEFAULT_MEMORY_LATENCY;
+    config->icache_miss_latency = IFETCH_DEFAULT_MISS_LATENCY;
+    config->icache_prefetch = IFETCH_DEFAULT_PREFETCH;
+    config->fetch_buffer = IFETCH_DEFAULT_BUFFER;
+    config->data_memory_size = DATA_MEMORY_SIZE;
+    config->huge_pages = MEMORY_HUGE_OFF;
+    config->bench_variant = "default";
+    config->bench_tolerance = BENCH_DEFAULT_TOLERANCE;
+    config->idle_skip = TRUE;
+}
+
+/*
+ * Applies one --name=value option, returns 0 on success and -1 if the
+ * option is unknown or its value is invalid
+ */
+int
+APEX_config_option(APEX_Config *config, const char *option)
+{
+    char *end;
+
+    if (strncmp(option, "--trace=", 8) == 0)
+    {
+        config->trace_level = parse_trace_level(option + 8);
+        if (config->trace_level < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown trace level %s\n", option + 8);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (strncmp(option, "--fast-forward=", 15) == 0)
+    {
+        config->fast_forward = TRUE;
+        config->ff_insns = atoi(option + 15);
+        return 0;
+    }
+
+    if (strncmp(option, "--ff-until=", 11) == 0)
+    {
+        config->fast_forward = TRUE;
+        config->ff_until = atoi(option + 11);
+        return 0;
+    }
+
+    if (strncmp(option, "--checkpoint=", 13) == 0)
+    {
+        config->checkpoint_file = option + 13;
+        return 0;
+    }
+
+    if (strncmp(option, "--restore=", 10) == 0)
+    {
+        config->restore_file = option + 10;
+        return 0;
+    }
+
+    if (strncmp(option, "--btb-sets=", 11) == 0)
+    {
+        config->btb_sets = atoi(option + 11);
+        return 0;
+    }
+
+    if (strncmp(option, "--btb-ways=", 11) == 0)
+    {
+        config->btb_ways = atoi(option + 11);
+        return 0;
+    }
+
+    if (strncmp(option, "--btb-replace=", 14) == 0)
+    {
+        config->btb_policy = APEX_btb_parse_policy(option + 14);
+        if (config->btb_policy < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown BTB replacement policy %s\n", option + 14);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (strncmp(option, "--bpred=", 8) == 0)
+    {
+        config->bpred_kind = APEX_bpred_parse_kind(option + 8);
+        if (config->bpred_kind < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown branch predictor %s\n", option + 8);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (strncmp(option, "--bpred-entries=", 16) == 0)
+    {
+        config->bpred_entries = atoi(option + 16);
+        return 0;
+    }
+
+    if (strncmp(option, "--bpred-history=", 16) == 0)
+    {
+        config->bpred_history = atoi(option + 16);
+        return 0;
+    }
+
+    if (strncmp(option, "--ras-entries=", 14) == 0)
+    {
+        config->ras_entries = atoi(option + 14);
+        return 0;
+    }
+
+    if (strncmp(option, "--itp-entries=", 14) == 0)
+    {
+        config->itp_entries = atoi(option + 14);
+        return 0;
+    }
+
+    if (strncmp(option, "--branch-trace=", 15) == 0)
+    {
+        config->branch_trace_file = option + 15;
+        return 0;
+    }
+
+    if (strncmp(option, "--backend=", 10) == 0)
+    {
+        config->backend = APEX_ooo_parse_backend(option + 10);
+        if (config->backend < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown backend %s\n", option + 10);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (strncmp(option, "--rob-entries=", 14) == 0)
+    {
+        config->rob_entries = atoi(option + 14);
+        return 0;
+    }
+
+    if (strncmp(option, "--iq-entries=", 13) == 0)
+    {
+        config->iq_entries = atoi(option + 13);
+        return 0;
+    }
+
+    if (strncmp(option, "--prf-entries=", 14) == 0)
+    {
+        config->prf_entries = atoi(option + 14);
+        return 0;
+    }
+
+    if (strncmp(option, "--fu=", 5) == 0)
+    {
+        return APEX_fu_parse(config->units, option + 5);
+    }
+
+    if (strncmp(option, "--lsq-entries=", 14) == 0)
+    {
+        config->lsq_entries = atoi(option + 14);
+        return 0;
+    }
+
+    if (strncmp(option, "--width=", 8) == 0)
+    {
+        config->width = atoi(option + 8);
+        return 0;
+    }
+
+    if (strncmp(option, "--l1d=", 6) == 0)
+    {
+        return APEX_cache_parse(&config->dcache[CACHE_L1D], option + 6);
+    }
+
+    if (strncmp(option, "--l2=", 5) == 0)
+    {
+        return APEX_cache_parse(&config->dcache[CACHE_L2], option + 5);
+    }
+
+    if (strncmp(option, "--cache-write=", 14) == 0)
+    {
+        config->dcache_write = APEX_cache_parse_write(option + 14);
+        if (config->dcache_write < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown cache write policy %s\n", option + 14);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (strncmp(option, "--cache-replace=", 16) == 0)
+    {
+        config->dcache_policy = APEX_btb_parse_policy(option + 16);
+        if (config->dcache_policy < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown cache replacement policy %s\n", option + 16);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (strncmp(option, "--mem-latency=", 14) == 0)
+    {
+        config->memory_latency = atoi(option + 14);
+        return 0;
+    }
+
+    if (strncmp(option, "--l1i=", 6) == 0)
+    {
+        return APEX_cache_parse(&config->icache, option + 6);
+    }
+
+    if (strncmp(option, "--l1i-miss=", 11) == 0)
+    {
+        config->icache_miss_latency = atoi(option + 11);
+        return 0;
+    }
+
+    if (strncmp(option, "--l1i-prefetch=", 15) == 0)
+    {
+        config->icache_prefetch = atoi(option + 15);
+        return 0;
+    }
+
+    if (strncmp(option, "--fetch-buffer=", 15) == 0)
+    {
+        config->fetch_buffer = atoi(option + 15);
+        return 0;
+    }
+
+    if (strncmp(option, "--data-memory=", 14) == 0)
+    {
+        config->data_memory_size = atoi(option + 14);
+        return 0;
+    }
+
+    if (strncmp(option, "--data-image=", 13) == 0)
+    {
+        config->data_image_file = option + 13;
+        return 0;
+    }
+
+    if (strncmp(option, "--data-dump=", 12) == 0)
+    {
+        config->data_dump_file = option + 12;
+        return 0;
+    }
+
+    if (strncmp(option, "--memory-checksum=", 18) == 0)
+    {
+        if (strcmp(option + 18, "show") == 0)
+        {
+            config->memory_checksum = MEMORY_CHECKSUM_SHOW;
+            return 0;
+        }
+        config->expected_checksum = strtoul(option + 18, &end, 0);
+        if (option[18] == '\0' || *end != '\0')
+        {
+            fprintf(stderr, "APEX_Error: The memory checksum must be show or a number\n");
+            return -1;
+        }
+        config->memory_checksum = MEMORY_CHECKSUM_CHECK;
+        return 0;
+    }
+
+    if (strncmp(option, "--bench-variant=", 16) == 0)
+    {
+        config->bench_variant = option + 16;
+        return 0;
+    }
+
+    if (strncmp(option, "--bench-baseline=", 17) == 0)
+    {
+        config->bench_baseline = option + 17;
+        return 0;
+    }
+
+    if (strncmp(option, "--bench-tolerance=", 18) == 0)
+    {
+        config->bench_tolerance = atoi(option + 18);
+        return 0;
+    }
+
+    if (strncmp(option, "--idle-skip=", 12) == 0)
+    {
+        if (strcmp(option + 12, "on") != 0 && strcmp(option + 12, "off") != 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown idle skip setting %s\n", option + 12);
+            return -1;
+        }
+        config->idle_skip = strcmp(option + 12, "on") == 0;
+        return 0;
+    }
+
+    if (strncmp(option, "--code-cache=", 13) == 0)
+    {
+        if (strcmp(option + 13, "on") != 0 && strcmp(option + 13, "off") != 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown code cache setting %s\n", option + 13);
+            return -1;
+        }
+        config->code_cache = strcmp(option + 13, "on") == 0;
+        return 0;
+    }
+
+    if (strncmp(option, "--huge-pages=", 13) == 0)
+    {
+        config->huge_pages = APEX_memory_parse_huge(option + 13);
+        if (config->huge_pages < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown huge page setting %s\n", option + 13);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (strncmp(option, "--perf-report=", 14) == 0)
+    {
+        config->perf_report_file = option + 14;
+        return 0;
+    }
+
+    if (strncmp(option, "--perf-format=", 14) == 0)
+    {
+        config->perf_format = APEX_perf_parse_format(option + 14);
+        if (config->perf_format < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown performance report format %s\n", option + 14);
+            return -1;
+        }
+        return 0;
+    }
+
+    fprintf(stderr, "APEX_Error: Unknown option %s\n", option);
+    return -1;
+}
+
+/*
+ * Runs an initialized CPU as the options ask: restore, fast-forward,
+ * simulate up to num_of_cycles, checkpoint, dump and check data memory and
+ * report the counters. Returns TRUE if HALT retired, FALSE if the cycle
+ * budget ran out and -1 on failure.
+ */
+int
+APEX_simulate(APEX_CPU *cpu, const APEX_Config *config, int num_of_cycles)
+{
+    unsigned int checksum;
+    int halted;
+
+    if (config->restore_file && APEX_cpu_restore(cpu, config->restore_file) != 0)
+    {
+        return -1;
+    }
+
+    if (config->fast_forward)
+    {
+        APEX_cpu_fast_forward(cpu, config->ff_insns, config->ff_until);
+    }
+
+    halted = APEX_cpu_run(cpu, num_of_cycles);
+
+    if (config->checkpoint_file &&
+        APEX_cpu_checkpoint(cpu, config->checkpoint_file) != 0)
+    {
+        return -1;
+    }
+
+    if (config->data_dump_file)
+    {
+        /* Stores still in the store buffer are part of the final memory */
+        APEX_lsq_flush(&cpu->lsq, &cpu->data_memory);
+        if (APEX_memory_dump(&cpu->data_memory, config->data_dump_file) != 0)
+        {
+            return -1;
+        }
+    }
+
+    if (config->memory_checksum != MEMORY_CHECKSUM_OFF)
+    {
+        APEX_lsq_flush(&cpu->lsq, &cpu->data_memory);
+        checksum = APEX_memory_checksum(&cpu->data_memory);
+        if (config->trace_level >= TRACE_SUMMARY)
+        {
+            printf("APEX_CPU: Data memory checksum = 0x%08x\n", checksum);
+        }
+        if (config->memory_checksum == MEMORY_CHECKSUM_CHECK &&
+            checksum != config->expected_checksum)
+        {
+            fprintf(stderr, "APEX_Error: Data memory checksum 0x%08x, expected 0x%08x\n",
+                    checksum, config->expected_checksum);
+            return -1;
+        }
+    }
+
+    if (config->perf_report_file &&
+        APEX_perf_write(cpu, config->perf_report_file, config->perf_format) != 0)
+    {
+        return -1;
+    }
+    return halted;
+}
+
+static void
+APEX_free_jobs(APEX_Job *jobs, int num_jobs)
+{
+    int i;
+
+    for (i = 0; i < num_jobs; ++i)
+    {
+        free(jobs[i].line);
+    }
+    free(jobs);
+}
+
+/*
+ * Reads a manifest with one job per line:
+ *
+ *     <program> <cycles> [--option=value ...]
+ *
+ * Blank lines and lines starting with # are skipped. Options are the same
+ * as on the command line and apply on top of the defaults. Jobs always run
+ * with tracing off. Returns the job array, or NULL on failure.
+ */
+static APEX_Job *
+APEX_read_manifest(const char *manifest, const APEX_Config *defaults, int *num_jobs)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t len = 0;
+    int line_num = 0;
+    int capacity = 16;
+    int count = 0;
+    APEX_Job *jobs;
+    APEX_Job *job;
+    char *save;
+    char *token;
+
+    fp = fopen(manifest, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open manifest %s\n", manifest);
+        return NULL;
+    }
+
+    jobs = calloc(capacity, sizeof(APEX_Job));
+    if (!jobs)
+    {
+        fclose(fp);
+        return NULL;
+    }
+
+    while (getline(&line, &len, fp) != -1)
+    {
+        line_num++;
+        token = line + strspn(line, " \t\r\n");
+        if (*token == '\0' || *token == '#')
+        {
+            continue;
+        }
+
+        if (count == capacity)
+        {
+            capacity *= 2;
+            job = realloc(jobs, capacity * sizeof(APEX_Job));
+            if (!job)
+            {
+                goto fail;
+            }
+            jobs = job;
+        }
+
+        job = &jobs[count];
+        job->line = strdup(token);
+        if (!job->line)
+        {
+            goto fail;
+        }
+        count++;
+        job->config = *defaults;
+
+        job->program = strtok_r(job->line, " \t\r\n", &save);
+        token = strtok_r(NULL, " \t\r\n", &save);
+        job->num_of_cycles = token ? atoi(token) : 0;
+        if (job->num_of_cycles <= 0)
+        {
+            fprintf(stderr, "APEX_Error: %s:%d: expected <program> <cycles>\n",
+                    manifest, line_num);
+            goto fail;
+        }
+
+        while ((token = strtok_r(NULL, " \t\r\n", &save)) != NULL)
+        {
+            if (APEX_config_option(&job->config, token) != 0)
+            {
+                fprintf(stderr, "APEX_Error: %s:%d: bad option\n", manifest, line_num);
+                goto fail;
+            }
+        }
+        job->config.trace_level = TRACE_OFF;
+    }
+
+    free(line);
+    fclose(fp);
+    if (!count)
+    {
+        fprintf(stderr, "APEX_Error: Manifest %s has no jobs\n", manifest);
+        free(jobs);
+        return NULL;
+    }
+    *num_jobs = count;
+    return jobs;
+
+fail:
+    free(line);
+    fclose(fp);
+    APEX_free_jobs(jobs, count);
+    return NULL;
+}
+
+static void
+APEX_run_job(const APEX_Job *job, APEX_JobResult *result)
+{
+    APEX_CPU *cpu;
+    double start = APEX_now();
+    double sim_start;
+
+    result->status = -1;
+    cpu = APEX_cpu_init(job->program, &job->config);
+    if (!cpu)
+    {
+        fprintf(stderr, "APEX_Error: Unable to initialize CPU for %s\n", job->program);
+        return;
+    }
+
+    sim_start = APEX_now();
+    result->halted = APEX_simulate(cpu, &job->config, job->num_of_cycles);
+    result->sim_seconds = APEX_now() - sim_start;
+    if (result->halted >= 0)
+    {
+        result->status = 0;
+    }
+    result->cycles = cpu->clock;
+    result->instructions = cpu->insn_completed;
+    result->ff_instructions = cpu->insn_fast_forwarded;
+    result->btb = cpu->btb.stats;
+    result->bpred = cpu->bpred.stats;
+    result->targets = cpu->bpred.target_stats;
+    result->seconds = APEX_now() - start;
+    APEX_cpu_stop(cpu);
+}
+
+/*
+ * Takes the next job for a worker, first from its own queue and then by
+ * stealing from the others. Returns -1 once every queue is empty.
+ */
+static int
+APEX_next_job(APEX_Batch *batch, int id)
+{
+    APEX_WorkQueue *queue;
+    int job = -1;
+    int i;
+
+    queue = &batch->queues[id];
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail > queue->head)
+    {
+        job = queue->jobs[--queue->tail];
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    for (i = 1; job < 0 && i < batch->num_workers; ++i)
+    {
+        queue = &batch->queues[(id + i) % batch->num_workers];
+        pthread_mutex_lock(&queue->lock);
+        if (queue->tail > queue->head)
+        {
+            job = queue->jobs[queue->head++];
+        }
+        pthread_mutex_unlock(&queue->lock);
+    }
+    return job;
+}
+
+static void *
+APEX_worker_main(void *arg)
+{
+    APEX_Worker *worker = arg;
+    APEX_Batch *batch = worker->batch;
+    int job;
+
+    while ((job = APEX_next_job(batch, worker->id)) >= 0)
+    {
+        APEX_run_job(&batch->jobs[job], &batch->results[job]);
+        batch->results[job].worker = worker->id;
+    }
+    return NULL;
+}
+
+/*
+ * Runs every job on num_threads workers, filling in one result per job.
+ * Jobs are dealt round-robin to the worker queues up front. Returns the
+ * wall-clock time taken, or a negative value on failure.
+ */
+static double
+APEX_run_jobs(const APEX_Job *jobs, int num_jobs, int num_threads,
+              APEX_JobResult *results)
+{
+    APEX_Batch batch;
+    APEX_Worker *workers;
+    double seconds = -1;
+    double start;
+    int started;
+    int i;
+
+    if (num_threads > num_jobs)
+    {
+        num_threads = num_jobs;
+    }
+
+    batch.jobs = jobs;
+    batch.num_jobs = num_jobs;
+    batch.results = results;
+    batch.num_workers = num_threads;
+    batch.queues = calloc(num_threads, sizeof(APEX_WorkQueue));
+    workers = calloc(num_threads, sizeof(APEX_Worker));
+    if (!batch.queues || !workers)
+    {
+        free(batch.queues);
+        free(workers);
+        return -1;
+    }
+
+    for (i = 0; i < num_threads; ++i)
+    {
+        pthread_mutex_init(&batch.queues[i].lock, NULL);
+        batch.queues[i].jobs = calloc(num_jobs / num_threads + 1, sizeof(int));
+        if (!batch.queues[i].jobs)
+        {
+            num_threads = i + 1;
+            goto done;
+        }
+    }
+    for (i = 0; i < num_jobs; ++i)
+    {
+        APEX_WorkQueue *queue = &batch.queues[i % num_threads];
+        queue->jobs[queue->tail++] = i;
+    }
+
+    memset(results, 0, num_jobs * sizeof(APEX_JobResult));
+    start = APEX_now();
+    for (started = 0; started < num_threads; ++started)
+    {
+        workers[started].batch = &batch;
+        workers[started].id = started;
+        if (pthread_create(&workers[started].thread, NULL, APEX_worker_main,
+                           &workers[started]) != 0)
+        {
+            break;
+        }
+    }
+
+    /* Workers that did start steal the jobs queued for the others */
+    if (started == 0)
+    {
+        workers[0].batch = &batch;
+        workers[0].id = 0;
+        APEX_worker_main(&workers[0]);
+    }
+    for (i = 0; i < started; ++i)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+    seconds = APEX_now() - start;
+
+done:
+    for (i = 0; i < num_threads; ++i)
+    {
+        pthread_mutex_destroy(&batch.queues[i].lock);
+        free(batch.queues[i].jobs);
+    }
+    free(batch.queues);
+    free(workers);
+    return seconds;
+}
+
+static int
+APEX_default_threads(int num_threads)
+{
+    long cores;
+
+    if (num_threads > 0)
+    {
+        return num_threads;
+    }
+    cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
+
+/*
+ * Runs every job of a manifest on a pool of num_threads workers (all cores
+ * when 0) and writes one CSV record per job, in manifest order. Returns 0
+ * if every job ran and -1 otherwise.
+ */
+int
+APEX_batch_run(const char *manifest, int num_threads, const APEX_Config *defaults,
+               FILE *out)
+{
+    APEX_Job *jobs;
+    APEX_JobResult *results;
+    int num_jobs;
+    int ret = 0;
+    int i;
+
+    jobs = APEX_read_manifest(manifest, defaults, &num_jobs);
+    if (!jobs)
+    {
+        return -1;
+    }
+
+    results = calloc(num_jobs, sizeof(APEX_JobResult));
+    if (!results || APEX_run_jobs(jobs, num_jobs, APEX_default_threads(num_threads),
+                                  results) < 0)
+    {
+        free(results);
+        APEX_free_jobs(jobs, num_jobs);
+        return -1;
+    }
+
+    fprintf(out, "job,program,cycle_budget,status,cycles,instructions,"
+            "ff_instructions,btb,btb_lookups,btb_hits,btb_conflict_misses,bpred,branches,"
+            "mispredicts,jumps,jump_targets_correct,cpi,seconds,worker\n");
+    for (i = 0; i < num_jobs; ++i)
+    {
+        const APEX_JobResult *r = &results[i];
+
+        if (r->status != 0)
+        {
+            ret = -1;
+        }
+        fprintf(out, "%d,%s,%d,%s,%d,%d,%d,%dx%d-%s,%lld,%lld,%lld,%s,%lld,%lld,%lld,%lld,"
+                "%.3f,%.6f,%d\n", i, jobs[i].program, jobs[i].num_of_cycles,
+                r->status != 0 ? "error" : (r->halted ? "halted" : "stopped"),
+                r->cycles, r->instructions, r->ff_instructions, jobs[i].config.btb_sets,
+                jobs[i].config.btb_ways, APEX_btb_policy_name(jobs[i].config.btb_policy),
+                r->btb.lookups, r->btb.hits, r->btb.conflict_misses,
+                APEX_bpred_kind_name(jobs[i].config.bpred_kind), r->bpred.branches,
+                r->bpred.mispredicts, r->targets.jumps, r->targets.correct,
+                r->instructions ? (double)r->cycles / r->instructions : 0.0, r->seconds,
+                r->worker);
+    }
+
+    free(results);
+    APEX_free_jobs(jobs, num_jobs);
+    return ret;
+}
+
+/*
+ * Runs a manifest at 1, 2, 4, ... threads up to max_threads (all cores
+ * when 0) and writes throughput against thread count as CSV
+ */
+int
+APEX_batch_scaling(const char *manifest, int max_threads, const APEX_Config *defaults,
+                   FILE *out)
+{
+    APEX_Job *jobs;
+    APEX_JobResult *results;
+    double seconds;
+    double base = 0;
+    double cycles;
+    int num_jobs;
+    int threads;
+    int i;
+
+    jobs = APEX_read_manifest(manifest, defaults, &num_jobs);
+    if (!jobs)
+    {
+        return -1;
+    }
+
+    results = calloc(num_jobs, sizeof(APEX_JobResult));
+    if (!results)
+    {
+        APEX_free_jobs(jobs, num_jobs);
+        return -1;
+    }
+
+    max_threads = APEX_default_threads(max_threads);
+    fprintf(out, "threads,seconds,jobs_per_second,mcycles_per_second,speedup,efficiency\n");
+    for (threads = 1; threads <= max_threads; threads *= 2)
+    {
+        /* Always finish on max_threads itself */
+        if (threads * 2 > max_threads)
+        {
+            threads = max_threads;
+        }
+
+        seconds = APEX_run_jobs(jobs, num_jobs, threads, results);
+        if (seconds < 0)
+        {
+            break;
+        }
+
+        cycles = 0;
+        for (i = 0; i < num_jobs; ++i)
+        {
+            cycles += results[i].cycles;
+        }
+        if (threads == 1)
+        {
+            base = seconds;
+        }
+        fprintf(out, "%d,%.6f,%.2f,%.3f,%.2f,%.2f\n", threads, seconds,
+                num_jobs / seconds, cycles / seconds / 1e6, base / seconds,
+                base / seconds / threads);
+    }
+
+    free(results);
+    APEX_free_jobs(jobs, num_jobs);
+    return 0;
+}
+
+static int
+APEX_compare_seconds(const void *a, const void *b)
+{
+    const double x = *(const double *)a;
+    const double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Simulated cycles per host second of a job, or of the whole manifest for
+ * job "all", in an earlier bench CSV for the same variant and program.
+ * Returns 0 if the baseline has no such record.
+ */
+static double
+APEX_bench_baseline(const char *baseline, const char *variant, const char *job,
+                    const char *program)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t len = 0;
+    char *field[11];
+    char *save;
+    double rate = 0;
+    int i;
+
+    fp = fopen(baseline, "r");
+    if (!fp)
+    {
+        return 0;
+    }
+    while (rate == 0 && getline(&line, &len, fp) != -1)
+    {
+        field[0] = strtok_r(line, ",\r\n", &save);
+        for (i = 1; i < 11 && field[i - 1]; ++i)
+        {
+            field[i] = strtok_r(NULL, ",\r\n", &save);
+        }
+        if (field[i - 1] && strcmp(field[0], variant) == 0 && strcmp(field[1], job) == 0 &&
+            strcmp(field[2], program) == 0)
+        {
+            rate = atof(field[10]);
+        }
+    }
+    free(line);
+    fclose(fp);
+    return rate;
+}
+
+/* Writes one bench record, with the change from the baseline if it has one.
+ * Returns -1 if the rate dropped by more than the tolerance. */
+static int
+APEX_bench_record(FILE *out, const APEX_Config *defaults, const char *job,
+                  const char *program, double cycles, double instructions, int repeats,
+                  double median, double fastest, double stddev)
+{
+    double rate = cycles / median / 1e6;
+    double base = 0;
+    double change = 0;
+    const char *verdict = "none";
+
+    if (defaults->bench_baseline)
+    {
+        base = APEX_bench_baseline(defaults->bench_baseline, defaults->bench_variant, job,
+                                   program);
+        verdict = "new";
+    }
+    if (base > 0)
+    {
+        change = (rate - base) / base * 100;
+        verdict = change < -defaults->bench_tolerance ? "slower" :
+                  change > defaults->bench_tolerance ? "faster" : "same";
+    }
+    fprintf(out, "%s,%s,%s,%.0f,%.0f,%d,%.6f,%.6f,%.6f,%.3f,%.3f,%.3f,%.3f,%.1f,%s\n",
+            defaults->bench_variant, job, program, cycles, instructions, repeats, median,
+            fastest, stddev, cycles / fastest / 1e6, rate, instructions / median / 1e6,
+            base, change, verdict);
+    return strcmp(verdict, "slower") == 0 ? -1 : 0;
+}
+
+/*
+ * Measures how fast this build simulates: every job of a manifest runs on
+ * one thread, once to warm up and then repeats times, and the time spent
+ * in APEX_simulate is summarized per job and for the whole manifest as a
+ * CSV record with the median, fastest and standard deviation, simulated
+ * cycles per host second and instructions per host second. Rates use the
+ * median, so one disturbed repetition does not move them. With a baseline
+ * each record is compared to the same job of the same variant there.
+ * Returns -1 if a job failed or got slower than the tolerance allows.
+ */
+int
+APEX_batch_bench(const char *manifest, int repeats, const APEX_Config *defaults,
+                 FILE *out)
+{
+    APEX_Job *jobs;
+    APEX_JobResult *results;
+    double *seconds;
+    double *totals;
+    double cycles = 0;
+    double instructions = 0;
+    double median;
+    double mean;
+    double var;
+    char job[16];
+    int num_jobs;
+    int ret = 0;
+    int i;
+    int r;
+
+    if (repeats <= 0)
+    {
+        repeats = BENCH_DEFAULT_REPEATS;
+    }
+    jobs = APEX_read_manifest(manifest, defaults, &num_jobs);
+    if (!jobs)
+    {
+        return -1;
+    }
+
+    results = calloc(num_jobs, sizeof(APEX_JobResult));
+    seconds = calloc((size_t)num_jobs * repeats, sizeof(double));
+    totals = calloc(repeats, sizeof(double));
+    if (!results || !seconds || !totals)
+    {
+        ret = -1;
+        goto done;
+    }
+
+    for (r = -1; r < repeats; ++r)
+    {
+        for (i = 0; i < num_jobs; ++i)
+        {
+            APEX_run_job(&jobs[i], &results[i]);
+            if (results[i].status != 0)
+            {
+                fprintf(stderr, "APEX_Error: Job %d (%s) failed\n", i, jobs[i].program);
+                ret = -1;
+                goto done;
+            }
+            if (r >= 0)
+            {
+                seconds[i * repeats + r] = results[i].sim_seconds;
+                totals[r] += results[i].sim_seconds;
+            }
+        }
+    }
+
+    fprintf(out, "variant,job,program,cycles,instructions,repeats,median_seconds,"
+            "min_seconds,stddev_seconds,best_mcycles_per_second,mcycles_per_second,"
+            "minsns_per_second,baseline_mcycles_per_second,change_percent,verdict\n");
+    for (i = 0; i <= num_jobs; ++i)
+    {
+        /* The last record is the whole manifest */
+        double *s = i < num_jobs ? &seconds[i * repeats] : totals;
+
+        mean = 0;
+        for (r = 0; r < repeats; ++r)
+        {
+            mean += s[r] / repeats;
+        }
+        var = 0;
+        for (r = 0; r < repeats; ++r)
+        {
+            var += (s[r] - mean) * (s[r] - mean);
+        }
+        var = repeats > 1 ? var / (repeats - 1) : 0;
+        qsort(s, repeats, sizeof(double), APEX_compare_seconds);
+        median = (s[(repeats - 1) / 2] + s[repeats / 2]) / 2;
+
+        if (i < num_jobs)
+        {
+            snprintf(job, sizeof(job), "%d", i);
+            cycles += results[i].cycles;
+            instructions += results[i].instructions;
+            if (APEX_bench_record(out, defaults, job, jobs[i].program, results[i].cycles,
+                                  results[i].instructions, repeats, median, s[0],
+                                  sqrt(var)) != 0)
+            {
+                ret = -1;
+            }
+        }
+        else if (APEX_bench_record(out, defaults, "all", manifest, cycles, instructions,
+                                   repeats, median, s[0], sqrt(var)) != 0)
+        {
+            ret = -1;
+        }
+    }
+
+done:
+    free(totals);
+    free(seconds);
+    free(results);
+    APEX_free_jobs(jobs, num_jobs);
+    return ret;
+}
@@ -0,0 +1,247 @@
+/*
+ * apex_bpeval.c
+ * Replays a branch stream written with --branch-trace through the BTB and a
+ * branch predictor, without simulating the pipeline
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apex_bpred.h"
+#include "apex_btb.h"
+#include "apex_btrace.h"
+#include "apex_macros.h"
+
+/* Predictor configuration, the same options and defaults as apex_sim */
+typedef struct APEX_EvalConfig
+{
+    int btb_sets;
+    int btb_ways;
+    int btb_policy;
+    int bpred_kind;
+    int bpred_entries;
+    int bpred_history;
+    int ras_entries;
+    int itp_entries;
+} APEX_EvalConfig;
+
+static int
+APEX_eval_option(APEX_EvalConfig *config, const char *option)
+{
+    if (strncmp(option, "--btb-sets=", 11) == 0)
+    {
+        config->btb_sets = atoi(option + 11);
+        return 0;
+    }
+
+    if (strncmp(option, "--btb-ways=", 11) == 0)
+    {
+        config->btb_ways = atoi(option + 11);
+        return 0;
+    }
+
+    if (strncmp(option, "--btb-replace=", 14) == 0)
+    {
+        config->btb_policy = APEX_btb_parse_policy(option + 14);
+        if (config->btb_policy < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown BTB replacement policy %s\n", option + 14);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (strncmp(option, "--bpred=", 8) == 0)
+    {
+        config->bpred_kind = APEX_bpred_parse_kind(option + 8);
+        if (config->bpred_kind < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown branch predictor %s\n", option + 8);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (strncmp(option, "--bpred-entries=", 16) == 0)
+    {
+        config->bpred_entries = atoi(option + 16);
+        return 0;
+    }
+
+    if (strncmp(option, "--bpred-history=", 16) == 0)
+    {
+        config->bpred_history = atoi(option + 16);
+        return 0;
+    }
+
+    if (strncmp(option, "--ras-entries=", 14) == 0)
+    {
+        config->ras_entries = atoi(option + 14);
+        return 0;
+    }
+
+    if (strncmp(option, "--itp-entries=", 14) == 0)
+    {
+        config->itp_entries = atoi(option + 14);
+        return 0;
+    }
+
+    fprintf(stderr, "APEX_Error: Unknown option %s\n", option);
+    return -1;
+}
+
+/*
+ * Conditional branch: predicted at fetch as the pipeline does in BTBHit, a
+ * BTB miss allocates and seeds an entry as decode does, then execute
+ * records the target and trains the predictor. Every step completes before
+ * the next branch, so no prediction sees a branch still in flight.
+ */
+static void
+APEX_eval_branch(APEX_BTB *btb, APEX_BPred *bp, const APEX_BranchRecord *r)
+{
+    APEX_BPredInfo *info;
+    BTBentry *entry;
+    int predicted;
+    int slot;
+    int i;
+
+    i = APEX_btb_lookup(btb, r->pc);
+    APEX_btb_account(btb, r->pc, i >= 0);
+    info = APEX_bpred_begin(bp, r->pc, i, &slot);
+    predicted = APEX_bpred_predict(bp, info) & (i >= 0);
+    APEX_bpred_spec_update(bp, info, predicted);
+
+    if (i < 0)
+    {
+        i = APEX_btb_allocate(btb, r->pc);
+        entry = &btb->entries[i];
+        entry->valid = 1;
+        entry->i_address = r->pc;
+        entry->h_bits[0] = entry->h_bits[1] =
+            r->opcode == OPCODE_BNZ || r->opcode == OPCODE_BP;
+    }
+    btb->entries[i].t_address = r->target;
+    info->btb_index = i;
+
+    APEX_bpred_update(bp, info, r->taken, r->taken != predicted);
+    if (r->taken != predicted)
+    {
+        APEX_bpred_recover(bp, info);
+        APEX_bpred_spec_update(bp, info, r->taken);
+    }
+}
+
+/* JUMP or JALR: target predicted at fetch and resolved in execute */
+static void
+APEX_eval_jump(APEX_BPred *bp, const APEX_BranchRecord *r)
+{
+    APEX_BPredInfo *info;
+    int predicted;
+    int slot;
+
+    info = APEX_bpred_begin(bp, r->pc, -1, &slot);
+    if (r->opcode == OPCODE_JALR)
+    {
+        predicted = APEX_bpred_predict_call(bp, info, r->reg);
+    }
+    else
+    {
+        predicted = APEX_bpred_predict_jump(bp, info, r->reg, r->imm);
+    }
+    APEX_bpred_resolve_target(bp, info, r->target, predicted != r->target);
+}
+
+int
+main(int argc, char const *argv[])
+{
+    APEX_EvalConfig config;
+    APEX_BranchTraceHeader header;
+    const APEX_BranchRecord *records;
+    const APEX_BranchRecord *r;
+    struct timespec start;
+    struct timespec end;
+    APEX_BTB btb;
+    APEX_BPred bp;
+    size_t map_size;
+    long long misses;
+    long long i;
+    double seconds;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s <branch_trace> [--btb-sets=<sets>] "
+                "[--btb-ways=<ways>] [--btb-replace=<policy>] [--bpred=<kind>] "
+                "[--bpred-entries=<rows>] [--bpred-history=<bits>] "
+                "[--ras-entries=<entries>] [--itp-entries=<rows>]\n", argv[0]);
+        exit(1);
+    }
+
+    memset(&config, 0, sizeof(config));
+    config.btb_sets = BTB_DEFAULT_SETS;
+    config.btb_ways = BTB_DEFAULT_WAYS;
+    config.btb_policy = BTB_REPLACE_LRU;
+    config.bpred_kind = BPRED_BTB;
+    config.ras_entries = RAS_DEFAULT_ENTRIES;
+    config.itp_entries = ITP_DEFAULT_ENTRIES;
+    for (i = 2; i < argc; ++i)
+    {
+        if (APEX_eval_option(&config, argv[i]) != 0)
+        {
+            exit(1);
+        }
+    }
+
+    if (APEX_btb_init(&btb, config.btb_sets, config.btb_ways, config.btb_policy) != 0)
+    {
+        exit(1);
+    }
+    if (APEX_bpred_init(&bp, config.bpred_kind, config.bpred_entries,
+                        config.bpred_history, &btb) != 0 ||
+        APEX_bpred_init_targets(&bp, config.ras_entries, config.itp_entries) != 0)
+    {
+        exit(1);
+    }
+
+    records = APEX_btrace_map(argv[1], &header, &map_size);
+    if (!records)
+    {
+        exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0, r = records; i < header.records; ++i, ++r)
+    {
+        if (r->opcode == OPCODE_JUMP || r->opcode == OPCODE_JALR)
+        {
+            APEX_eval_jump(&bp, r);
+        }
+        else
+        {
+            APEX_eval_branch(&btb, &bp, r);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    /* Wrong-path fetches of branches plus jumps fetched at a wrong target */
+    misses = bp.stats.mispredicts + bp.target_stats.jumps - bp.target_stats.correct;
+    printf("APEX_EVAL: %s, records = %lld instructions = %lld\n", argv[1],
+           header.records, header.instructions);
+    APEX_btb_report(&btb, stdout);
+    APEX_bpred_report(&bp, 0, 0, stdout);
+    APEX_bpred_report_targets(&bp, stdout);
+    printf("APEX_EVAL: accuracy = %.2f%% MPKI = %.3f, %.1f million records/s\n",
+           header.records ? 100.0 * (header.records - misses) / header.records : 0.0,
+           header.instructions ? 1000.0 * misses / header.instructions : 0.0,
+           seconds > 0 ? header.records / seconds / 1e6 : 0.0);
+
+    APEX_btrace_unmap(records, map_size);
+    APEX_bpred_free(&bp);
+    APEX_btb_free(&btb);
+    return 0;
+}
@@ -0,0 +1,961 @@
+/*
+ * apex_bpred.c
+ * Contains the branch direction predictors: the 2-bit state in the BTB,
+ * bimodal, gshare, tournament, TAGE-lite and perceptron, and the return
+ * address stack and indirect target predictor for register jumps
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_bpred.h"
+
+#define TAGE_TAG_BITS 9
+#define TAGE_NO_TAG 0xFFFF         /* Never matches a 9-bit tag */
+#define TAGE_AGE_PERIOD 0x3FFFF    /* Updates between halving the useful bits */
+
+/* Fixed part of a saved predictor, followed by the in-flight branches, the
+ * tables, the return address stack and the indirect target predictor */
+typedef struct APEX_BPredState
+{
+    int kind;
+    int entries;
+    int history_bits;
+    int inflight_cursor;
+    unsigned long long history;
+    unsigned int tage_clock;
+    APEX_BPredStats stats;
+    int ras_entries;
+    int ras_top;
+    int ras_count;
+    unsigned int link_mask;
+    int itp_entries;
+    APEX_TargetStats target_stats;
+} APEX_BPredState;
+
+static unsigned int
+pc_word(int pc)
+{
+    return (unsigned int)pc >> 2;
+}
+
+/* XOR of the newest length bits of history taken bits at a time */
+static unsigned int
+fold_history(unsigned long long history, int length, int bits)
+{
+    unsigned int folded = 0;
+
+    if (length < 64)
+    {
+        history &= (1ULL << length) - 1;
+    }
+    while (history)
+    {
+        folded ^= history & ((1ULL << bits) - 1);
+        history >>= bits;
+    }
+    return folded;
+}
+
+static int
+counter_taken(unsigned char counter)
+{
+    return counter >= 2;
+}
+
+/* Saturating update without branches, the outcomes are too random for the
+ * host's own predictor */
+static void
+counter_train(unsigned char *counter, int taken)
+{
+    taken = taken != 0;
+    *counter += (taken & (*counter < 3)) - (!taken & (*counter > 0));
+}
+
+/* Shifts a direction into the speculative global history */
+static void
+history_push(APEX_BPred *bp, const APEX_BPredInfo *info, int taken)
+{
+    bp->history = (bp->history << 1) | (taken ? 1 : 0);
+}
+
+static void
+history_restore(APEX_BPred *bp, const APEX_BPredInfo *info)
+{
+    bp->history = info->history;
+}
+
+/*
+ * btb: the original 2-bit scheme. The state lives in the h_bits of the BTB
+ * entry, so a branch is only predicted taken on a BTB hit and its state is
+ * lost when the entry is replaced. Decode seeds a new entry from the opcode.
+ */
+static int
+btb_predict(APEX_BPred *bp, APEX_BPredInfo *info)
+{
+    if (info->btb_index < 0)
+    {
+        return FALSE;
+    }
+    return bp->btb->entries[info->btb_index].h_bits[0] == 1;
+}
+
+/*
+ * Next h_bits state, indexed by h_bits[0] * 2 + h_bits[1] and the outcome.
+ * 11 and 10 predict taken, a taken 01 goes straight to 10 and a not taken
+ * 10 drops to 01.
+ */
+static const unsigned char btb_next_state[4][2] = {
+    {0, 1}, /* 00 */
+    {0, 2}, /* 01 */
+    {1, 3}, /* 10 */
+    {2, 3}, /* 11 */
+};
+
+static void
+btb_update(APEX_BPred *bp, const APEX_BPredInfo *info, int a_taken)
+{
+    BTBentry *entry;
+    int state;
+
+    if (info->btb_index < 0)
+    {
+        return;
+    }
+    entry = &bp->btb->entries[info->btb_index];
+    state = (entry->h_bits[0] & 1) * 2 + (entry->h_bits[1] & 1);
+    state = btb_next_state[state][a_taken != 0];
+    entry->h_bits[0] = state >> 1;
+    entry->h_bits[1] = state & 1;
+}
+
+/* bimodal: a 2-bit counter per branch address */
+static int
+bimodal_predict(APEX_BPred *bp, APEX_BPredInfo *info)
+{
+    info->index[0] = pc_word(info->pc) & (bp->entries - 1);
+    return counter_taken(bp->counters[info->index[0]]);
+}
+
+static void
+bimodal_update(APEX_BPred *bp, const APEX_BPredInfo *info, int taken)
+{
+    counter_train(&bp->counters[info->index[0]], taken);
+}
+
+/* gshare: a 2-bit counter per branch address XOR global history */
+static int
+gshare_index(const APEX_BPred *bp, const APEX_BPredInfo *info)
+{
+    return (pc_word(info->pc) ^
+            fold_history(info->history, bp->history_bits, bp->index_bits)) &
+           (bp->entries - 1);
+}
+
+static int
+gshare_predict(APEX_BPred *bp, APEX_BPredInfo *info)
+{
+    info->index[0] = gshare_index(bp, info);
+    return counter_taken(bp->counters[info->index[0]]);
+}
+
+/*
+ * tournament: bimodal and gshare side by side, counters[0 .. entries-1]
+ * bimodal, then gshare, then a per-branch chooser counting towards gshare
+ */
+static int
+tournament_predict(APEX_BPred *bp, APEX_BPredInfo *info)
+{
+    int row = pc_word(info->pc) & (bp->entries - 1);
+
+    info->index[0] = row;
+    info->index[1] = bp->entries + gshare_index(bp, info);
+    info->index[2] = 2 * bp->entries + row;
+    info->component[0] = counter_taken(bp->counters[info->index[0]]);
+    info->component[1] = counter_taken(bp->counters[info->index[1]]);
+    return info->component[counter_taken(bp->counters[info->index[2]])];
+}
+
+static void
+tournament_update(APEX_BPred *bp, const APEX_BPredInfo *info, int taken)
+{
+    if (info->component[0] != info->component[1])
+    {
+        counter_train(&bp->counters[info->index[2]], info->component[1] == taken);
+    }
+    counter_train(&bp->counters[info->index[0]], taken);
+    counter_train(&bp->counters[info->index[1]], taken);
+}
+
+/*
+ * TAGE-lite: a bimodal base plus BPRED_TAGE_TABLES tagged tables indexed
+ * with geometrically longer history. The longest matching table provides
+ * the prediction, a misprediction allocates in a longer table.
+ */
+static APEX_TageEntry *
+tage_entry(const APEX_BPred *bp, const APEX_BPredInfo *info, int table)
+{
+    return &bp->tagged[table * bp->entries + info->index[table]];
+}
+
+static int
+tage_predict(APEX_BPred *bp, APEX_BPredInfo *info)
+{
+    unsigned int word = pc_word(info->pc);
+    int base_taken;
+    int alt = -1;
+    int length;
+    int t;
+
+    info->index[BPRED_TAGE_TABLES] = word & (bp->entries - 1);
+    base_taken = counter_taken(bp->counters[info->index[BPRED_TAGE_TABLES]]);
+    info->provider = -1;
+
+    for (t = BPRED_TAGE_TABLES - 1; t >= 0; --t)
+    {
+        length = bp->lengths[t];
+        info->index[t] = (word ^ (word >> (t + 1)) ^
+                          fold_history(info->history, length, bp->index_bits)) &
+                         (bp->entries - 1);
+        info->tag[t] = (word ^ fold_history(info->history, length, TAGE_TAG_BITS) ^
+                        (fold_history(info->history, length, TAGE_TAG_BITS - 1) << 1)) &
+                       ((1 << TAGE_TAG_BITS) - 1);
+
+        if (tage_entry(bp, info, t)->tag != info->tag[t])
+        {
+            continue;
+        }
+        if (info->provider < 0)
+        {
+            info->provider = t;
+        }
+        else if (alt < 0)
+        {
+            alt = t;
+        }
+    }
+
+    info->alt_taken = alt >= 0 ? tage_entry(bp, info, alt)->ctr >= 0 : base_taken;
+    if (info->provider < 0)
+    {
+        return base_taken;
+    }
+    return tage_entry(bp, info, info->provider)->ctr >= 0;
+}
+
+static void
+tage_update(APEX_BPred *bp, const APEX_BPredInfo *info, int taken)
+{
+    APEX_TageEntry *entry;
+    int allocated = FALSE;
+    int i;
+    int t;
+
+    if (info->provider >= 0)
+    {
+        entry = tage_entry(bp, info, info->provider);
+        if (info->taken != info->alt_taken)
+        {
+            if (info->taken == taken && entry->useful < 3)
+            {
+                entry->useful++;
+            }
+            else if (info->taken != taken && entry->useful > 0)
+            {
+                entry->useful--;
+            }
+        }
+        if (taken && entry->ctr < 3)
+        {
+            entry->ctr++;
+        }
+        else if (!taken && entry->ctr > -4)
+        {
+            entry->ctr--;
+        }
+    }
+    else
+    {
+        counter_train(&bp->counters[info->index[BPRED_TAGE_TABLES]], taken);
+    }
+
+    if (info->taken != taken)
+    {
+        /* Claim the first unused entry of a longer history table, or age
+         * the candidates so one frees up next time */
+        for (t = info->provider + 1; t < BPRED_TAGE_TABLES && !allocated; ++t)
+        {
+            entry = tage_entry(bp, info, t);
+            if (entry->useful == 0)
+            {
+                entry->tag = info->tag[t];
+                entry->ctr = taken ? 0 : -1;
+                allocated = TRUE;
+            }
+        }
+        for (t = info->provider + 1; t < BPRED_TAGE_TABLES && !allocated; ++t)
+        {
+            entry = tage_entry(bp, info, t);
+            if (entry->useful > 0)
+            {
+                entry->useful--;
+            }
+        }
+    }
+
+    if ((++bp->tage_clock & TAGE_AGE_PERIOD) == 0)
+    {
+        for (i = 0; i < BPRED_TAGE_TABLES * bp->entries; ++i)
+        {
+            bp->tagged[i].useful >>= 1;
+        }
+    }
+}
+
+/*
+ * perceptron: one weight per history bit plus a bias for each row, the
+ * prediction is the sign of their dot product with the history as +1/-1
+ */
+static int
+perceptron_predict(APEX_BPred *bp, APEX_BPredInfo *info)
+{
+    const signed char *weights;
+    int output;
+    int i;
+
+    info->index[0] = pc_word(info->pc) & (bp->entries - 1);
+    weights = bp->weights + info->index[0] * (bp->history_bits + 1);
+    output = weights[0];
+    for (i = 0; i < bp->history_bits; ++i)
+    {
+        output += (info->history >> i) & 1 ? weights[i + 1] : -weights[i + 1];
+    }
+    info->output = output;
+    return output >= 0;
+}
+
+static void
+weight_train(signed char *weight, int step)
+{
+    if (*weight + step <= 127 && *weight + step >= -128)
+    {
+        *weight += step;
+    }
+}
+
+static void
+perceptron_update(APEX_BPred *bp, const APEX_BPredInfo *info, int taken)
+{
+    signed char *weights = bp->weights + info->index[0] * (bp->history_bits + 1);
+    int step = taken ? 1 : -1;
+    int i;
+
+    if (info->taken == taken && abs(info->output) > bp->theta)
+    {
+        return;
+    }
+
+    weight_train(&weights[0], step);
+    for (i = 0; i < bp->history_bits; ++i)
+    {
+        weight_train(&weights[i + 1], (info->history >> i) & 1 ? step : -step);
+    }
+}
+
+static const APEX_BPredOps bpred_ops[] = {
+    [BPRED_BTB] = {"btb", btb_predict, btb_update, NULL, NULL},
+    [BPRED_BIMODAL] = {"bimodal", bimodal_predict, bimodal_update, NULL, NULL},
+    [BPRED_GSHARE] = {"gshare", gshare_predict, bimodal_update, history_push,
+                      history_restore},
+    [BPRED_TOURNAMENT] = {"tournament", tournament_predict, tournament_update,
+                          history_push, history_restore},
+    [BPRED_TAGE] = {"tage", tage_predict, tage_update, history_push, history_restore},
+    [BPRED_PERCEPTRON] = {"perceptron", perceptron_predict, perceptron_update,
+                          history_push, history_restore},
+};
+
+#define BPRED_KINDS ((int)(sizeof(bpred_ops) / sizeof(bpred_ops[0])))
+
+/* Table sizes of a predictor, in elements */
+static int
+bpred_counter_count(const APEX_BPred *bp)
+{
+    switch (bp->kind)
+    {
+        case BPRED_BIMODAL:
+        case BPRED_GSHARE:
+        case BPRED_TAGE:
+            return bp->entries;
+
+        case BPRED_TOURNAMENT:
+            return 3 * bp->entries;
+    }
+    return 0;
+}
+
+static int
+bpred_tagged_count(const APEX_BPred *bp)
+{
+    return bp->kind == BPRED_TAGE ? BPRED_TAGE_TABLES * bp->entries : 0;
+}
+
+static int
+bpred_weight_count(const APEX_BPred *bp)
+{
+    return bp->kind == BPRED_PERCEPTRON ? bp->entries * (bp->history_bits + 1) : 0;
+}
+
+/*
+ * Sets up a predictor of the given kind with entries rows per table and
+ * history_bits of global history, 0 picks the default for either. The btb
+ * kind keeps its state in the entries of btb. Returns 0 on success and -1
+ * on a bad size or when memory runs out.
+ */
+int
+APEX_bpred_init(APEX_BPred *bp, int kind, int entries, int history_bits,
+                APEX_BTB *btb)
+{
+    int i;
+
+    memset(bp, 0, sizeof(*bp));
+    if (kind < 0 || kind >= BPRED_KINDS)
+    {
+        fprintf(stderr, "APEX_Error: Unknown branch predictor %d\n", kind);
+        return -1;
+    }
+
+    if (!entries)
+    {
+        entries = BPRED_DEFAULT_ENTRIES;
+    }
+    if (entries < 16 || entries > (1 << 24) || (entries & (entries - 1)))
+    {
+        fprintf(stderr, "APEX_Error: Predictor entries must be a power of two from 16\n");
+        return -1;
+    }
+
+    bp->kind = kind;
+    bp->ops = &bpred_ops[kind];
+    bp->entries = entries;
+    bp->btb = btb;
+    while ((1 << bp->index_bits) < entries)
+    {
+        bp->index_bits++;
+    }
+
+    if (!history_bits)
+    {
+        history_bits = kind == BPRED_TAGE ? 32 : kind == BPRED_PERCEPTRON ? 24 : bp->index_bits;
+    }
+    if (history_bits < BPRED_TAGE_TABLES || history_bits > 64)
+    {
+        fprintf(stderr, "APEX_Error: Predictor history must be %d to 64 bits\n",
+                BPRED_TAGE_TABLES);
+        return -1;
+    }
+    bp->history_bits = history_bits;
+
+    /* TAGE lengths double up to the full history, perceptrons train until
+     * the output clears 1.93 * history + 14 */
+    for (i = 0; i < BPRED_TAGE_TABLES; ++i)
+    {
+        bp->lengths[i] = history_bits >> (BPRED_TAGE_TABLES - 1 - i);
+    }
+    bp->theta = (193 * history_bits) / 100 + 14;
+
+    if (bpred_counter_count(bp))
+    {
+        bp->counters = malloc(bpred_counter_count(bp));
+    }
+    if (bpred_tagged_count(bp))
+    {
+        bp->tagged = malloc(bpred_tagged_count(bp) * sizeof(APEX_TageEntry));
+    }
+    if (bpred_weight_count(bp))
+    {
+        bp->weights = calloc(bpred_weight_count(bp), 1);
+    }
+    if ((bpred_counter_count(bp) && !bp->counters) ||
+        (bpred_tagged_count(bp) && !bp->tagged) ||
+        (bpred_weight_count(bp) && !bp->weights))
+    {
+        APEX_bpred_free(bp);
+        return -1;
+    }
+
+    /* Counters start weakly taken, the chooser weakly towards gshare */
+    if (bp->counters)
+    {
+        memset(bp->counters, 2, bpred_counter_count(bp));
+    }
+    for (i = 0; i < bpred_tagged_count(bp); ++i)
+    {
+        bp->tagged[i].tag = TAGE_NO_TAG;
+        bp->tagged[i].ctr = 0;
+        bp->tagged[i].useful = 0;
+    }
+    return 0;
+}
+
+/*
+ * Adds a return address stack of ras_entries and an indirect target
+ * predictor of itp_entries rows to an initialized predictor, 0 leaves either
+ * out. Returns 0 on success and -1 on a bad size or when memory runs out.
+ */
+int
+APEX_bpred_init_targets(APEX_BPred *bp, int ras_entries, int itp_entries)
+{
+    int i;
+
+    if (ras_entries < 0 || ras_entries > 4096)
+    {
+        fprintf(stderr, "APEX_Error: Return address stack must have 0 to 4096 entries\n");
+        return -1;
+    }
+    if (itp_entries < 0 || itp_entries > (1 << 24) || (itp_entries & (itp_entries - 1)))
+    {
+        fprintf(stderr, "APEX_Error: Indirect target predictor entries must be 0 "
+                "or a power of two\n");
+        return -1;
+    }
+
+    bp->ras_entries = ras_entries;
+    bp->itp_entries = itp_entries;
+    if (ras_entries)
+    {
+        bp->ras = calloc(ras_entries, sizeof(int));
+    }
+    if (itp_entries)
+    {
+        bp->itp_tag = malloc(itp_entries * sizeof(int));
+        bp->itp_target = calloc(itp_entries, sizeof(int));
+    }
+    if ((ras_entries && !bp->ras) || (itp_entries && (!bp->itp_tag || !bp->itp_target)))
+    {
+        return -1;
+    }
+
+    for (i = 0; i < itp_entries; ++i)
+    {
+        bp->itp_tag[i] = -1;
+    }
+    return 0;
+}
+
+void
+APEX_bpred_free(APEX_BPred *bp)
+{
+    free(bp->counters);
+    free(bp->tagged);
+    free(bp->weights);
+    free(bp->ras);
+    free(bp->itp_tag);
+    free(bp->itp_target);
+    memset(bp, 0, sizeof(*bp));
+}
+
+/*
+ * Starts tracking a fetched conditional branch or register jump and
+ * snapshots the global history and the return address stack before it.
+ * Returns its record, with the handle the pipeline keeps in the latch in
+ * *slot.
+ */
+APEX_BPredInfo *
+APEX_bpred_begin(APEX_BPred *bp, int pc, int btb_index, int *slot)
+{
+    APEX_BPredInfo *info;
+
+    bp->inflight_cursor = (bp->inflight_cursor + 1) & (APEX_BPRED_INFLIGHT - 1);
+    *slot = bp->inflight_cursor;
+    info = &bp->inflight[*slot];
+    info->pc = pc;
+    info->btb_index = btb_index;
+    info->history = bp->history;
+    info->ras_top = bp->ras_top;
+    info->ras_count = bp->ras_count;
+    info->ras_value = bp->ras_entries ? bp->ras[bp->ras_top] : 0;
+    info->call = FALSE;
+    info->target = -1;
+    info->target_source = TARGET_NONE;
+    return info;
+}
+
+APEX_BPredInfo *
+APEX_bpred_info(APEX_BPred *bp, int slot)
+{
+    return &bp->inflight[slot & (APEX_BPRED_INFLIGHT - 1)];
+}
+
+/* Predicts the direction of the branch, returns TRUE for taken */
+int
+APEX_bpred_predict(APEX_BPred *bp, APEX_BPredInfo *info)
+{
+    info->taken = bp->ops->predict(bp, info);
+    return info->taken;
+}
+
+/* Records the direction the branch was fetched down */
+void
+APEX_bpred_spec_update(APEX_BPred *bp, const APEX_BPredInfo *info, int taken)
+{
+    if (bp->ops->spec_update)
+    {
+        bp->ops->spec_update(bp, info, taken);
+    }
+}
+
+/*
+ * Trains the predictor with the resolved direction of the branch and counts
+ * it. mispredicted tells whether fetch went down the wrong path, which also
+ * happens on a correct taken prediction without a BTB target.
+ */
+void
+APEX_bpred_update(APEX_BPred *bp, const APEX_BPredInfo *info, int taken,
+                  int mispredicted)
+{
+    bp->stats.branches++;
+    if (mispredicted)
+    {
+        bp->stats.mispredicts++;
+    }
+    if (info->taken != taken)
+    {
+        bp->stats.direction_mispredicts++;
+    }
+    bp->ops->update(bp, info, taken);
+}
+
+/* Undoes the speculative updates of the branch and everything after it */
+void
+APEX_bpred_recover(APEX_BPred *bp, const APEX_BPredInfo *info)
+{
+    if (bp->ops->recover)
+    {
+        bp->ops->recover(bp, info);
+    }
+    if (bp->ras_entries)
+    {
+        bp->ras_top = info->ras_top;
+        bp->ras_count = info->ras_count;
+        bp->ras[bp->ras_top] = info->ras_value;
+    }
+}
+
+static void
+ras_push(APEX_BPred *bp, int address)
+{
+    if (!bp->ras_entries)
+    {
+        return;
+    }
+    bp->ras_top = (bp->ras_top + 1) % bp->ras_entries;
+    bp->ras[bp->ras_top] = address;
+    if (bp->ras_count < bp->ras_entries)
+    {
+        bp->ras_count++;
+    }
+    else
+    {
+        bp->target_stats.ras_overflows++;
+    }
+}
+
+/* Returns the newest return address, -1 if the stack is empty */
+static int
+ras_pop(APEX_BPred *bp)
+{
+    int address;
+
+    if (!bp->ras_count)
+    {
+        return -1;
+    }
+    address = bp->ras[bp->ras_top];
+    bp->ras_top = (bp->ras_top + bp->ras_entries - 1) % bp->ras_entries;
+    bp->ras_count--;
+    return address;
+}
+
+/* Looks the jump up in the indirect target predictor, -1 on a miss */
+static int
+itp_predict(APEX_BPred *bp, APEX_BPredInfo *info)
+{
+    if (!bp->itp_entries)
+    {
+        return -1;
+    }
+    info->itp_index = (pc_word(info->pc) ^
+                       fold_history(info->history, bp->history_bits, bp->index_bits)) &
+                      (bp->itp_entries - 1);
+    if (bp->itp_tag[info->itp_index] != info->pc)
+    {
+        return -1;
+    }
+    info->target_source = TARGET_ITP;
+    return bp->itp_target[info->itp_index];
+}
+
+/*
+ * Predicts the target of a JALR at fetch and pushes its return address.
+ * Returns the target, -1 if there is none.
+ */
+int
+APEX_bpred_predict_call(APEX_BPred *bp, APEX_BPredInfo *info, int rd)
+{
+    info->call = TRUE;
+    info->target = itp_predict(bp, info);
+    ras_push(bp, info->pc + 4);
+    bp->link_mask |= 1u << rd;
+    return info->target;
+}
+
+/*
+ * Predicts the target of a JUMP to rs1 + imm at fetch, popping the return
+ * address stack if rs1 has held a return address. Returns the target, -1
+ * if there is none.
+ */
+int
+APEX_bpred_predict_jump(APEX_BPred *bp, APEX_BPredInfo *info, int rs1, int imm)
+{
+    int address;
+
+    if (bp->ras_entries && (bp->link_mask & (1u << rs1)))
+    {
+        address = ras_pop(bp);
+        if (address >= 0)
+        {
+            info->target_source = TARGET_RAS;
+            info->target = address + imm;
+            return info->target;
+        }
+        bp->target_stats.ras_underflows++;
+    }
+    info->target = itp_predict(bp, info);
+    return info->target;
+}
+
+/*
+ * Trains the indirect target predictor with the resolved target of a
+ * register jump and counts it. When fetch went to the wrong target the
+ * stack is rolled back to the jump and the jump's own push or pop is redone.
+ */
+void
+APEX_bpred_resolve_target(APEX_BPred *bp, const APEX_BPredInfo *info, int target,
+                          int mispredicted)
+{
+    int row;
+
+    bp->target_stats.jumps++;
+    if (info->target >= 0)
+    {
+        bp->target_stats.predicted++;
+    }
+    if (!mispredicted)
+    {
+        bp->target_stats.correct++;
+        if (info->target_source == TARGET_RAS)
+        {
+            bp->target_stats.ras_hits++;
+        }
+        else
+        {
+            bp->target_stats.itp_hits++;
+        }
+    }
+
+    /* Returns the stack predicted right need no row of their own */
+    if (bp->itp_entries && (mispredicted || info->target_source != TARGET_RAS))
+    {
+        row = (pc_word(info->pc) ^
+               fold_history(info->history, bp->history_bits, bp->index_bits)) &
+              (bp->itp_entries - 1);
+        bp->itp_tag[row] = info->pc;
+        bp->itp_target[row] = target;
+    }
+
+    if (mispredicted)
+    {
+        APEX_bpred_recover(bp, info);
+        if (info->call)
+        {
+            ras_push(bp, info->pc + 4);
+        }
+        else if (info->target_source == TARGET_RAS)
+        {
+            ras_pop(bp);
+        }
+    }
+}
+
+/*
+ * Prints the predictor configuration, its misprediction rates and the CPI
+ * of the run, leaving out the CPI when no cycles were simulated
+ */
+void
+APEX_bpred_report(const APEX_BPred *bp, int cycles, int instructions, FILE *out)
+{
+    const APEX_BPredStats *stats = &bp->stats;
+
+    if (bp->kind == BPRED_BTB)
+    {
+        fprintf(out, "APEX_CPU: Predictor btb (2-bit state per BTB entry)");
+    }
+    else
+    {
+        fprintf(out, "APEX_CPU: Predictor %s (%d entries, %d history bits)",
+                bp->ops->name, bp->entries, bp->history_bits);
+    }
+    fprintf(out, ", branches = %lld mispredicts = %lld (%.2f%%) direction "
+            "mispredicts = %lld (%.2f%%)",
+            stats->branches, stats->mispredicts,
+            stats->branches ? 100.0 * stats->mispredicts / stats->branches : 0.0,
+            stats->direction_mispredicts,
+            stats->branches ? 100.0 * stats->direction_mispredicts / stats->branches : 0.0);
+    if (cycles)
+    {
+        fprintf(out, " CPI = %.3f", instructions ? (double)cycles / instructions : 0.0);
+    }
+    fprintf(out, "\n");
+}
+
+/*
+ * Prints how the register jumps were predicted and the fetch cycles the
+ * correct targets saved over redirecting from execute
+ */
+void
+APEX_bpred_report_targets(const APEX_BPred *bp, FILE *out)
+{
+    const APEX_TargetStats *stats = &bp->target_stats;
+
+    fprintf(out, "APEX_CPU: Targets RAS %d entries, ITP %d entries, jumps = %lld "
+            "predicted = %lld correct = %lld (%.2f%%) ras hits = %lld itp hits = %lld "
+            "ras overflows = %lld ras underflows = %lld cycles recovered = %lld\n",
+            bp->ras_entries, bp->itp_entries, stats->jumps, stats->predicted,
+            stats->correct, stats->jumps ? 100.0 * stats->correct / stats->jumps : 0.0,
+            stats->ras_hits, stats->itp_hits, stats->ras_overflows,
+            stats->ras_underflows, stats->correct * TARGET_REDIRECT_PENALTY);
+}
+
+/*
+ * Maps the value of a --bpred=<kind> option to a BPRED_* kind, returns -1
+ * if the kind is unknown
+ */
+int
+APEX_bpred_parse_kind(const char *name)
+{
+    int i;
+
+    for (i = 0; i < BPRED_KINDS; ++i)
+    {
+        if (strcmp(name, bpred_ops[i].name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *
+APEX_bpred_kind_name(int kind)
+{
+    return bpred_ops[kind].name;
+}
+
+/*
+ * Appends the complete predictor state to a checkpoint, returns 0 on
+ * success and -1 on failure
+ */
+int
+APEX_bpred_save(const APEX_BPred *bp, FILE *fp)
+{
+    APEX_BPredState state;
+    size_t counters = bpred_counter_count(bp);
+    size_t tagged = bpred_tagged_count(bp);
+    size_t weights = bpred_weight_count(bp);
+
+    memset(&state, 0, sizeof(state));
+    state.kind = bp->kind;
+    state.entries = bp->entries;
+    state.history_bits = bp->history_bits;
+    state.inflight_cursor = bp->inflight_cursor;
+    state.history = bp->history;
+    state.tage_clock = bp->tage_clock;
+    state.stats = bp->stats;
+    state.ras_entries = bp->ras_entries;
+    state.ras_top = bp->ras_top;
+    state.ras_count = bp->ras_count;
+    state.link_mask = bp->link_mask;
+    state.itp_entries = bp->itp_entries;
+    state.target_stats = bp->target_stats;
+
+    if (fwrite(&state, sizeof(state), 1, fp) != 1 ||
+        fwrite(bp->inflight, sizeof(bp->inflight), 1, fp) != 1 ||
+        fwrite(bp->counters, 1, counters, fp) != counters ||
+        fwrite(bp->tagged, sizeof(APEX_TageEntry), tagged, fp) != tagged ||
+        fwrite(bp->weights, 1, weights, fp) != weights ||
+        fwrite(bp->ras, sizeof(int), bp->ras_entries, fp) != (size_t)bp->ras_entries ||
+        fwrite(bp->itp_tag, sizeof(int), bp->itp_entries, fp) != (size_t)bp->itp_entries ||
+        fwrite(bp->itp_target, sizeof(int), bp->itp_entries, fp) != (size_t)bp->itp_entries)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Checks that data holds predictor state saved by APEX_bpred_save from a
+ * predictor configured like bp, returns its length or -1
+ */
+long
+APEX_bpred_check(const APEX_BPred *bp, const void *data, long size)
+{
+    const APEX_BPredState *state = data;
+    long length = sizeof(APEX_BPredState) + sizeof(bp->inflight) +
+                  bpred_counter_count(bp) +
+                  bpred_tagged_count(bp) * (long)sizeof(APEX_TageEntry) +
+                  bpred_weight_count(bp) +
+                  (bp->ras_entries + 2L * bp->itp_entries) * (long)sizeof(int);
+
+    if (size < length || state->kind != bp->kind || state->entries != bp->entries ||
+        state->history_bits != bp->history_bits || state->ras_entries != bp->ras_entries ||
+        state->itp_entries != bp->itp_entries || state->ras_count < 0 ||
+        state->ras_count > bp->ras_entries)
+    {
+        return -1;
+    }
+    return length;
+}
+
+/* Loads predictor state that passed APEX_bpred_check */
+void
+APEX_bpred_load(APEX_BPred *bp, const void *data)
+{
+    const APEX_BPredState *state = data;
+    const char *tables = (const char *)data + sizeof(APEX_BPredState);
+
+    bp->inflight_cursor = state->inflight_cursor & (APEX_BPRED_INFLIGHT - 1);
+    bp->history = state->history;
+    bp->tage_clock = state->tage_clock;
+    bp->stats = state->stats;
+    bp->ras_top = bp->ras_entries ? (unsigned int)state->ras_top % bp->ras_entries : 0;
+    bp->ras_count = state->ras_count;
+    bp->link_mask = state->link_mask;
+    bp->target_stats = state->target_stats;
+    memcpy(bp->inflight, tables, sizeof(bp->inflight));
+    tables += sizeof(bp->inflight);
+    memcpy(bp->counters, tables, bpred_counter_count(bp));
+    tables += bpred_counter_count(bp);
+    memcpy(bp->tagged, tables, bpred_tagged_count(bp) * sizeof(APEX_TageEntry));
+    tables += bpred_tagged_count(bp) * sizeof(APEX_TageEntry);
+    memcpy(bp->weights, tables, bpred_weight_count(bp));
+    tables += bpred_weight_count(bp);
+    memcpy(bp->ras, tables, bp->ras_entries * sizeof(int));
+    tables += bp->ras_entries * sizeof(int);
+    memcpy(bp->itp_tag, tables, bp->itp_entries * sizeof(int));
+    tables += bp->itp_entries * sizeof(int);
+    memcpy(bp->itp_target, tables, bp->itp_entries * sizeof(int));
+}
@@ -0,0 +1,55 @@
+/*
+ * apex_btrace.h
+ * Contains the branch stream written by the pipeline and read back by the
+ * predictor evaluator
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_BTRACE_H_
+#define _APEX_BTRACE_H_
+
+#include <stdio.h>
+
+/* Start of a branch stream. records and instructions are filled in when
+ * the stream is closed. */
+typedef struct APEX_BranchTraceHeader
+{
+    unsigned int magic;            /* APEX_BTRACE_MAGIC */
+    unsigned int version;          /* APEX_BTRACE_VERSION */
+    long long records;
+    long long instructions;        /* Retired while the stream was open */
+} APEX_BranchTraceHeader;
+
+/* One resolved conditional branch, JUMP or JALR, in execute order */
+typedef struct APEX_BranchRecord
+{
+    int pc;
+    int target;                    /* pc + imm for a branch, rs1 + imm for a jump */
+    int imm;
+    unsigned char opcode;
+    unsigned char taken;
+    unsigned char reg;             /* Link register: rd of a JALR, rs1 of a JUMP */
+    unsigned char pad;
+} APEX_BranchRecord;
+
+/* Stream being written, records are buffered and written in blocks */
+typedef struct APEX_BranchTrace
+{
+    FILE *fp;                      /* NULL when no stream is written */
+    APEX_BranchRecord *buffer;
+    int buffered;
+    long long records;
+    int insn_base;                 /* Retired count when the stream started */
+} APEX_BranchTrace;
+
+int APEX_btrace_open(APEX_BranchTrace *bt, const char *filename);
+void APEX_btrace_write(APEX_BranchTrace *bt, const APEX_BranchRecord *record);
+int APEX_btrace_close(APEX_BranchTrace *bt, int insn_completed);
+const APEX_BranchRecord *APEX_btrace_map(const char *filename,
+                                         APEX_BranchTraceHeader *header,
+                                         size_t *map_size);
+void APEX_btrace_unmap(const APEX_BranchRecord *records, size_t map_size);
+
+#endif
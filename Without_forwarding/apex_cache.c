@@ -0,0 +1,546 @@
+/*
+ * apex_cache.c
+ * Contains the cache hierarchy: set-associative tag arrays of one or two
+ * levels with their write and replacement policies, giving the latency of
+ * every access. It models the L1D and L2 data caches and the L1I.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cache.h"
+
+#define CACHE_EMPTY_TAG (-1)
+
+/* Fixed part of a saved level, followed by its tag, dirty and replacement
+ * arrays */
+typedef struct APEX_CacheState
+{
+    APEX_CacheConfig config;
+    int write_policy;
+    int policy;
+    unsigned int rng;
+    unsigned long long tick;
+    APEX_CacheStats stats;
+} APEX_CacheState;
+
+static const char *const cache_write_names[] = {
+    [CACHE_WRITE_BACK] = "wb",
+    [CACHE_WRITE_THROUGH] = "wt",
+};
+
+static int
+is_power_of_two(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+/*
+ * Applies the value of a --l1d, --l2 or --l1i=<size>:<ways>:<line>:<latency>
+ * option, returns 0 on success and -1 if the value is malformed
+ */
+int
+APEX_cache_parse(APEX_CacheConfig *config, const char *spec)
+{
+    APEX_CacheConfig level;
+
+    if (sscanf(spec, "%d:%d:%d:%d", &level.size, &level.ways, &level.line,
+               &level.latency) != 4)
+    {
+        fprintf(stderr, "APEX_Error: Cache levels are given as "
+                "<size>:<ways>:<line>:<latency>, not %s\n", spec);
+        return -1;
+    }
+    *config = level;
+    return 0;
+}
+
+/*
+ * Maps the value of a --cache-write=<policy> option to a CACHE_WRITE_*
+ * policy, returns -1 if the policy is unknown
+ */
+int
+APEX_cache_parse_write(const char *name)
+{
+    int i;
+
+    for (i = 0; i < (int)(sizeof(cache_write_names) / sizeof(cache_write_names[0])); ++i)
+    {
+        if (strcmp(name, cache_write_names[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Sets up the levels of the given configuration with empty lines, named
+ * after names in reports. The cache is off when the first level has no
+ * size, and the second is left out when it has none. Returns 0 on success
+ * and -1 if a level is invalid or memory runs out.
+ */
+int
+APEX_cache_init(APEX_Cache *cache, const char *const *names, const APEX_CacheConfig *config,
+                int write_policy, int policy, int memory_latency)
+{
+    APEX_CacheLevel *level;
+    int lines;
+    int i;
+    int j;
+
+    memset(cache, 0, sizeof(APEX_Cache));
+    cache->names = names;
+    cache->write_policy = write_policy;
+    cache->policy = policy;
+    cache->memory_latency = memory_latency;
+    if (config[0].size == 0)
+    {
+        if (config[1].size != 0)
+        {
+            fprintf(stderr, "APEX_Error: An %s cache needs an %s cache in front of it\n",
+                    names[1], names[0]);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (memory_latency < 1)
+    {
+        fprintf(stderr, "APEX_Error: The memory latency must be at least 1\n");
+        return -1;
+    }
+
+    for (i = 0; i < CACHE_LEVELS && config[i].size != 0; ++i)
+    {
+        level = &cache->levels[i];
+        level->config = config[i];
+        if (config[i].ways < 1 || !is_power_of_two(config[i].line) ||
+            config[i].size > (1 << 20) || config[i].latency < 1 ||
+            config[i].size % (config[i].ways * config[i].line) != 0 ||
+            !is_power_of_two(config[i].size / (config[i].ways * config[i].line)))
+        {
+            fprintf(stderr, "APEX_Error: The %s cache needs a power of two sets of "
+                    "<ways> lines of a power of two bytes, and a latency of at least 1\n",
+                    names[i]);
+            APEX_cache_free(cache);
+            return -1;
+        }
+
+        if (policy == BTB_REPLACE_PLRU && !is_power_of_two(config[i].ways))
+        {
+            fprintf(stderr, "APEX_Error: Tree PLRU needs a power of two %s ways\n",
+                    names[i]);
+            APEX_cache_free(cache);
+            return -1;
+        }
+
+        level->sets = config[i].size / (config[i].ways * config[i].line);
+        while ((1 << level->line_shift) < config[i].line)
+        {
+            level->line_shift++;
+        }
+        level->rng = 2463534242u;
+        lines = level->sets * config[i].ways;
+        level->tags = malloc(lines * sizeof(int));
+        level->dirty = calloc(lines, sizeof(unsigned char));
+        level->repl = calloc(lines, sizeof(unsigned long long));
+        cache->count = i + 1;
+        if (!level->tags || !level->dirty || !level->repl)
+        {
+            APEX_cache_free(cache);
+            return -1;
+        }
+        for (j = 0; j < lines; ++j)
+        {
+            level->tags[j] = CACHE_EMPTY_TAG;
+        }
+    }
+    return 0;
+}
+
+void
+APEX_cache_free(APEX_Cache *cache)
+{
+    int i;
+
+    for (i = 0; i < CACHE_LEVELS; ++i)
+    {
+        free(cache->levels[i].tags);
+        free(cache->levels[i].dirty);
+        free(cache->levels[i].repl);
+    }
+    memset(cache, 0, sizeof(APEX_Cache));
+}
+
+/* Marks a way of a set as just used */
+static void
+APEX_cache_touch(const APEX_Cache *cache, APEX_CacheLevel *level, int set, int way)
+{
+    unsigned long long *repl = level->repl + set * level->config.ways;
+    int node = 1;
+    int bit;
+    int half;
+
+    switch (cache->policy)
+    {
+        case BTB_REPLACE_LRU:
+        {
+            repl[way] = ++level->tick;
+            break;
+        }
+
+        case BTB_REPLACE_PLRU:
+        {
+            for (half = level->config.ways >> 1; half; half >>= 1)
+            {
+                bit = (way & half) != 0;
+                repl[node] = !bit;
+                node = 2 * node + bit;
+            }
+            break;
+        }
+    }
+}
+
+/* Picks the way of a full set to evict */
+static int
+APEX_cache_victim(const APEX_Cache *cache, APEX_CacheLevel *level, int set)
+{
+    const int ways = level->config.ways;
+    unsigned long long *repl = level->repl + set * ways;
+    int node = 1;
+    int way = 0;
+    int i;
+
+    switch (cache->policy)
+    {
+        case BTB_REPLACE_PLRU:
+        {
+            while (node < ways)
+            {
+                way = 2 * way + (int)repl[node];
+                node = 2 * node + (int)repl[node];
+            }
+            return way;
+        }
+
+        case BTB_REPLACE_RANDOM:
+        {
+            /* xorshift32 */
+            level->rng ^= level->rng << 13;
+            level->rng ^= level->rng >> 17;
+            level->rng ^= level->rng << 5;
+            return level->rng % ways;
+        }
+
+        case BTB_REPLACE_FIFO:
+        {
+            way = (int)repl[0];
+            repl[0] = (way + 1) % ways;
+            return way;
+        }
+
+        default:
+        {
+            for (i = 1; i < ways; ++i)
+            {
+                if (repl[i] < repl[way])
+                {
+                    way = i;
+                }
+            }
+            return way;
+        }
+    }
+}
+
+/* Way of the set holding tag, -1 if none does */
+static int
+APEX_cache_find(const APEX_CacheLevel *level, int set, int tag)
+{
+    const int *tags = level->tags + set * level->config.ways;
+    int way;
+
+    for (way = 0; way < level->config.ways; ++way)
+    {
+        if (tags[way] == tag)
+        {
+            return way;
+        }
+    }
+    return -1;
+}
+
+static int APEX_cache_level_access(APEX_Cache *cache, int index, int address, int write);
+
+/*
+ * Brings the line tag into level index, into an empty way or else in place
+ * of the victim the replacement policy picks. A dirty victim is written to
+ * the next level off the critical path.
+ */
+static void
+APEX_cache_fill(APEX_Cache *cache, int index, int tag, int dirty)
+{
+    APEX_CacheLevel *level = &cache->levels[index];
+    const int ways = level->config.ways;
+    const int set = tag & (level->sets - 1);
+    int way = APEX_cache_find(level, set, CACHE_EMPTY_TAG);
+    int slot;
+
+    if (way < 0)
+    {
+        way = APEX_cache_victim(cache, level, set);
+        slot = set * ways + way;
+        level->stats.evictions++;
+        if (level->dirty[slot])
+        {
+            level->stats.writebacks++;
+            APEX_cache_level_access(cache, index + 1,
+                                    (int)((unsigned int)level->tags[slot] << level->line_shift),
+                                    TRUE);
+        }
+    }
+    else if (cache->policy == BTB_REPLACE_FIFO)
+    {
+        /* Sets fill in way order, so the oldest way stays next */
+        level->repl[set * ways] = (way + 1) % ways;
+    }
+
+    slot = set * ways + way;
+    level->tags[slot] = tag;
+    level->dirty[slot] = dirty;
+    APEX_cache_touch(cache, level, set, way);
+}
+
+/*
+ * Reads or writes address at level index and below, returns the cycles it
+ * takes. A hit costs the latency of the level. A miss adds the time of the
+ * next level, or of data memory after the last, and then fills the line,
+ * except for a write-through store which goes on without allocating.
+ * A write-back store marks its line dirty.
+ */
+static int
+APEX_cache_level_access(APEX_Cache *cache, int index, int address, int write)
+{
+    APEX_CacheLevel *level;
+    int latency;
+    int ways;
+    int tag;
+    int set;
+    int way;
+
+    if (index == cache->count)
+    {
+        return cache->memory_latency;
+    }
+
+    level = &cache->levels[index];
+    latency = level->config.latency;
+    ways = level->config.ways;
+    tag = (int)((unsigned int)address >> level->line_shift);
+    set = tag & (level->sets - 1);
+    way = APEX_cache_find(level, set, tag);
+    if (write)
+    {
+        level->stats.writes++;
+    }
+    else
+    {
+        level->stats.reads++;
+    }
+
+    if (way >= 0)
+    {
+        level->stats.hits++;
+        APEX_cache_touch(cache, level, set, way);
+        if (write && cache->write_policy == CACHE_WRITE_THROUGH)
+        {
+            return latency + APEX_cache_level_access(cache, index + 1, address, TRUE);
+        }
+        level->dirty[set * ways + way] |= write;
+        return latency;
+    }
+
+    level->stats.misses++;
+    if (write && cache->write_policy == CACHE_WRITE_THROUGH)
+    {
+        return latency + APEX_cache_level_access(cache, index + 1, address, TRUE);
+    }
+    latency += APEX_cache_level_access(cache, index + 1, address, FALSE);
+    APEX_cache_fill(cache, index, tag, write);
+    return latency;
+}
+
+/*
+ * Accounts a read (write FALSE) or write of address in the hierarchy and
+ * returns the cycles it takes, counting from the first level
+ */
+int
+APEX_cache_access(APEX_Cache *cache, int address, int write)
+{
+    return APEX_cache_level_access(cache, 0, address, write);
+}
+
+/*
+ * Brings the line holding address into the first level ahead of its use,
+ * returns TRUE if it was not there yet. The prefetch is not an access, so
+ * it counts neither as a read nor towards the hit rate.
+ */
+int
+APEX_cache_prefetch(APEX_Cache *cache, int address)
+{
+    APEX_CacheLevel *level = &cache->levels[0];
+    const int tag = (int)((unsigned int)address >> level->line_shift);
+
+    if (APEX_cache_find(level, tag & (level->sets - 1), tag) >= 0)
+    {
+        return FALSE;
+    }
+    level->stats.prefetches++;
+    APEX_cache_fill(cache, 0, tag, FALSE);
+    return TRUE;
+}
+
+/* Prints the geometry and use of every level, and the cycles the named
+ * pipeline stage waited on them */
+void
+APEX_cache_report(const APEX_Cache *cache, const char *stage, long long stalls, FILE *out)
+{
+    const APEX_CacheLevel *level;
+    const APEX_CacheStats *stats;
+    long long accesses;
+    int i;
+
+    for (i = 0; i < cache->count; ++i)
+    {
+        level = &cache->levels[i];
+        stats = &level->stats;
+        accesses = stats->reads + stats->writes;
+        fprintf(out, "APEX_CPU: Cache %s %d bytes %d ways %d-byte lines %s latency %d, "
+                "reads = %lld writes = %lld hits = %lld (%.2f%%) misses = %lld "
+                "evictions = %lld writebacks = %lld", cache->names[i],
+                level->config.size, level->config.ways, level->config.line,
+                cache_write_names[cache->write_policy], level->config.latency,
+                stats->reads, stats->writes, stats->hits,
+                accesses ? 100.0 * stats->hits / accesses : 0.0, stats->misses,
+                stats->evictions, stats->writebacks);
+        if (stats->prefetches)
+        {
+            fprintf(out, " prefetches = %lld", stats->prefetches);
+        }
+        fprintf(out, "\n");
+    }
+    if (cache->count)
+    {
+        fprintf(out, "APEX_CPU: Memory latency %d, %s stage stalls = %lld\n",
+                cache->memory_latency, stage, stalls);
+    }
+}
+
+const char *
+APEX_cache_name(const APEX_Cache *cache, int level)
+{
+    return cache->names[level];
+}
+
+/*
+ * Appends the state of every modeled level to a checkpoint, returns 0 on
+ * success and -1 on failure
+ */
+int
+APEX_cache_save(const APEX_Cache *cache, FILE *fp)
+{
+    const APEX_CacheLevel *level;
+    APEX_CacheState state;
+    size_t lines;
+    int i;
+
+    for (i = 0; i < cache->count; ++i)
+    {
+        level = &cache->levels[i];
+        lines = level->sets * level->config.ways;
+        memset(&state, 0, sizeof(state));
+        state.config = level->config;
+        state.write_policy = cache->write_policy;
+        state.policy = cache->policy;
+        state.tick = level->tick;
+        state.rng = level->rng;
+        state.stats = level->stats;
+        if (fwrite(&state, sizeof(state), 1, fp) != 1 ||
+            fwrite(level->tags, sizeof(int), lines, fp) != lines ||
+            fwrite(level->dirty, sizeof(unsigned char), lines, fp) != lines ||
+            fwrite(level->repl, sizeof(unsigned long long), lines, fp) != lines)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Checks that data holds cache state saved by APEX_cache_save from a
+ * hierarchy of the same configuration, returns its length or -1
+ */
+long
+APEX_cache_check(const APEX_Cache *cache, const void *data, long size)
+{
+    const APEX_CacheLevel *level;
+    APEX_CacheState state;
+    long length = 0;
+    long lines;
+    int i;
+
+    for (i = 0; i < cache->count; ++i)
+    {
+        level = &cache->levels[i];
+        if (size - length < (long)sizeof(APEX_CacheState))
+        {
+            return -1;
+        }
+        /* The dirty bytes leave a level after the first unaligned */
+        memcpy(&state, (const char *)data + length, sizeof(state));
+        if (memcmp(&state.config, &level->config, sizeof(APEX_CacheConfig)) != 0 ||
+            state.write_policy != cache->write_policy || state.policy != cache->policy)
+        {
+            return -1;
+        }
+        lines = level->sets * (long)level->config.ways;
+        length += sizeof(APEX_CacheState) +
+                  lines * (long)(sizeof(int) + sizeof(unsigned char) +
+                                 sizeof(unsigned long long));
+    }
+    return size < length ? -1 : length;
+}
+
+/* Loads cache state that passed APEX_cache_check */
+void
+APEX_cache_load(APEX_Cache *cache, const void *data)
+{
+    const char *arrays = data;
+    APEX_CacheLevel *level;
+    APEX_CacheState state;
+    long lines;
+    int i;
+
+    for (i = 0; i < cache->count; ++i)
+    {
+        level = &cache->levels[i];
+        lines = level->sets * (long)level->config.ways;
+        memcpy(&state, arrays, sizeof(state));
+        level->tick = state.tick;
+        level->rng = state.rng;
+        level->stats = state.stats;
+        arrays += sizeof(APEX_CacheState);
+        memcpy(level->tags, arrays, lines * sizeof(int));
+        arrays += lines * sizeof(int);
+        memcpy(level->dirty, arrays, lines * sizeof(unsigned char));
+        arrays += lines * sizeof(unsigned char);
+        memcpy(level->repl, arrays, lines * sizeof(unsigned long long));
+        arrays += lines * sizeof(unsigned long long);
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ * apex_cache.h
+ * Contains the cache hierarchy declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_CACHE_H_
+#define _APEX_CACHE_H_
+
+#include <stdio.h>
+
+#include "apex_macros.h"
+
+/* Geometry and hit latency of one level, sizes in bytes of the address space
+ * it caches */
+typedef struct APEX_CacheConfig
+{
+    int size;                      /* 0 when the level is not modeled */
+    int ways;
+    int line;                      /* Bytes per line, a power of two */
+    int latency;                   /* Cycles of a hit */
+} APEX_CacheConfig;
+
+typedef struct APEX_CacheStats
+{
+    long long reads;
+    long long writes;
+    long long hits;
+    long long misses;
+    long long evictions;           /* Valid lines replaced by a fill */
+    long long writebacks;          /* Of those, dirty lines written to the next level */
+    long long prefetches;          /* Lines brought in ahead of their use */
+} APEX_CacheStats;
+
+/* One level of sets x ways lines. Only the tags are kept, the data itself
+ * stays in data memory, so the cache changes timing and never values. */
+typedef struct APEX_CacheLevel
+{
+    APEX_CacheConfig config;
+    int sets;                      /* Power of two */
+    int line_shift;                /* log2 of the line size */
+    int *tags;                     /* Line address of each way, -1 if empty */
+    unsigned char *dirty;
+    unsigned long long *repl;      /* Replacement state, as for the BTB */
+    unsigned long long tick;       /* LRU time stamp */
+    unsigned int rng;              /* Random replacement state */
+    APEX_CacheStats stats;
+} APEX_CacheLevel;
+
+/* Cache hierarchy in front of data or code memory, first level first */
+typedef struct APEX_Cache
+{
+    APEX_CacheLevel levels[CACHE_LEVELS];
+    const char *const *names;      /* Report name of each level */
+    int count;                     /* Levels modeled, 0 when the cache is off */
+    int write_policy;              /* One of CACHE_WRITE_* */
+    int policy;                    /* One of BTB_REPLACE_* */
+    int memory_latency;            /* Cycles memory takes after the last level */
+} APEX_Cache;
+
+int APEX_cache_parse(APEX_CacheConfig *config, const char *spec);
+int APEX_cache_parse_write(const char *name);
+int APEX_cache_init(APEX_Cache *cache, const char *const *names, const APEX_CacheConfig *config,
+                    int write_policy, int policy, int memory_latency);
+void APEX_cache_free(APEX_Cache *cache);
+int APEX_cache_access(APEX_Cache *cache, int address, int write);
+int APEX_cache_prefetch(APEX_Cache *cache, int address);
+void APEX_cache_report(const APEX_Cache *cache, const char *stage, long long stalls, FILE *out);
+const char *APEX_cache_name(const APEX_Cache *cache, int level);
+int APEX_cache_save(const APEX_Cache *cache, FILE *fp);
+long APEX_cache_check(const APEX_Cache *cache, const void *data, long size);
+void APEX_cache_load(APEX_Cache *cache, const void *data);
+
+#endif
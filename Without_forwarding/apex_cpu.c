@@ -9,26 +9,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "apex_cpu.h"
 #include "apex_macros.h"
 
-/* Converts the PC(4000 series) into array index for code memory
- *
- * Note: You are not supposed to edit this function
- */
-typedef struct Scoreboard
-{
-    int busy[16];
-}Scoreboard;
-
-static Scoreboard scoreboard;
-
-
-int stall_flag;
-int reached_halt;
-APEX_CPU *btb = NULL;
-
 static int 
 flag_check(int val, APEX_CPU*cpu)
 {
@@ -50,6 +38,10 @@ flag_check(int val, APEX_CPU*cpu)
     }
 }
 
+/* Converts the PC(4000 series) into array index for code memory
+ *
+ * Note: You are not supposed to edit this function
+ */
 static int
 get_code_memory_index_from_pc(const int pc)
 {
@@ -59,100 +51,7 @@ get_code_memory_index_from_pc(const int pc)
 static void
 print_instruction(const CPU_Stage *stage)
 {
-    switch (stage->opcode)
-    {
-        case OPCODE_ADD:
-        case OPCODE_SUB:
-        case OPCODE_MUL:
-        case OPCODE_DIV:
-        case OPCODE_AND:
-        case OPCODE_OR:
-        case OPCODE_XOR:
-        {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->rs2);
-            break;
-        }
-
-        case OPCODE_ADDL:
-        case OPCODE_SUBL:
-        {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd,stage->rs1, stage->imm);
-            break;
-        }
-
-        case OPCODE_MOVC:
-        {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rd, stage->imm);
-            break;
-        }
-
-        case OPCODE_LOAD:
-        case OPCODE_JALR:
-        {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->imm);
-            break;
-        }
-
-        case OPCODE_LOADP:
-        {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->imm);
-            break;
-        }
-
-        case OPCODE_STORE:
-        {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
-                   stage->imm);
-            break;
-        }
-
-        case OPCODE_STOREP:
-        {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
-                   stage->imm);
-            break;
-        }
-        case OPCODE_CML:
-        case OPCODE_JUMP:
-        {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rs1,
-                   stage->imm);
-            break;
-        }
-
-
-        case OPCODE_CMP:
-        {
-            printf("%s,R%d,R%d ", stage->opcode_str, stage->rs1, stage->rs2);
-            break;
-        }
-
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
-        case OPCODE_BP:
-        case OPCODE_BNP:
-        case OPCODE_BN:
-        case OPCODE_BNN:
-        {
-            printf("%s,#%d ", stage->opcode_str, stage->imm);
-            break;
-        }
-
-        case OPCODE_HALT:
-        {
-            printf("%s", stage->opcode_str);
-            break;
-        }
-
-        case OPCODE_NOP:
-        {
-            printf("%s", stage->opcode_str);
-            break;
-        }
-    }
+    APEX_isa_print(stage->mnemonic, stage->rd, stage->rs1, stage->rs2, stage->imm);
 }
 
 /* Debug function which prints the CPU stage content
@@ -179,18 +78,16 @@ print_reg_file(const APEX_CPU *cpu)
 
     printf("---------------------");
 
-    for (int i = 0; i < BTB_SIZE; ++i)
+    for (int i = 0; i < APEX_btb_size(&cpu->btb); ++i)
     {
-        printf("\ni_address: %d hbit0: %d hbit1: %d taddress: %d\n",btb->BTBentry[i].i_address,
-        btb->BTBentry[i].h_bits[0],btb->BTBentry[i].h_bits[1],btb->BTBentry[i].t_address);
+        printf("\ni_address: %d hbit0: %d hbit1: %d taddress: %d\n",cpu->btb.entries[i].i_address,
+        cpu->btb.entries[i].h_bits[0],cpu->btb.entries[i].h_bits[1],cpu->btb.entries[i].t_address);
     }
 
-    for(int i=0;i<4096;i++)
+    for (i = APEX_memory_next(&cpu->data_memory, 0); i >= 0;
+         i = APEX_memory_next(&cpu->data_memory, i + 1))
     {
-        if(cpu->data_memory[i] != 0)
-        {
-            printf("\nMEM[%d] = %d\n",i, cpu->data_memory[i]);
-        }
+        printf("\nMEM[%d] = %d\n", i, cpu->data_memory.words[i]);
     }
     // if(cpu->data_memory[i])
     printf("----------\n%s\n----------\n", "Registers:");
@@ -213,1222 +110,1171 @@ print_reg_file(const APEX_CPU *cpu)
 
 
 
+/*
+ * Predicts the target of a JUMP or JALR being fetched from the return
+ * address stack or the indirect target predictor. A target inside the
+ * program goes to cpu->target_address and fetch follows it.
+ */
+static void
+APEX_predict_target(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    APEX_BPredInfo *info;
+    int slot;
+    int target;
+
+    info = APEX_bpred_begin(&cpu->bpred, stage->pc, -1, &slot);
+    stage->bp_slot = slot;
+    if (stage->opcode == OPCODE_JALR)
+    {
+        target = APEX_bpred_predict_call(&cpu->bpred, info, stage->rd);
+    }
+    else
+    {
+        target = APEX_bpred_predict_jump(&cpu->bpred, info, stage->rs1, stage->imm);
+    }
+
+    if (target < 4000 || target > (cpu->code_memory_size - 1) * 4 + 4000 || (target & 3))
+    {
+        info->target = -1;
+        return;
+    }
+    stage->predict_taken = TRUE;
+    stage->target_pc = target;
+    cpu->target_address = target;
+}
+
+/*
+ * Looks up the instruction being fetched in the BTB and predicts it if it
+ * is a conditional branch or a register jump. On a hit the target goes to
+ * cpu->target_address and the index of the entry is returned. Returns -1
+ * on a miss.
+ */
 int 
 BTBHit(APEX_CPU *cpu, int pc)
 {
-    
-    for (int i = 0; i < BTB_SIZE; i++)
+    APEX_BPredInfo *info;
+    int slot;
+    int i = APEX_btb_lookup(&cpu->btb, pc);
+
+    cpu->fetch->predict_taken = FALSE;
+
+    if (i >= 0)
     {
-        // printf("\nbtbentry instruction address: %d\n", btb->BTBentry[i].i_address);
-        // printf("\nactual instruction address: %d\n", pc);
-       
-        if (btb->BTBentry[i].i_address == pc)
-        {
-            cpu->fetch.btb_index = i;
-            if((btb->BTBentry[i].h_bits[0] == 1 &&  btb->BTBentry[i].h_bits[1] == 0) || 
-            (btb->BTBentry[i].h_bits[0] == 1 &&  btb->BTBentry[i].h_bits[1] == 1) )
-            {
-                cpu->fetch.predict_taken = 1;
-            }
-            else
-            {
-                cpu->fetch.predict_taken = 0;
-            }
-            // Use the second history bit as the prediction
-            cpu->target_address = btb->BTBentry[i].t_address;
-            return i; // BTB hit
-        }
+        cpu->fetch->btb_index = i;
+        cpu->target_address = cpu->btb.entries[i].t_address;
     }
-    // BTB miss
-    return -1;
-}
 
+    if (cpu->fetch->ops->taken)
+    {
+        APEX_btb_account(&cpu->btb, pc, i >= 0);
+
+        /* Every conditional branch is predicted and goes into the global
+         * history, but without a BTB target it is fetched as not taken */
+        info = APEX_bpred_begin(&cpu->bpred, pc, i, &slot);
+        cpu->fetch->bp_slot = slot;
+        cpu->fetch->predict_taken = APEX_bpred_predict(&cpu->bpred, info) && i >= 0;
+        APEX_bpred_spec_update(&cpu->bpred, info, cpu->fetch->predict_taken);
+    }
+    else if (cpu->fetch->opcode == OPCODE_JUMP || cpu->fetch->opcode == OPCODE_JALR)
+    {
+        APEX_predict_target(cpu, cpu->fetch);
+    }
 
-void flipbits(int index, int a_taken)
-{
-    if(btb->BTBentry[index].h_bits[0] == 0 && btb->BTBentry[index].h_bits[1] == 0)
-        {
-            if(a_taken)
-            {
-                btb->BTBentry[index].h_bits[1] = 1;
-            }
-            
-        }
-        else if(btb->BTBentry[index].h_bits[0] == 1 && btb->BTBentry[index].h_bits[1] == 0)
-        {
-            if(a_taken)
-            {
-                btb->BTBentry[index].h_bits[1] = 1;
-            }
-            else
-            {
-                btb->BTBentry[index].h_bits[0] = 0;
-                btb->BTBentry[index].h_bits[1] = 1;
-            }
-        }
-        else if(btb->BTBentry[index].h_bits[0] == 1 && btb->BTBentry[index].h_bits[1] == 1)
-        {
-            if(!a_taken)
-            {
-                btb->BTBentry[index].h_bits[1] = 0;
-            }
-        }
-        else
-        {
-            if(a_taken)
-            {
-                btb->BTBentry[index].h_bits[0] = 1;
-                btb->BTBentry[index].h_bits[1] = 0;
-            }
-            else
-            {
-                btb->BTBentry[index].h_bits[1] = 0;
-            }
-        }
+    // BTB hit when i >= 0
+    return i;
 }
 
+
+/*
+ * Resolves the branch in execute against the direction it was fetched down.
+ * The predictor is trained, and on a mispredict its history is rolled back.
+ * Fetch is left to the pipeline, see APEX_cpu_redirect.
+ */
 void actual(APEX_CPU *cpu, int actual_taken, int predict_taken, int btb_hit_bit, int index)
 {
-    if(actual_taken)
-    {
-        if(btb_hit_bit)
-        {
-            if(predict_taken)
-            {
-                flipbits(index, actual_taken);
-            }
-            else
-            {
-                flipbits(index, actual_taken);
-                cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                cpu->fetch_from_next_cycle = TRUE;
-                cpu->decode.has_insn = FALSE;
-                cpu->fetch.has_insn = TRUE;
-            }
-        }
-        else
-        {
-            flipbits(index, actual_taken);
-                cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    cpu->fetch_from_next_cycle = TRUE;
-                    cpu->decode.has_insn = FALSE;
-                    cpu->fetch.has_insn = TRUE;
-        }
-    }
+    APEX_BPredInfo *info = APEX_bpred_info(&cpu->bpred, cpu->execute->bp_slot);
+    int mispredicted = actual_taken != (btb_hit_bit && predict_taken);
 
-    else
+    /* A branch that missed in the BTB trains the entry decode gave it */
+    info->btb_index = index;
+    APEX_bpred_update(&cpu->bpred, info, actual_taken, mispredicted);
+
+    if (mispredicted)
     {
-        if(btb_hit_bit)
-        {
-            if(predict_taken)
-            {
-                flipbits(index, actual_taken);
-                cpu->pc = cpu->execute.pc + 4;
-                    cpu->fetch_from_next_cycle = TRUE;
-                    cpu->decode.has_insn = FALSE;
-                    cpu->fetch.has_insn = TRUE;
-                    // cpu->pc = cpu->execute.pc + 4;
-            }
-        }
-        else
-        {
-            flipbits(index, actual_taken);
-        }
+        APEX_bpred_recover(&cpu->bpred, info);
+        APEX_bpred_spec_update(&cpu->bpred, info, actual_taken);
     }
 }
 
 // int stalling(APEX_CPU *cpu)
 // {
-//     if(cpu->memory.opcode == OPCODE_STOREP)
+//     if(cpu->memory->opcode == OPCODE_STOREP)
 //     {
-//         if(cpu->decode.rs1 == cpu->memory.rd)
+//         if(cpu->decode->rs1 == cpu->memory->rd)
 //         return 1;
-//         if(cpu->decode.rs2 == cpu->memory.rd)
+//         if(cpu->decode->rs2 == cpu->memory->rd)
 //         return 1;
 //     }
 
-//     if(cpu->memory.opcode == OPCODE_LOADP)
+//     if(cpu->memory->opcode == OPCODE_LOADP)
 //     {
-//          if(cpu->decode.rs1 == cpu->memory.rd || cpu->decode.rs1 == cpu->memory.rs1)
+//          if(cpu->decode->rs1 == cpu->memory->rd || cpu->decode->rs1 == cpu->memory->rs1)
 //         return 1;
-//         if(cpu->decode.rs2 == cpu->memory.rd || cpu->decode.rs2 == cpu->memory.rs1)
+//         if(cpu->decode->rs2 == cpu->memory->rd || cpu->decode->rs2 == cpu->memory->rs1)
 //         return TRUE;
 //     }
 // }
 
 /*
- * Fetch Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Per-opcode stage handlers. Each instruction is bound to its handler record
+ * once when the program is loaded, so the stages call straight through the
+ * record instead of switching on the opcode every cycle.
  */
 static void
-APEX_fetch(APEX_CPU *cpu)
+execute_add(APEX_CPU *cpu, CPU_Stage *stage)
 {
-    cpu->fetch.btb_hit_bit = 0;
-    
-    if(cpu->pc <= (cpu->code_memory_size - 1)*4 + 4000)
-    {
-    APEX_Instruction *current_ins;
-    if (cpu->fetch.has_insn)
-    {     
-        
-        /* This fetches new branch target instruction from next cycle */
-        if (cpu->fetch_from_next_cycle == TRUE)
-        {
-            cpu->fetch_from_next_cycle = FALSE;
-
-            /* Skip this cycle*/
-            return;
-        }
+    stage->result_buffer = stage->rs1_value + stage->rs2_value;
 
+    /* Set the zero flag based on the result buffer */
+    flag_check(stage->result_buffer, cpu);
+}
 
-        /* Store current PC in fetch latch */
-        cpu->fetch.pc = cpu->pc;
+static void
+execute_sub(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value - stage->rs2_value;
+    flag_check(stage->result_buffer, cpu);
+}
 
-        /* Index into code memory using this pc and copy all instruction fields
-         * into fetch latch  */
-        current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-        strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-        cpu->fetch.opcode = current_ins->opcode;
-        cpu->fetch.rd = current_ins->rd;
-        cpu->fetch.rs1 = current_ins->rs1;
-        cpu->fetch.rs2 = current_ins->rs2;
-        cpu->fetch.imm = current_ins->imm;
+static void
+execute_addl(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value + stage->imm;
+    flag_check(stage->result_buffer, cpu);
+}
 
-        
-        printf("\nstallflag: %d\n", stall_flag);
-        /* Update PC for next instruction */
-        
-        /* Copy data from fetch latch to decode latch*/
-        if(stall_flag==0){
-            int btb_hit = BTBHit(cpu, cpu->pc);
-            /* If BTB hit, update PC to the predicted target address */
-            if (btb_hit != -1)
-            {
-                printf("\nbtb hit true\n");
-                cpu->fetch.btb_hit_bit = 1;
-                printf("\npredict taken: %d\n", cpu->fetch.predict_taken);
-                if(cpu->fetch.predict_taken)
-                {
-                cpu->pc = cpu->target_address;
-                // printf("target pc: %d", cpu->pc);
-                // cpu->fetch_from_next_cycle = TRUE;
-                }
-                else
-                {
-                    cpu->pc += 4;
-                }
-            }
-            else
-            {
-                cpu->fetch.btb_hit_bit = 0;
-                cpu->pc += 4;
-            }
-            cpu->decode = cpu->fetch;
-        }
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            print_stage_content("Fetch", &cpu->fetch);
-        }
-        }
-        else
-        {
-            cpu->fetch.has_insn = FALSE;
-            return;
-        }
+static void
+execute_subl(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value - stage->imm;
+    flag_check(stage->result_buffer, cpu);
+}
 
-        /* Stop fetching new instructions if HALT is fetched */
-        // if (cpu->fetch.opcode == OPCODE_HALT)
-        // {
-        //     cpu->fetch.has_insn = FALSE;
-        // }
-    }
+static void
+execute_mul(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value * stage->rs2_value;
+    flag_check(stage->result_buffer, cpu);
 }
 
-int stall_check(APEX_CPU *cpu)
+/* Defined for every operand, since the out-of-order backend also executes
+ * uops on paths the program never takes: x / 0 is -1 and INT_MIN / -1 wraps
+ * to INT_MIN, as on RISC-V */
+static void
+execute_div(APEX_CPU *cpu, CPU_Stage *stage)
 {
-    if(!cpu->stall_0_check)
+    if (stage->rs2_value == 0)
     {
-        if(cpu->memory.opcode == OPCODE_STOREP)
-                    {
-                        if(cpu->decode.rs1 == cpu->memory.rs2)
-                        return 1;
-                        if(cpu->decode.rs2 == cpu->memory.rs2)
-                        return 1;
-                    }
-
-                    if(cpu->memory.opcode == OPCODE_LOADP)
-                    {
-                        if(cpu->decode.rs1 == cpu->memory.rd || cpu->decode.rs1 == cpu->memory.rs1)
-                        return 1;
-                        if(cpu->decode.rs2 == cpu->memory.rd || cpu->decode.rs2 == cpu->memory.rs1)
-                        return 1;
-                    }
+        stage->result_buffer = -1;
     }
-    return 0;
+    else if (stage->rs2_value == -1)
+    {
+        stage->result_buffer = (int)(0u - (unsigned int)stage->rs1_value);
+    }
+    else
+    {
+        stage->result_buffer = stage->rs1_value / stage->rs2_value;
+    }
+    flag_check(stage->result_buffer, cpu);
 }
 
-void load_store(APEX_CPU *cpu)
+static void
+execute_and(APEX_CPU *cpu, CPU_Stage *stage)
 {
-    if (cpu->writeback.opcode == OPCODE_STOREP){
-                       
-                        if((cpu->decode.rs1 == cpu->writeback.rs2)){
-                            cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                        }
-                        if((cpu->decode.rs2 == cpu->writeback.rs2)){
-                            cpu->decode.rs2_value = cpu->writeback.result_buffer;
-                            // printf("\nfirst rs2 value: %d\n", cpu->decode.rs2_value);
-                        }
-                    }
+    stage->result_buffer = stage->rs1_value & stage->rs2_value;
+    flag_check(stage->result_buffer, cpu);
+}
 
-                    if (cpu->memory.opcode == OPCODE_STOREP){
-                        if((cpu->decode.rs1 == cpu->memory.rs2)){
-                            cpu->decode.rs1_value = cpu->memory.result_buffer;
-                        }
-                        if((cpu->decode.rs2 == cpu->memory.rs2)){
-                            cpu->decode.rs2_value = cpu->memory.result_buffer;
-                        }
-                    }
+static void
+execute_or(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value | stage->rs2_value;
+    flag_check(stage->result_buffer, cpu);
+}
 
-        if(cpu->writeback.opcode == OPCODE_LOADP)
-        {
-            if((cpu->decode.rs1 == cpu->writeback.rs1)){
-                    cpu->decode.rs1_value = cpu->writeback.rs1_value;
-                }
-            else if(cpu->decode.rs1 == cpu->writeback.rd)
-            {
-                cpu->decode.rs1_value = cpu->data_memory[cpu->writeback.memory_address];
-            }
-            if((cpu->decode.rs2 == cpu->writeback.rs1))
-            {
-                cpu->decode.rs2_value = cpu->writeback.result_buffer;
-                // printf("\nfirst rs2 value: %d\n", cpu->decode.rs2_value);
-            }
-            else if(cpu->decode.rs2 == cpu->writeback.rd)
-            {
-                cpu->decode.rs2_value = cpu->data_memory[cpu->writeback.memory_address];
-            }
-        }
+static void
+execute_xor(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value ^ stage->rs2_value;
+    flag_check(stage->result_buffer, cpu);
+}
 
-            if (cpu->memory.opcode == OPCODE_LOADP)
-            {
-                if((cpu->decode.rs1 == cpu->memory.rs1)){
-                cpu->decode.rs1_value = cpu->memory.rs1_value;
-                }
-            else if(cpu->decode.rs1 == cpu->memory.rd)
-            {
-                cpu->decode.rs1_value = cpu->memory.memory_address;
-            }
-            if((cpu->decode.rs2 == cpu->memory.rs1))
-            {
-                cpu->decode.rs2_value = cpu->memory.result_buffer;
-                // printf("\nfirst rs2 value: %d\n", cpu->decode.rs2_value);
-            }
-            else if(cpu->decode.rs2 == cpu->memory.rd)
-            {
-                cpu->decode.rs2_value = cpu->memory.memory_address;
-            }
-            }
+static void
+execute_load(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    stage->memory_address = stage->rs1_value + stage->imm;
 }
-/*
- * Decode Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
- */
+
 static void
-APEX_decode(APEX_CPU *cpu)
+execute_loadp(APEX_CPU *cpu, CPU_Stage *stage)
 {
-    // printf("\n%d, %d, %d\n", scoreboard.busy[cpu->decode.rd], scoreboard.busy[cpu->decode.rs1], scoreboard.busy[cpu->decode.rs2]);
-    if (cpu->decode.has_insn)
-    {
-        // stall_flag = 1;
+    stage->memory_address = stage->rs1_value + stage->imm;
+    stage->rs1_value = stage->rs1_value + 4;
+}
 
-        switch (cpu->decode.opcode)
-        {
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            case OPCODE_MUL:
-            case OPCODE_DIV:
-            {
-                // if(scoreboard.busy[cpu->decode.rd] != 1 && scoreboard.busy[cpu->decode.rs1] != 1 && 
-                // scoreboard.busy[cpu->decode.rs2] != 1)
-                // {
-                //     scoreboard.busy[cpu->decode.rd] = 1;
-
-                // stalling logic
-                // if(cpu->execute.opcode == OPCODE_LOAD || cpu->execute.opcode == OPCODE_LOADP)
-                // {
-                //     // if(scoreboard.busy[cpu->decode.rs1] == 1 || scoreboard.busy[cpu->decode.rs1] == 1 )
-                //     // {
-                //     //     stall_flag = 1;
-                //     //     cpu->decode.has_insn = TRUE;
-                //     //     return;
-                //     // }
-                //     if((cpu->decode.rs1 == cpu->memory.rd && cpu->memory.has_insn) || (cpu->decode.rs2 == cpu->memory.rd && cpu->memory.has_insn)){
-                //         stall_flag = 1;
-                //         // cpu->decode.has_insn = TRUE;
-                //         return;
-                //     }
-
-                    stall_flag = stall_check(cpu);
-                   
-                if(cpu->decode.rs1 == cpu->writeback.rd && cpu->writeback.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                    }
-                    else if(cpu->decode.rs1 == cpu->memory.rd && cpu->memory.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->memory.result_buffer;
-                    }
-                    else if(cpu->execute.rd == cpu->decode.rs1 && cpu->execute.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->execute.result_buffer;
-                    }
-                    else
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-
-                    }
-
-               if(cpu->decode.rs2 == cpu->writeback.rd && cpu->writeback.has_insn)
-                    {
-                        cpu->decode.rs2_value = cpu->writeback.result_buffer;
-                    }
-                    else if(cpu->decode.rs2 == cpu->memory.rd && cpu->memory.has_insn)
-                    {
-                        cpu->decode.rs2_value = cpu->memory.result_buffer;
-                    }
-                    else if(cpu->execute.rd == cpu->decode.rs2 && cpu->execute.has_insn)
-                    {
-                        cpu->decode.rs2_value = cpu->execute.result_buffer;
-                    }
-                    else
-                    {
-                        cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-
-                    }
-
-                    load_store(cpu);
-                // }
-                // else
-                // {
-                //     stall_flag = 1;
-                // }
-                break;
-            }
+static void
+execute_store(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    stage->memory_address = stage->rs2_value + stage->imm;
+}
 
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            {
-                // if(scoreboard.busy[cpu->decode.rd] != 1 && scoreboard.busy[cpu->decode.rs1] !=1)
-                // {
-                //     stall_flag = 0;
-                    // scoreboard.busy[cpu->decode.rd] = 1;
-                    stall_flag = stall_check(cpu);
-
-                    if(cpu->decode.rs1 == cpu->writeback.rd && cpu->writeback.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                    }
-                    else if(cpu->decode.rs1 == cpu->memory.rd && cpu->memory.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->memory.result_buffer;
-                    }
-                    else if(cpu->execute.rd == cpu->decode.rs1 && cpu->execute.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->execute.result_buffer;
-                    }
-                    else
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-
-                    }
-
-                    // TODO: check everywhere
-                    // if (cpu->execute.opcode == OPCODE_STOREP){
-                    //     if(cpu->decode.rs1 == cpu->execute.rs2)
-                    //     {
-                    //         cpu->decode.rs1_value = cpu->execute.result_buffer;
-                    //     }
-                    // }
-
-                     load_store(cpu);
-                // }
-                // else
-                // {
-                //     stall_flag = 1;
-                // }
-                
-                // stall_flag = 0;
-                break;
-            }
-            case OPCODE_LOAD:
-            {
-                // if(scoreboard.busy[cpu->decode.rd] != 1 && scoreboard.busy[cpu->decode.rs1] !=1)
-                // {
-                //     stall_flag = 0;
-                    // scoreboard.busy[cpu->decode.rd] = 1;
-                    stall_flag = stall_check(cpu);
-
-                    if(cpu->execute.rd == cpu->decode.rs1 && cpu->execute.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->execute.result_buffer;
-                    }
-                    else if(cpu->decode.rs1 == cpu->memory.rd && cpu->memory.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->memory.result_buffer;
-                    }
-                    else if(cpu->decode.rs1 == cpu->writeback.rd && cpu->writeback.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                    }
-                    else
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-
-                    }
-
-                     load_store(cpu);
-                // }
-                // else
-                // {
-                //     stall_flag = 1;
-                // }
-                
-                // stall_flag = 0;
-                break;
-            }
-            case OPCODE_LOADP:
-            {
-                // if(scoreboard.busy[cpu->decode.rd] != 1 && scoreboard.busy[cpu->decode.rs1] != 1)
-                // {
-                //     stall_flag = 0;
-                    // scoreboard.busy[cpu->decode.rd] = 1;
-
-                   stall_flag = stall_check(cpu);
-
-
-                //     scoreboard.busy[cpu->decode.rs1] = 1;
-                    if(cpu->execute.rd == cpu->decode.rs1 && cpu->execute.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->execute.result_buffer;
-                    }
-                    else if(cpu->decode.rs1 == cpu->memory.rd && cpu->memory.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->memory.result_buffer;
-                    }
-                    else if(cpu->decode.rs1 == cpu->writeback.rd && cpu->writeback.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                    }
-                    else
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-
-                    }
-                    // if(cpu->memory.opcode == OPCODE_STOREP)
-                    // {
-                    //     if(cpu->decode.rs1 == cpu->memory.rs2)
-                    //     {
-                    //         cpu->decode.rs1 = cpu->memory.rs2_value;
-                    //     }
-                    // }
-                    // if (cpu->execute.opcode == OPCODE_STOREP){
-                    // //printf("entered here\n %d %d %d", cpu->decode.rs1, cpu->execute.rs2, cpu->execute.has_insn);
-                    //     if((cpu->decode.rs1 == cpu->execute.rs2)){
-                    // //printf("entered here as well\n");
-                    //         cpu->decode.rs1_value = cpu->execute.result_buffer;
-                    //     }
-                    // }
-
-                     load_store(cpu);
-                    
-                    
-                //printf("dewcode %d %d\n", cpu->decode.rs1_value, cpu->decode.rs2_value);
-
-                // }
-                // else
-                // {
-                //     stall_flag = 1;
-                // }
-                
-                // stall_flag = 0;
-                break;
-            }
-            case OPCODE_STORE:
-            {
-                // if(scoreboard.busy[cpu->decode.rs2] != 1 && scoreboard.busy[cpu->decode.rs1] != 1)
-                // {
-                    
-                //     stall_flag = 0;
-
-                stall_flag = stall_check(cpu);
-
-                if(cpu->decode.rs1 == cpu->writeback.rd && cpu->writeback.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                    }
-                    else if(cpu->decode.rs1 == cpu->memory.rd && cpu->memory.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->memory.result_buffer;
-                    }
-                    else if(cpu->execute.rd == cpu->decode.rs1 && cpu->execute.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->execute.result_buffer;
-                    }
-                    else
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-
-                    }
-
-               if(cpu->decode.rs2 == cpu->writeback.rd && cpu->writeback.has_insn)
-                    {
-                        cpu->decode.rs2_value = cpu->writeback.result_buffer;
-                    }
-                    else if(cpu->decode.rs2 == cpu->memory.rd && cpu->memory.has_insn)
-                    {
-                        cpu->decode.rs2_value = cpu->memory.result_buffer;
-                    }
-                    else if(cpu->execute.rd == cpu->decode.rs2 && cpu->execute.has_insn)
-                    {
-                        cpu->decode.rs2_value = cpu->execute.result_buffer;
-                    }
-                    else
-                    {
-                        cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-
-                    }
-
-                     load_store(cpu);
-                // }
-                // else
-                // {
-                //     stall_flag = 1;
-                // }
-                // stall_flag = 0;
-                break;
-            }
+static void
+execute_storep(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    stage->memory_address = stage->rs2_value + stage->imm;
+    stage->result_buffer = stage->rs2_value + 4;
+}
 
-            case OPCODE_STOREP:
-            {
-                // if(scoreboard.busy[cpu->decode.rs2] != 1 && scoreboard.busy[cpu->decode.rs1 !=1])
-                // {
-                //     stall_flag = 0;
-                //     scoreboard.busy[cpu->decode.rs2] = 1;
-                stall_flag = stall_check(cpu);
-
-
-                if(cpu->decode.rs1 == cpu->writeback.rd && cpu->writeback.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                    }
-                    else if(cpu->decode.rs1 == cpu->memory.rd && cpu->memory.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->memory.result_buffer;
-                    }
-                    else if(cpu->execute.rd == cpu->decode.rs1 && cpu->execute.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->execute.result_buffer;
-                    }
-                    else
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-
-                    }
-
-               if(cpu->decode.rs2 == cpu->writeback.rd && cpu->writeback.has_insn)
-                    {
-                        cpu->decode.rs2_value = cpu->writeback.result_buffer;
-                    }
-                    else if(cpu->decode.rs2 == cpu->memory.rd && cpu->memory.has_insn)
-                    {
-                        cpu->decode.rs2_value = cpu->memory.result_buffer;
-                    }
-                    else if(cpu->execute.rd == cpu->decode.rs2 && cpu->execute.has_insn)
-                    {
-                        cpu->decode.rs2_value = cpu->execute.result_buffer;
-                    }
-                    else
-                    {
-                        cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-
-                    }
-
-                     load_store(cpu);
-
-                    // printf("\nmem instruction: %s", cpu->memory.opcode_str);
-                    // printf("\nwrite instruction: %s", cpu->writeback.opcode_str);
-                    //  if (cpu->writeback.opcode == OPCODE_STOREP){
-                    //     printf("entered here");
-                    // //printf("entered here\n %d %d %d", cpu->decode.rs1, cpu->execute.rs2, cpu->execute.has_insn);
-                    //     if((cpu->decode.rs1 == cpu->writeback.rs2)){
-                    //         cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                    //     }
-                    //     if((cpu->decode.rs2 == cpu->writeback.rs2)){
-                    //         cpu->decode.rs2_value = cpu->writeback.result_buffer;
-                    //         printf("\nfirst rs2 value: %d\n", cpu->decode.rs2_value);
-                    //     }
-                    // }
-
-                    // if (cpu->memory.opcode == OPCODE_STOREP){
-                    // //printf("entered here\n %d %d %d", cpu->decode.rs1, cpu->execute.rs2, cpu->execute.has_insn);
-                    //     if((cpu->decode.rs1 == cpu->memory.rs2)){
-                    //         cpu->decode.rs1_value = cpu->memory.result_buffer;
-                    //     }
-                    //     if((cpu->decode.rs2 == cpu->memory.rs2)){
-                    //         cpu->decode.rs2_value = cpu->memory.result_buffer;
-                    //     }
-                    // }
-
-                    // printf("rs1 value: %d", cpu->decode.rs1_value);
-                    // printf("rs2 value: %d", cpu->decode.rs2_value);
-                // }
-                // else
-                // {
-                //     stall_flag = 1;
-                // }
-                
-                // stall_flag = 0;
-                break;
-            }
+static void
+execute_cmp(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    cpu->zero_flag = FALSE;
+    cpu->positive_flag = FALSE;
+    cpu->negative_flag = FALSE;
+    if (stage->rs1_value == stage->rs2_value)
+    {
+        cpu->zero_flag = TRUE;
+    }
+    else if (stage->rs1_value > stage->rs2_value)
+    {
+        cpu->positive_flag = TRUE;
+    }
+    else
+    {
+        cpu->negative_flag = TRUE;
+    }
+}
 
-            case OPCODE_CMP:
-            {
-                
-
-                stall_flag = stall_check(cpu);
-                   
-                
-                if(cpu->decode.rs1 == cpu->writeback.rd && cpu->writeback.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                    }
-                    else if(cpu->decode.rs1 == cpu->memory.rd && cpu->memory.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->memory.result_buffer;
-                    }
-                    else if(cpu->execute.rd == cpu->decode.rs1 && cpu->execute.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->execute.result_buffer;
-                    }
-                    else
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-
-                    }
-
-               if(cpu->decode.rs2 == cpu->writeback.rd && cpu->writeback.has_insn)
-                    {
-                        cpu->decode.rs2_value = cpu->writeback.result_buffer;
-                    }
-                    else if(cpu->decode.rs2 == cpu->memory.rd && cpu->memory.has_insn)
-                    {
-                        cpu->decode.rs2_value = cpu->memory.result_buffer;
-                    }
-                    else if(cpu->execute.rd == cpu->decode.rs2 && cpu->execute.has_insn)
-                    {
-                        cpu->decode.rs2_value = cpu->execute.result_buffer;
-                    }
-                    else
-                    {
-                        cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-
-                    }
-
-                     load_store(cpu);
-                // }
-                // else
-                // {
-                //     stall_flag = 1;
-                // }
-
-                // stall_flag = 0;
-                break;
-            }
+static void
+execute_cml(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    cpu->zero_flag = FALSE;
+    cpu->positive_flag = FALSE;
+    cpu->negative_flag = FALSE;
+    if (stage->rs1_value == stage->imm)
+    {
+        cpu->zero_flag = TRUE;
+    }
+    else if (stage->rs1_value > stage->imm)
+    {
+        cpu->positive_flag = TRUE;
+    }
+    else
+    {
+        cpu->negative_flag = TRUE;
+    }
+}
 
-            case OPCODE_CML:
-            {
-                // if(scoreboard.busy[cpu->decode.rs1] != 1)
-                // {
-                //     stall_flag = 0;
-
-                stall_flag = stall_check(cpu);
-                
-                    if(cpu->decode.rs1 == cpu->writeback.rd && cpu->writeback.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                    }
-                    else if(cpu->decode.rs1 == cpu->memory.rd && cpu->memory.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->memory.result_buffer;
-                    }
-                    else if(cpu->execute.rd == cpu->decode.rs1 && cpu->execute.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->execute.result_buffer;
-                    }
-                    else
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-
-                    }
-
-                     load_store(cpu);
-                // }
-                // else
-                // {
-                //     stall_flag = 1;
-                // }
-
-                // stall_flag = 0;
-                break;
-            }
+/*
+ * JALR and JUMP leave their target in memory_address and clear
+ * predict_taken when fetch did not go there already, which the pipeline
+ * then redirects. Either way APEX_execute resolves the prediction. The
+ * return address is ready in execute, as a correctly predicted call has its
+ * first callee instructions right behind it.
+ */
+static void
+execute_jalr(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    stage->result_buffer = stage->pc + 4;
+    stage->memory_address = stage->rs1_value + stage->imm;
+    if (stage->predict_taken && stage->target_pc == stage->memory_address)
+    {
+        return;
+    }
+    stage->predict_taken = FALSE;
+}
 
-            case OPCODE_MOVC:
-            {
-                // printf("rd: %d, score for rd %d", cpu->decode.rd, scoreboard.busy[cpu->decode.rd]);
-                // if(scoreboard.busy[cpu->decode.rd] != 1)
-                // {
-                //     printf("here");
-                //     stall_flag = 0;
-                    scoreboard.busy[cpu->decode.rd] = 1;
-
-                // }
-                // else
-                // {
-                //     stall_flag = 1;
-                // }
-                // stall_flag = 0;
-                break;
-            }
+static void
+execute_jump(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    stage->memory_address = stage->rs1_value + stage->imm;
+    if (stage->predict_taken && stage->target_pc == stage->memory_address)
+    {
+        return;
+    }
+    stage->predict_taken = FALSE;
+}
 
-            case OPCODE_JALR:
-            
-            {
-                // if(scoreboard.busy[cpu->decode.rd] != 1 && scoreboard.busy[cpu->decode.rs1] != 1)
-                // {
-                //     stall_flag = 0;
-                //     scoreboard.busy[cpu->decode.rd] = 1;
-
-                stall_flag = stall_check(cpu);
-
-                    if(cpu->execute.rd == cpu->decode.rs1 && cpu->execute.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->execute.result_buffer;
-                    }
-                    else if(cpu->decode.rs1 == cpu->memory.rd && cpu->memory.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->memory.result_buffer;
-                    }
-                    else if(cpu->decode.rs1 == cpu->writeback.rd && cpu->writeback.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                    }
-                    else
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-
-                    }
-
-                     load_store(cpu);
-                // }
-                // else
-                // {
-                //     stall_flag = 1;
-                // }
-                // stall_flag = 0;
-                break;
-            }
-            
+static void
+execute_movc(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    stage->result_buffer = stage->imm;
 
+    /* Set the zero flag based on the result buffer */
+    cpu->zero_flag = (stage->result_buffer == 0) ? TRUE : FALSE;
+}
 
-            case OPCODE_JUMP:
-            {
-                // if(scoreboard.busy[cpu->decode.rs1] != 1)
-                // {
-                //     stall_flag = 0;
-                stall_flag = stall_check(cpu);
-
-
-                    if(cpu->execute.rd == cpu->decode.rs1 && cpu->execute.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->execute.result_buffer;
-                    }
-                    else if(cpu->decode.rs1 == cpu->memory.rd && cpu->memory.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->memory.result_buffer;
-                    }
-                    else if(cpu->decode.rs1 == cpu->writeback.rd && cpu->writeback.has_insn)
-                    {
-                        cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                    }
-                    else
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-
-                    }
-
-                     load_store(cpu);
-                // }
-                // else
-                // {
-                //     stall_flag = 1;
-                // }
-                
-                // stall_flag = 0;
-                break;
-            }
+/* Branch conditions, shared by the pipeline and the functional fast-forward */
+static int
+taken_bz(const APEX_CPU *cpu)
+{
+    return cpu->zero_flag == TRUE;
+}
 
-            case OPCODE_NOP:
-            {
-                // stall_flag = 0;
-                break;
-            }
+static int
+taken_bnz(const APEX_CPU *cpu)
+{
+    return cpu->zero_flag == FALSE;
+}
 
-            case OPCODE_BP:
-            case OPCODE_BNP:
-            case OPCODE_BZ:
-            case OPCODE_BNZ:
-            // case OPCODE_BN:
-            // case OPCODE_BNN:
-            {
-                // stall_flag = 0;
-                printf("Stall flag at decode is %d:\n",stall_flag);
-                int slot = 0;
-                //int btb_hit = BTBLookup(btb, cpu->decode.pc);   
-                if(!cpu->decode.btb_hit_bit)
-                {
-                     for (int i = 0; i < BTB_SIZE; ++i) 
-                    {
-                        if(!btb->BTBentry[i].valid)
-                        {
-                            slot = i;
-                            break;
-                        }
-                    }
-                        btb->BTBentry[slot].valid = 1;
-                        btb->BTBentry[slot].i_address = cpu->decode.pc;
-                         if (strcmp(cpu->decode.opcode_str, "BNZ") == 0 || strcmp(cpu->decode.opcode_str, "BP") == 0) {
-                            btb->BTBentry[slot].h_bits[0] = 1;
-                            btb->BTBentry[slot].h_bits[1] = 1;
-                        } else {
-                            btb->BTBentry[slot].h_bits[0] = 0;
-                            btb->BTBentry[slot].h_bits[1] = 0;
-                        }
+static int
+taken_bp(const APEX_CPU *cpu)
+{
+    return cpu->positive_flag == TRUE;
+}
 
-                cpu->decode.btb_index = slot;
-                }
+static int
+taken_bnp(const APEX_CPU *cpu)
+{
+    return cpu->positive_flag == FALSE;
+}
 
+/*
+ * Records the branch target in the BTB and resolves the prediction. The
+ * entry is only written while it still holds this branch, another branch
+ * may have been given it since it was looked up.
+ */
+static void
+execute_branch(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    BTBentry *entry = &cpu->btb.entries[stage->btb_index];
 
-                break;
-            }
+    if (entry->i_address == stage->pc)
+    {
+        entry->t_address = stage->pc + stage->imm;
+    }
+    cpu->actual_taken = stage->ops->taken(cpu);
+    actual(cpu, cpu->actual_taken, stage->predict_taken, stage->btb_hit_bit,
+           stage->btb_index);
+}
 
-         cpu->fetch.has_insn = TRUE;
-        }
+static void
+stage_nop(APEX_CPU *cpu, CPU_Stage *stage)
+{
+}
 
-        
-        if(cpu->decode.opcode == OPCODE_HALT){
-            cpu->fetch.has_insn = FALSE;
-            // stall_flag = 0;
-        }
-        /* Copy data from decode latch to execute latch*/
-        if(stall_flag == 0){
+static void
+memory_load(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    /* Read from the youngest buffered store to the address, else memory */
+    stage->result_buffer = APEX_lsq_load(&cpu->lsq, stage->memory_address,
+                                         &cpu->data_memory);
+}
 
-        cpu->execute = cpu->decode;
-        cpu->stall_0_check = FALSE;
-        cpu->decode.has_insn = FALSE;
+static void
+memory_store(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    APEX_lsq_store(&cpu->lsq, stage->memory_address, stage->rs1_value, &cpu->data_memory);
+}
+
+static void
+writeback_rd(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    cpu->regs[stage->rd] = stage->result_buffer;
+}
+
+static void
+writeback_loadp(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    cpu->regs[stage->rd] = stage->result_buffer;
+    cpu->regs[stage->rs1] = stage->rs1_value;
+}
+
+static void
+writeback_storep(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    cpu->regs[stage->rs2] = stage->result_buffer;
+}
+
+/* Stage handlers of every opcode, from the description of the instruction set */
+static const APEX_OpHandler op_handlers[OPCODE_COUNT] = {
+#define APEX_ISA(name, value, mnemonic, format, unit, effects, execute, memory, writeback, \
+                 taken) \
+    [OPCODE_##name] = {execute, memory, writeback, ISA_EFFECTS_##name, taken},
+#include "apex_isa.def"
+};
+
+/* Handler record of an opcode, opcodes without a record behave as NOP */
+static const APEX_OpHandler *
+APEX_handler(int opcode)
+{
+    if (opcode < OPCODE_COUNT && op_handlers[opcode].execute)
+    {
+        return &op_handlers[opcode];
+    }
+    return &op_handlers[OPCODE_NOP];
+}
+
+/*
+ * Binds an instruction to its handler record and works out which registers
+ * it reads and writes
+ */
+static void
+APEX_bind_instruction(APEX_Instruction *ins)
+{
+    const APEX_OpHandler *ops = APEX_handler(ins->opcode);
+
+    ins->ops = ops;
+    ins->src_mask = 0;
+    ins->dst_mask = 0;
+    if (ops->operands & OPERAND_READS_RS1)
+    {
+        ins->src_mask |= 1u << ins->rs1;
+    }
+    if (ops->operands & OPERAND_READS_RS2)
+    {
+        ins->src_mask |= 1u << ins->rs2;
+    }
+    if (ops->operands & OPERAND_WRITES_RD)
+    {
+        ins->dst_mask |= 1u << ins->rd;
+    }
+    if (ops->operands & OPERAND_WRITES_RS1)
+    {
+        ins->dst_mask |= 1u << ins->rs1;
+    }
+    if (ops->operands & OPERAND_WRITES_RS2)
+    {
+        ins->dst_mask |= 1u << ins->rs2;
+    }
+}
+
+/*
+ * Loads the code memory entry at pc into a micro-op, with its operand and
+ * result values cleared
+ */
+static APEX_ALWAYS_INLINE void
+APEX_load_instruction(const APEX_CPU *cpu, CPU_Stage *stage, int pc)
+{
+    const APEX_Instruction *ins = &cpu->code_memory[get_code_memory_index_from_pc(pc)];
+
+    stage->pc = pc;
+    stage->opcode = ins->opcode;
+    stage->mnemonic = ins->mnemonic;
+    stage->rd = ins->rd;
+    stage->rs1 = ins->rs1;
+    stage->rs2 = ins->rs2;
+    stage->imm = ins->imm;
+    stage->src_mask = ins->src_mask;
+    stage->dst_mask = ins->dst_mask;
+    stage->ops = ins->ops;
+    stage->rs1_value = 0;
+    stage->rs2_value = 0;
+    stage->result_buffer = 0;
+    stage->memory_address = 0;
+}
+
+/*
+ * TRUE if a latch past fetch points at slot, a lane of a live group holds
+ * it or it is in a functional unit
+ */
+static APEX_ALWAYS_INLINE int
+APEX_slot_in_use(const APEX_CPU *cpu, const CPU_Stage *slot)
+{
+    const APEX_Group *const groups[4] = {&cpu->decode_group, &cpu->execute_group,
+                                         &cpu->memory_group, &cpu->writeback_group};
+    const int live[4] = {cpu->decode_has_insn, cpu->execute_has_insn,
+                         cpu->memory_has_insn, cpu->writeback_has_insn};
+    int i;
+    int j;
+
+    if (slot == cpu->decode || slot == cpu->execute || slot == cpu->memory ||
+        slot == cpu->writeback || (cpu->units.slot_mask & (1ull << (slot - cpu->slots))))
+    {
+        return TRUE;
+    }
+
+    /* With one lane each group is its latch pointer */
+    for (i = 0; cpu->width > 1 && i < 4; ++i)
+    {
+        for (j = 0; live[i] && j < groups[i]->count; ++j)
+        {
+            if (groups[i]->lanes[j] == slot)
+            {
+                return TRUE;
+            }
         }
-        
-        if (ENABLE_DEBUG_MESSAGES)
+    }
+    return FALSE;
+}
+
+/*
+ * Returns a micro-op slot that none of the pipeline latches points at. A
+ * latch keeps pointing at the slot it handed on until it receives a new
+ * one, so at most five slots plus the lanes in flight and those in the
+ * functional units are in use at any time.
+ */
+static CPU_Stage *
+APEX_free_slot(APEX_CPU *cpu)
+{
+    CPU_Stage *slot;
+
+    while (1)
+    {
+        cpu->slot_cursor = (cpu->slot_cursor + 1) & (APEX_LATCH_SLOTS - 1);
+        slot = &cpu->slots[cpu->slot_cursor];
+        if (slot != cpu->fetch && !APEX_slot_in_use(cpu, slot))
         {
-            print_stage_content("Decode/RF", &cpu->decode);
+            return slot;
         }
     }
 }
 
 /*
- * Execute Stage of APEX Pipeline
+ * Fetch Stage of APEX Pipeline
  *
  * Note: You are free to edit this function according to your implementation
  */
-static void
-APEX_execute(APEX_CPU *cpu)
+static APEX_ALWAYS_INLINE void
+APEX_fetch(APEX_CPU *cpu, const int trace)
 {
-    if (cpu->execute.has_insn)
+    const int last_pc = (cpu->code_memory_size - 1) * 4 + 4000;
+    APEX_Group *group = &cpu->decode_group;
+    
+    if(cpu->pc <= last_pc)
     {
-        /* Execute logic based on instruction type */
-        switch (cpu->execute.opcode)
-        {
-            case OPCODE_ADD:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value + cpu->execute.rs2_value;
+    if (cpu->fetch_has_insn)
+    {     
         
-                /* Set the zero flag based on the result buffer */
-                flag_check(cpu->execute.result_buffer, cpu);
-                break;
-            }
-            case OPCODE_SUB:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.rs2_value;
-                flag_check(cpu->execute.result_buffer,cpu);
-                break;
-            }
+        /* This fetches new branch target instruction from next cycle */
+        if (cpu->fetch_from_next_cycle == TRUE)
+        {
+            cpu->fetch_from_next_cycle = FALSE;
+            cpu->perf.events[PERF_STALL_REDIRECT]++;
 
-            case OPCODE_ADDL:
+            /* Skip this cycle*/
+            return;
+        }
+
+        /* With an L1I, fetch hands on what the fetch buffer holds for pc and
+         * waits while its line is still on the way. Only the cycles decode
+         * could have taken an instruction count as bubbles. */
+        if (cpu->ifetch.icache.count)
+        {
+            APEX_ifetch_fill(&cpu->ifetch, cpu->pc, last_pc, cpu->clock);
+            if (!APEX_ifetch_ready(&cpu->ifetch, cpu->pc, cpu->clock))
             {
-                cpu->execute.result_buffer = cpu->execute.rs1_value + cpu->execute.imm;
-                printf("ADDL forwarded value %d", cpu->execute.result_buffer);
-                flag_check(cpu->execute.result_buffer, cpu);
-                break;
+                if (cpu->stall_flag == 0)
+                {
+                    cpu->perf.events[PERF_STALL_ICACHE]++;
+                }
+                return;
             }
+        }
+
+
+        /* The fetch latch may still share its slot with the instruction it
+         * handed to decode, so take an unused slot before writing to it */
+        if (APEX_slot_in_use(cpu, cpu->fetch))
+        {
+            cpu->fetch = APEX_free_slot(cpu);
+        }
+        cpu->fetch->btb_hit_bit = 0;
+
+        /* Copy all instruction fields at the current PC into fetch latch */
+        APEX_load_instruction(cpu, cpu->fetch, cpu->pc);
 
-             case OPCODE_SUBL:
+        
+        if (trace >= TRACE_FULL)
+        {
+            printf("\nstallflag: %d\n", cpu->stall_flag);
+        }
+        /* Update PC for next instruction */
+        
+        /* Copy data from fetch latch to decode latch*/
+        if(cpu->stall_flag==0){
+        /* Decode is empty and takes a group of up to width instructions */
+        group->count = 0;
+        cpu->decode_has_insn = TRUE;
+        while (1)
+        {
+            int btb_hit = BTBHit(cpu, cpu->pc);
+            /* If BTB hit, update PC to the predicted target address */
+            if (btb_hit != -1)
             {
-                cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.imm;
-                flag_check(cpu->execute.result_buffer, cpu);
-                break;
+                cpu->fetch->btb_hit_bit = 1;
+                if (trace >= TRACE_FULL)
+                {
+                    printf("\nbtb hit true\n");
+                    printf("\npredict taken: %d\n", cpu->fetch->predict_taken);
+                }
+                if(cpu->fetch->predict_taken)
+                {
+                cpu->pc = cpu->target_address;
+                // printf("target pc: %d", cpu->pc);
+                // cpu->fetch_from_next_cycle = TRUE;
+                }
+                else
+                {
+                    cpu->pc += 4;
+                }
             }
-            
-            case OPCODE_MUL:
+            else if (cpu->fetch->predict_taken)
             {
-                cpu->execute.result_buffer = cpu->execute.rs1_value * cpu->execute.rs2_value;
-                flag_check(cpu->execute.result_buffer, cpu);
-                break;
+                /* Register jump with a predicted target */
+                cpu->fetch->btb_hit_bit = 0;
+                cpu->pc = cpu->target_address;
             }
-
-            case OPCODE_DIV:
+            else
             {
-                cpu->execute.result_buffer = cpu->execute.rs1_value / cpu->execute.rs2_value;
-                flag_check(cpu->execute.result_buffer, cpu);
-                break;
+                cpu->fetch->btb_hit_bit = 0;
+                cpu->pc += 4;
             }
-
-            case OPCODE_AND:
+            group->lanes[group->count++] = cpu->fetch;
+            if (cpu->ifetch.icache.count)
             {
-                cpu->execute.result_buffer = cpu->execute.rs1_value & cpu->execute.rs2_value;
-                printf("\nAND result: %d",cpu->execute.result_buffer);
-                flag_check(cpu->execute.result_buffer, cpu);
-                break;
+                APEX_ifetch_advance(&cpu->ifetch);
             }
 
-            case OPCODE_OR:
+            if (trace >= TRACE_STAGE)
             {
-                cpu->execute.result_buffer = cpu->execute.rs1_value | cpu->execute.rs2_value;
-                flag_check(cpu->execute.result_buffer, cpu);
-                break;
+                print_stage_content("Fetch", cpu->fetch);
             }
 
-            case OPCODE_XOR:
+            /* The group ends at a predicted-taken branch or jump, at HALT, at
+             * the end of the program and where the fetch buffer runs dry */
+            if (group->count == cpu->width || cpu->pc != cpu->fetch->pc + 4 ||
+                cpu->fetch->opcode == OPCODE_HALT || cpu->pc > last_pc ||
+                (cpu->ifetch.icache.count &&
+                 !APEX_ifetch_ready(&cpu->ifetch, cpu->pc, cpu->clock)))
             {
-                cpu->execute.result_buffer = cpu->execute.rs1_value ^ cpu->execute.rs2_value;
-                flag_check(cpu->execute.result_buffer, cpu);
                 break;
             }
-
-            case OPCODE_LOAD:
-            {
-                cpu->execute.memory_address
-                    = cpu->execute.rs1_value + cpu->execute.imm;
-                break;
-            }
-            case OPCODE_LOADP:
-            {
-                cpu->execute.memory_address
-                    = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->execute.rs1_value = cpu->execute.rs1_value + 4;
-                break;
-            }
-            case OPCODE_STORE:
+            cpu->fetch = APEX_free_slot(cpu);
+            cpu->fetch->btb_hit_bit = 0;
+            APEX_load_instruction(cpu, cpu->fetch, cpu->pc);
+        }
+        cpu->decode = group->lanes[0];
+        }
+        else if (trace >= TRACE_STAGE)
+        {
+            print_stage_content("Fetch", cpu->fetch);
+        }
+        }
+        else
+        {
+            cpu->fetch_has_insn = FALSE;
+            return;
+        }
+
+        /* Stop fetching new instructions if HALT is fetched */
+        // if (cpu->fetch->opcode == OPCODE_HALT)
+        // {
+        //     cpu->fetch_has_insn = FALSE;
+        // }
+    }
+}
+
+/*
+ * Latch field holding the value an instruction writes to reg, NULL if it
+ * does not write reg. The new base of LOADP is kept in rs1_value and every
+ * other destination, the new base of STOREP included, in result_buffer.
+ */
+static const int *
+APEX_latch_result(const CPU_Stage *stage, int reg)
+{
+    if (!(stage->dst_mask & (1u << reg)))
+    {
+        return NULL;
+    }
+    if ((stage->ops->operands & OPERAND_WRITES_RS1) && stage->rs1 == reg)
+    {
+        /* Written after rd, so it wins when both are the same register */
+        return &stage->rs1_value;
+    }
+    return &stage->result_buffer;
+}
+
+/*
+ * Reads source register reg for decode from the youngest older instruction
+ * writing it, or from the register file when none is in flight. Older lanes
+ * decode handed on this cycle are the youngest, then come the functional
+ * units and the memory and writeback lanes. Returns -1 once *value holds
+ * the source, or the stall event to count when the value does not exist
+ * yet: a result still to be computed in a unit, or the data of a load about
+ * to read memory.
+ */
+static int
+APEX_read_source(const APEX_CPU *cpu, int reg, int *value)
+{
+    unsigned long long mask = cpu->units.slot_mask;
+    const CPU_Stage *stage;
+    const int *result;
+    int slot;
+    int lane;
+
+    for (lane = 0; cpu->execute_has_insn && lane < cpu->execute_group.count; ++lane)
+    {
+        if (cpu->execute_group.lanes[lane]->dst_mask & (1u << reg))
+        {
+            return PERF_STALL_UNIT_RESULT;
+        }
+    }
+
+    for (slot = 0; mask; ++slot, mask >>= 1)
+    {
+        if ((mask & 1) && (cpu->slots[slot].dst_mask & (1u << reg)))
+        {
+            return PERF_STALL_UNIT_RESULT;
+        }
+    }
+
+    for (lane = cpu->memory_has_insn ? cpu->memory_group.count - 1 : -1; lane >= 0; --lane)
+    {
+        stage = cpu->memory_group.lanes[lane];
+        if ((result = APEX_latch_result(stage, reg)))
+        {
+            if ((stage->ops->operands & OPERAND_LOADS) && result == &stage->result_buffer)
             {
-                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
-                break;         
+                return PERF_STALL_LOAD_USE;
             }
-            case OPCODE_STOREP:
+            *value = *result;
+            return -1;
+        }
+    }
+
+    for (lane = cpu->writeback_has_insn ? cpu->writeback_group.count - 1 : -1; lane >= 0;
+         --lane)
+    {
+        if ((result = APEX_latch_result(cpu->writeback_group.lanes[lane], reg)))
+        {
+            *value = *result;
+            return -1;
+        }
+    }
+
+    *value = cpu->regs[reg];
+    return -1;
+}
+
+/*
+ * Decode Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static APEX_ALWAYS_INLINE void
+APEX_decode(APEX_CPU *cpu, const int trace)
+{
+    int claimed[FU_CLASS_COUNT] = {0};
+    int operands;
+    int fu_class;
+    int stall;
+    int lane;
+
+    /* Hazards are checked again in every cycle an instruction waits */
+    cpu->stall_flag = 0;
+
+    if (!cpu->decode_has_insn)
+    {
+        return;
+    }
+
+    /* Lanes go on in order up to the first one held back. A lane depending
+     * on an older lane finds it among the lanes handed on to execute. */
+    cpu->execute_group.count = 0;
+    for (lane = 0; lane < cpu->decode_group.count && cpu->stall_flag == 0; ++lane)
+    {
+        cpu->decode = cpu->decode_group.lanes[lane];
+
+        switch (cpu->decode->opcode)
+        {
+            case OPCODE_MOVC:
+            case OPCODE_NOP:
+            case OPCODE_HALT:
+            case OPCODE_BN:
+            case OPCODE_BNN:
             {
-                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
-                cpu->execute.result_buffer = cpu->execute.rs2_value + 4;
+                /* No register sources */
                 break;
             }
 
-            case OPCODE_CMP:
+            case OPCODE_BP:
+            case OPCODE_BNP:
+            case OPCODE_BZ:
+            case OPCODE_BNZ:
             {
-                if(cpu->execute.rs1_value == cpu->execute.rs2_value)
-                {
-                    cpu->zero_flag = TRUE;
-                    cpu->positive_flag = FALSE;
-                    cpu->negative_flag = FALSE;
-                }
-                else if(cpu->execute.rs1_value > cpu->execute.rs2_value)
+                if (trace >= TRACE_FULL)
                 {
-                    cpu->positive_flag = TRUE;
-                    cpu->negative_flag = FALSE;
-                    cpu->zero_flag = FALSE;
+                    printf("Stall flag at decode is %d:\n",cpu->stall_flag);
                 }
-                else
+                int slot = 0;
+                //int btb_hit = BTBLookup(btb, cpu->decode->pc);   
+                if(!cpu->decode->btb_hit_bit)
                 {
-                    cpu->negative_flag = TRUE;
-                    cpu->positive_flag = FALSE;
-                    cpu->zero_flag = FALSE;
+                    slot = APEX_btb_allocate(&cpu->btb, cpu->decode->pc);
+                    cpu->perf.events[PERF_BTB_ALLOCATIONS]++;
+                        cpu->btb.entries[slot].valid = 1;
+                        cpu->btb.entries[slot].i_address = cpu->decode->pc;
+                        /* The target is known here, a squashed branch must not
+                         * leave a predicted-taken entry without one */
+                        cpu->btb.entries[slot].t_address = cpu->decode->pc + cpu->decode->imm;
+                         if (cpu->decode->opcode == OPCODE_BNZ || cpu->decode->opcode == OPCODE_BP) {
+                            cpu->btb.entries[slot].h_bits[0] = 1;
+                            cpu->btb.entries[slot].h_bits[1] = 1;
+                        } else {
+                            cpu->btb.entries[slot].h_bits[0] = 0;
+                            cpu->btb.entries[slot].h_bits[1] = 0;
+                        }
+
+                cpu->decode->btb_index = slot;
                 }
+
+
                 break;
             }
 
-            case OPCODE_CML:
+            default:
             {
-                if(cpu->execute.rs1_value == cpu->execute.imm)
+                /* The data of a store is read in memory, its producer has
+                 * written back by then */
+                operands = cpu->decode->ops->operands;
+                if (operands & OPERAND_STORES)
+                {
+                    operands &= ~OPERAND_READS_RS1;
+                }
+
+                stall = -1;
+                if (operands & OPERAND_READS_RS1)
                 {
-                     cpu->zero_flag = TRUE;
-                    cpu->positive_flag = FALSE;
-                    cpu->negative_flag = FALSE;
+                    stall = APEX_read_source(cpu, cpu->decode->rs1, &cpu->decode->rs1_value);
                 }
-                else if(cpu->execute.rs1_value > cpu->execute.imm)
+                if (stall < 0 && (operands & OPERAND_READS_RS2))
                 {
-                     cpu->positive_flag = TRUE;
-                    cpu->negative_flag = FALSE;
-                    cpu->zero_flag = FALSE;
+                    stall = APEX_read_source(cpu, cpu->decode->rs2, &cpu->decode->rs2_value);
                 }
-                else
+                if (stall >= 0)
                 {
-                    cpu->negative_flag = TRUE;
-                    cpu->positive_flag = FALSE;
-                    cpu->zero_flag = FALSE;
+                    cpu->stall_flag = 1;
+                    cpu->perf.events[stall]++;
                 }
                 break;
             }
+        }
 
-            case OPCODE_JALR:
-            {
-                cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->fetch.has_insn = FALSE;
-                cpu->decode.has_insn = FALSE;
-                break;
+        if(cpu->decode->opcode == OPCODE_HALT){
+            cpu->fetch_has_insn = FALSE;
+        }
 
-            }
+        /* A unit of its class has to take the instruction when it enters
+         * execute next cycle, next to the older lanes of its group */
+        fu_class = APEX_fu_class(cpu->decode->opcode);
+        if (cpu->stall_flag == 0 &&
+            !APEX_fu_accepts(&cpu->units, fu_class, cpu->clock + 1, claimed[fu_class],
+                             cpu->execute_group.count))
+        {
+            cpu->stall_flag = 1;
+            cpu->perf.events[PERF_STALL_STRUCTURAL]++;
+        }
 
-            case OPCODE_BZ:
-            {
-                btb->BTBentry[cpu->execute.btb_index].t_address = cpu->execute.pc + cpu->execute.imm;
+        /* Copy data from decode latch to execute latch*/
+        if(cpu->stall_flag == 0){
+        cpu->execute = cpu->decode;
+        cpu->execute_group.lanes[cpu->execute_group.count++] = cpu->decode;
+        cpu->execute_has_insn = TRUE;
+        claimed[fu_class]++;
+        }
 
-                printf("\ntarget address: %d\n", btb->BTBentry[cpu->execute.btb_index].t_address);
-                // printf("zero flag: %d",cpu->zero_flag);
-                if (cpu->zero_flag == TRUE)
-                {
-                    cpu->actual_taken = TRUE;
-                    actual(cpu, cpu->actual_taken, cpu->execute.predict_taken, cpu->execute.btb_hit_bit, cpu->execute.btb_index);
-                 
-                }
-                else
-                {
-                    cpu->actual_taken = FALSE;
-                    actual(cpu, cpu->actual_taken, cpu->execute.predict_taken, cpu->execute.btb_hit_bit, cpu->execute.btb_index);
-                }
-                break;
-            }
+        if (trace >= TRACE_STAGE)
+        {
+            print_stage_content("Decode/RF", cpu->decode);
+        }
+    }
+    APEX_decode_advance(cpu, cpu->execute_group.count);
+}
 
-            case OPCODE_BNZ:
-            {
+/*
+ * Drops the n oldest decode lanes once they have moved on. The rest stay in
+ * decode, holding fetch, and are tried again next cycle.
+ */
+void
+APEX_decode_advance(APEX_CPU *cpu, int n)
+{
+    APEX_Group *group = &cpu->decode_group;
+    int i;
 
-                btb->BTBentry[cpu->execute.btb_index].t_address = cpu->execute.pc + cpu->execute.imm;
-                printf("\ntarget address: %d\n", btb->BTBentry[cpu->execute.btb_index].t_address);
-                // printf("zero flag: %d",cpu->zero_flag);
-                if (cpu->zero_flag == FALSE)
-                {
-                    cpu->actual_taken = TRUE;
-                    actual(cpu, cpu->actual_taken, cpu->execute.predict_taken, cpu->execute.btb_hit_bit, cpu->execute.btb_index);
-                 
-                }
-                else
-                {
-                    cpu->actual_taken = FALSE;
-                    actual(cpu, cpu->actual_taken, cpu->execute.predict_taken, cpu->execute.btb_hit_bit, cpu->execute.btb_index);
-                }
-                
-                break;
+    group->count -= n;
+    for (i = 0; i < group->count; ++i)
+    {
+        group->lanes[i] = group->lanes[i + n];
+    }
+    cpu->decode_has_insn = group->count > 0;
+    cpu->stall_flag = group->count > 0;
+}
+
+/*
+ * Appends a conditional branch, JUMP or JALR leaving execute to the branch
+ * stream
+ */
+static void
+APEX_trace_branch(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    APEX_BranchRecord record;
+
+    if (stage->ops->taken)
+    {
+        record.taken = cpu->actual_taken;
+        record.target = stage->pc + stage->imm;
+        record.reg = 0;
+    }
+    else if (stage->opcode == OPCODE_JUMP || stage->opcode == OPCODE_JALR)
+    {
+        record.taken = TRUE;
+        record.target = stage->rs1_value + stage->imm;
+        record.reg = stage->opcode == OPCODE_JALR ? stage->rd : stage->rs1;
+    }
+    else
+    {
+        return;
+    }
+    record.pc = stage->pc;
+    record.imm = stage->imm;
+    record.opcode = stage->opcode;
+    record.pad = 0;
+    APEX_btrace_write(&cpu->branch_trace, &record);
+}
+
+/*
+ * Runs the instruction in cpu->execute through its execute handler, then
+ * resolves a jump's target prediction and records the branch stream.
+ * Returns TRUE if the instruction redirected fetch.
+ */
+static APEX_ALWAYS_INLINE int
+APEX_execute_insn(APEX_CPU *cpu)
+{
+    CPU_Stage *stage = cpu->execute;
+
+    /* Execute logic based on instruction type */
+    stage->ops->execute(cpu, stage);
+
+    if (cpu->branch_trace.fp)
+    {
+        APEX_trace_branch(cpu, stage);
+    }
+
+    if (stage->ops->taken)
+    {
+        return cpu->actual_taken != (stage->btb_hit_bit && stage->predict_taken);
+    }
+
+    /* The jump handlers cleared predict_taken if they redirected */
+    if (stage->opcode == OPCODE_JUMP || stage->opcode == OPCODE_JALR)
+    {
+        APEX_bpred_resolve_target(&cpu->bpred, APEX_bpred_info(&cpu->bpred, stage->bp_slot),
+                                  stage->rs1_value + stage->imm, !stage->predict_taken);
+        return !stage->predict_taken;
+    }
+    return FALSE;
+}
+
+/*
+ * Executes an instruction outside the execute latch, for the out-of-order
+ * backend issuing from its reorder buffer. Returns TRUE if the instruction
+ * redirected fetch.
+ */
+int
+APEX_cpu_execute(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    CPU_Stage *execute = cpu->execute;
+    int redirected;
+
+    cpu->execute = stage;
+    redirected = APEX_execute_insn(cpu);
+    cpu->execute = execute;
+    return redirected;
+}
+
+/*
+ * Squashes fetch and decode behind a branch or jump that redirected them
+ * and points fetch at the correct path, which it starts on the cycle after
+ * next. After a JALR fetch sits idle until the memory stage hands it the
+ * target. The execute handlers leave fetch alone, so the functional
+ * fast-forward and the out-of-order backend can share them.
+ */
+void
+APEX_cpu_redirect(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    cpu->decode_has_insn = FALSE;
+    if (stage->opcode == OPCODE_JALR)
+    {
+        cpu->fetch_has_insn = FALSE;
+        return;
+    }
+    if (stage->ops->taken)
+    {
+        cpu->pc = cpu->actual_taken ? stage->pc + stage->imm : stage->pc + 4;
+    }
+    else
+    {
+        cpu->pc = stage->memory_address;
+    }
+    cpu->fetch_from_next_cycle = TRUE;
+    cpu->fetch_has_insn = TRUE;
+}
+
+/*
+ * Counts the prediction and the flush of a branch or jump. The in-order
+ * pipeline calls this from execute and the out-of-order backend at commit,
+ * so instructions that were fast-forwarded or squashed are never counted.
+ */
+void
+APEX_cpu_count_branch(APEX_CPU *cpu, const CPU_Stage *stage, int taken, int redirected)
+{
+    if (stage->ops->taken)
+    {
+        cpu->perf.events[PERF_PREDICTED_TAKEN] += stage->btb_hit_bit && stage->predict_taken;
+        cpu->perf.events[PERF_ACTUAL_TAKEN] += taken != 0;
+        cpu->perf.events[PERF_FLUSH_BRANCH] += redirected;
+    }
+    else if (redirected)
+    {
+        cpu->perf.events[PERF_FLUSH_JUMP]++;
+    }
+}
+
+/*
+ * Execute Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static APEX_ALWAYS_INLINE void
+APEX_execute(APEX_CPU *cpu, const int trace)
+{
+    APEX_Group *group = &cpu->execute_group;
+    int redirected;
+    int slot;
+    int lane;
+
+    for (lane = 0; cpu->execute_has_insn && lane < group->count; ++lane)
+    {
+        cpu->execute = group->lanes[lane];
+        redirected = APEX_execute_insn(cpu);
+        if (redirected || cpu->execute->ops->taken)
+        {
+            APEX_cpu_count_branch(cpu, cpu->execute, cpu->actual_taken, redirected);
+        }
+        if (redirected)
+        {
+            APEX_cpu_redirect(cpu, cpu->execute);
+            if (cpu->execute->opcode == OPCODE_JALR)
+            {
+                cpu->perf.events[PERF_STALL_REDIRECT]++;
             }
+        }
 
-            case OPCODE_BP:
+        if (trace >= TRACE_FULL)
+        {
+            switch (cpu->execute->opcode)
             {
-                btb->BTBentry[cpu->execute.btb_index].t_address = cpu->execute.pc + cpu->execute.imm;
-                printf("\ntarget address: %d\n", btb->BTBentry[cpu->execute.btb_index].t_address);
-                // printf("zero flag: %d",cpu->zero_flag);
-                if (cpu->positive_flag == TRUE)
+                case OPCODE_ADDL:
                 {
-                    cpu->actual_taken = TRUE;
-                    actual(cpu, cpu->actual_taken, cpu->execute.predict_taken, cpu->execute.btb_hit_bit, cpu->execute.btb_index);
-                 
+                    printf("ADDL forwarded value %d", cpu->execute->result_buffer);
+                    break;
                 }
-                else
+
+                case OPCODE_AND:
                 {
-                    cpu->actual_taken = FALSE;
-                    actual(cpu, cpu->actual_taken, cpu->execute.predict_taken, cpu->execute.btb_hit_bit, cpu->execute.btb_index);
+                    printf("\nAND result: %d",cpu->execute->result_buffer);
+                    break;
                 }
-                break;
-            }
 
-            case OPCODE_BNP:
-            {
-                btb->BTBentry[cpu->execute.btb_index].t_address = cpu->execute.pc + cpu->execute.imm;
-                printf("\ntarget address: %d\n", btb->BTBentry[cpu->execute.btb_index].t_address);
-                // printf("zero flag: %d",cpu->zero_flag);
-                if (cpu->positive_flag == FALSE)
+                case OPCODE_MOVC:
                 {
-                    cpu->actual_taken = TRUE;
-                    actual(cpu, cpu->actual_taken, cpu->execute.predict_taken, cpu->execute.btb_hit_bit, cpu->execute.btb_index);
-                 
+                    printf("MOvc rd value: %d",cpu->execute->result_buffer);
+                    break;
                 }
-                else
+
+                case OPCODE_BZ:
+                case OPCODE_BNZ:
+                case OPCODE_BP:
+                case OPCODE_BNP:
                 {
-                    cpu->actual_taken = FALSE;
-                    actual(cpu, cpu->actual_taken, cpu->execute.predict_taken, cpu->execute.btb_hit_bit, cpu->execute.btb_index);
+                    printf("\ntarget address: %d\n", cpu->btb.entries[cpu->execute->btb_index].t_address);
+                    break;
                 }
-                break;
             }
+        }
 
-            case OPCODE_JUMP:
-            {
-                cpu->pc = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->fetch_from_next_cycle = TRUE;
-                cpu->decode.has_insn = FALSE;
-                //cpu->fetch.has_insn = TRUE;
-                break;
-            }
+        /* Issue into the unit decode found free for it */
+        APEX_fu_issue(&cpu->units, APEX_fu_class(cpu->execute->opcode),
+                      cpu->execute - cpu->slots, cpu->clock);
 
-            case OPCODE_MOVC: 
-            {
-                cpu->execute.result_buffer = cpu->execute.imm + 0;
-                printf("MOvc rd value: %d",cpu->execute.result_buffer);
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
-            }
+        if (trace >= TRACE_STAGE)
+        {
+            print_stage_content("Execute", cpu->execute);
+        }
 
-            case OPCODE_NOP:
-            {
-                break;
-            }
+        if (redirected)
+        {
+            /* Younger lanes were fetched down the wrong path */
+            break;
         }
+    }
+    cpu->execute_has_insn = FALSE;
 
-        /* Copy data from execute latch to memory latch*/
+    /* Copy data from the oldest units to memory latch once they are done,
+     * unless memory is still waiting on the data cache */
+    if (cpu->memory_has_insn)
+    {
+        return;
+    }
+    group = &cpu->memory_group;
+    group->count = 0;
+    while (group->count < cpu->width && (slot = APEX_fu_complete(&cpu->units, cpu->clock)) >= 0)
+    {
+        cpu->memory = &cpu->slots[slot];
+        group->lanes[group->count++] = cpu->memory;
+        cpu->memory_has_insn = TRUE;
+    }
+}
 
-        cpu->memory = cpu->execute;
-        cpu->execute.has_insn = FALSE;
+/*
+ * Reads the data of the store in the given memory lane. Its producer has
+ * written back by now unless it is an older lane of the same group.
+ */
+static int
+APEX_store_data(const APEX_CPU *cpu, int lane)
+{
+    int reg = cpu->memory_group.lanes[lane]->rs1;
+    const int *result;
 
-        if (ENABLE_DEBUG_MESSAGES)
+    while (--lane >= 0)
+    {
+        result = APEX_latch_result(cpu->memory_group.lanes[lane], reg);
+        if (result)
         {
-            print_stage_content("Execute", &cpu->execute);
+            return *result;
         }
     }
+    return cpu->regs[reg];
+}
+
+/*
+ * Cycles the memory stage spends on an instruction once its handler ran:
+ * the data cache latency of a load or store, and 1 for everything else,
+ * for a load served by the store buffer and when the cache is off
+ */
+static int
+APEX_dcache_latency(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    const int operands = stage->ops->operands;
+
+    if (cpu->dcache.count == 0 || !(operands & (OPERAND_LOADS | OPERAND_STORES)) ||
+        ((operands & OPERAND_LOADS) && APEX_lsq_find(&cpu->lsq, stage->memory_address) >= 0))
+    {
+        return 1;
+    }
+    return APEX_cache_access(&cpu->dcache, stage->memory_address,
+                             (operands & OPERAND_STORES) != 0);
 }
 
 /*
@@ -1436,369 +1282,1180 @@ APEX_execute(APEX_CPU *cpu)
  *
  * Note: You are free to edit this function according to your implementation
  */
-static void
-APEX_memory(APEX_CPU *cpu)
+static APEX_ALWAYS_INLINE void
+APEX_memory(APEX_CPU *cpu, const int trace)
 {
-    if (cpu->memory.has_insn)
+    int lane_latency;
+    int latency = 0;
+    int lane;
+
+    for (lane = 0; cpu->memory_has_insn && lane < cpu->memory_group.count; ++lane)
     {
-        switch (cpu->memory.opcode)
+        cpu->memory = cpu->memory_group.lanes[lane];
+
+        /* Lanes waiting on the cache accessed memory when they arrived */
+        if (cpu->memory_wait == 0)
         {
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_XOR:
+            if (cpu->memory->ops->operands & OPERAND_STORES)
             {
-                /* No work for ADD */
-                break;
+                cpu->memory->rs1_value = APEX_store_data(cpu, lane);
             }
-
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
+            cpu->memory->ops->memory(cpu, cpu->memory);
+            if (cpu->memory->opcode == OPCODE_JALR && !cpu->memory->predict_taken)
             {
-                break;
+                /* Fetch sat idle since execute redirected it */
+                cpu->pc = cpu->memory->memory_address;
+                cpu->fetch_has_insn = TRUE;
             }
 
-            case OPCODE_MUL:
-            {
-                break;
-            }
+            /* The lanes access the cache side by side */
+            lane_latency = APEX_dcache_latency(cpu, cpu->memory);
+            latency = lane_latency > latency ? lane_latency : latency;
+        }
 
-            case OPCODE_DIV:
-            {
-                break;
-            }
+        if (trace >= TRACE_STAGE)
+        {
+            print_stage_content("Memory", cpu->memory);
+        }
+    }
 
-            case OPCODE_LOAD:
-            {
-                /* Read from data memory */
-                cpu->memory.result_buffer
-                    = cpu->data_memory[cpu->memory.memory_address];
-                scoreboard.busy[cpu->decode.rd] = 0;
-                break;
-            }
+    if (cpu->memory_has_insn)
+    {
+        if (latency)
+        {
+            cpu->memory_wait = latency;
+        }
+        if (--cpu->memory_wait > 0)
+        {
+            cpu->perf.events[PERF_STALL_DCACHE]++;
+            return;
+        }
+
+        /* Copy data from memory latch to writeback latch*/
+       
+        cpu->writeback = cpu->memory;
+        cpu->writeback_group = cpu->memory_group;
+        cpu->writeback_has_insn = TRUE;
+        cpu->memory_has_insn = FALSE;
+    }
+}
+
+/*
+ * Writeback Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static APEX_ALWAYS_INLINE int
+APEX_writeback(APEX_CPU *cpu, const int trace)
+{
+    int lane;
 
-            case OPCODE_LOADP:
+    if (!cpu->writeback_has_insn)
+    {
+        return 0;
+    }
+
+    cpu->writeback_has_insn = FALSE;
+    for (lane = 0; lane < cpu->writeback_group.count; ++lane)
+    {
+        cpu->writeback = cpu->writeback_group.lanes[lane];
+       
+        /* Write result to register file based on instruction type */
+        cpu->writeback->ops->writeback(cpu, cpu->writeback);
+
+        if (trace >= TRACE_FULL)
+        {
+            switch (cpu->writeback->opcode)
             {
-                cpu->memory.result_buffer
-                    = cpu->data_memory[cpu->memory.memory_address];
-                scoreboard.busy[cpu->decode.rd] = 0;
-                if(stall_flag)
+                case OPCODE_ADD:
+                case OPCODE_SUB:
+                case OPCODE_XOR:
+                case OPCODE_AND:
+                case OPCODE_OR:
                 {
-                    stall_flag = 0;
-                    cpu->stall_0_check = TRUE;
+                    printf("write back res: %d",cpu->regs[cpu->writeback->rd]);
+                    break;
                 }
-                break;
             }
+        }
 
-            case OPCODE_STORE:
-            {
-                cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
-                break;
-            }
+        cpu->insn_completed++;
+        cpu->perf.retired[cpu->writeback->opcode]++;
+
+        if (trace >= TRACE_STAGE)
+        {
+            print_stage_content("Writeback", cpu->writeback);
+        }
+
+        if (cpu->writeback->opcode == OPCODE_HALT)
+        {
+            /* Stop the APEX simulator */
+            // return TRUE;
+            cpu->reached_halt = 1;
+        }
+    }
+
+    /* Default */
+    return 0;
+}
+void display(APEX_CPU *cpu)
+{
+    print_stage_content("fetch",cpu->fetch);
+    print_stage_content("decode",cpu->decode);
+    print_stage_content("execute",cpu->execute);
+    print_stage_content("memory",cpu->memory);
+    print_stage_content("writeback",cpu->writeback);
+    print_reg_file(cpu);
+}
+/*
+ * Empties every pipeline latch, leaving the pipeline ready to fetch from
+ * cpu->pc on the next cycle
+ */
+static void
+APEX_reset_pipeline(APEX_CPU *cpu)
+{
+    int i;
+
+    /* Every latch starts out on its own empty slot */
+    memset(cpu->slots, 0, sizeof(cpu->slots));
+    cpu->fetch = &cpu->slots[0];
+    cpu->decode = &cpu->slots[1];
+    cpu->execute = &cpu->slots[2];
+    cpu->memory = &cpu->slots[3];
+    cpu->writeback = &cpu->slots[4];
+    cpu->slot_cursor = 4;
+    for (i = 0; i < APEX_LATCH_SLOTS; ++i)
+    {
+        cpu->slots[i].ops = APEX_handler(cpu->slots[i].opcode);
+    }
+
+    cpu->decode_has_insn = FALSE;
+    cpu->execute_has_insn = FALSE;
+    cpu->memory_has_insn = FALSE;
+    cpu->writeback_has_insn = FALSE;
+    cpu->decode_group.count = 0;
+    cpu->execute_group.count = 0;
+    cpu->memory_group.count = 0;
+    cpu->writeback_group.count = 0;
+    cpu->memory_wait = 0;
+    cpu->fetch_from_next_cycle = FALSE;
+    APEX_fu_reset(&cpu->units);
+    APEX_lsq_flush(&cpu->lsq, &cpu->data_memory);
+    APEX_ifetch_flush(&cpu->ifetch);
+
+    /* To start fetch stage */
+    cpu->fetch_has_insn = TRUE;
+}
+
+/* Report names of the data cache levels */
+static const char *const dcache_names[CACHE_LEVELS] = {
+    [CACHE_L1D] = "l1d",
+    [CACHE_L2] = "l2",
+};
+
+/*
+ * This function creates and initializes APEX cpu.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+APEX_CPU *
+APEX_cpu_init(const char *filename, const APEX_Config *config)
+{
+    int i;
+    APEX_CPU *cpu;
+
+    if (!filename)
+    {
+        return NULL;
+    }
+
+    cpu = calloc(1, sizeof(APEX_CPU));
+
+    if (!cpu)
+    {
+        return NULL;
+    }
+
+    
+    /* Initialize PC, Registers and all pipeline stages */
+    cpu->pc = 4000;
+    cpu->clock = 1;
+    cpu->trace_level = config->trace_level;
+    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
+
+    if (config->width < 1 || config->width > APEX_MAX_WIDTH)
+    {
+        fprintf(stderr, "APEX_Error: The width must be 1 to %d\n", APEX_MAX_WIDTH);
+        free(cpu);
+        return NULL;
+    }
+    cpu->width = config->width;
+    cpu->idle_skip = config->idle_skip;
+
+    /* Parse input file and create code memory */
+    cpu->code_memory = APEX_load_program(filename, config->code_cache,
+                                         &cpu->code_memory_size);
+    if (!cpu->code_memory)
+    {
+        free(cpu);
+        return NULL;
+    }
+
+    /* Bind every instruction to its stage handlers once, up front */
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        APEX_bind_instruction(&cpu->code_memory[i]);
+    }
+
+    if (APEX_btb_init(&cpu->btb, config->btb_sets, config->btb_ways,
+                      config->btb_policy) != 0)
+    {
+        free(cpu->code_memory);
+        free(cpu);
+        return NULL;
+    }
+
+    if (APEX_bpred_init(&cpu->bpred, config->bpred_kind, config->bpred_entries,
+                        config->bpred_history, &cpu->btb) != 0)
+    {
+        APEX_btb_free(&cpu->btb);
+        free(cpu->code_memory);
+        free(cpu);
+        return NULL;
+    }
 
-            case OPCODE_STOREP:
+    if (APEX_memory_init(&cpu->data_memory, config->data_memory_size,
+                         config->huge_pages) != 0 ||
+        (config->data_image_file &&
+         APEX_memory_load_image(&cpu->data_memory, config->data_image_file) != 0) ||
+        APEX_bpred_init_targets(&cpu->bpred, config->ras_entries,
+                                config->itp_entries) != 0 ||
+        APEX_fu_init(&cpu->units, config->units) != 0 ||
+        APEX_lsq_init(&cpu->lsq, config->lsq_entries) != 0 ||
+        APEX_cache_init(&cpu->dcache, dcache_names, config->dcache, config->dcache_write,
+                        config->dcache_policy, config->memory_latency) != 0 ||
+        APEX_ifetch_init(&cpu->ifetch, &config->icache, config->dcache_policy,
+                         config->icache_miss_latency, config->icache_prefetch,
+                         config->fetch_buffer) != 0 ||
+        (config->backend == BACKEND_OOO &&
+         APEX_ooo_init(&cpu->ooo, config->rob_entries, config->iq_entries,
+                       config->prf_entries) != 0) ||
+        (config->branch_trace_file &&
+         APEX_btrace_open(&cpu->branch_trace, config->branch_trace_file) != 0))
+    {
+        APEX_ifetch_free(&cpu->ifetch);
+        APEX_cache_free(&cpu->dcache);
+        APEX_memory_free(&cpu->data_memory);
+        APEX_ooo_free(&cpu->ooo);
+        APEX_bpred_free(&cpu->bpred);
+        APEX_btb_free(&cpu->btb);
+        free(cpu->code_memory);
+        free(cpu);
+        return NULL;
+    }
+
+
+    if (cpu->trace_level >= TRACE_STAGE)
+    {
+        fprintf(stderr,
+                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
+                cpu->code_memory_size);
+        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
+        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
+        printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2",
+               "imm");
+
+        for (i = 0; i < cpu->code_memory_size; ++i)
+        {
+            printf("%-9s %-9d %-9d %-9d %-9d\n", APEX_mnemonic(cpu->code_memory[i].mnemonic),
+                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
+                   cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
+        }
+    }
+
+    APEX_reset_pipeline(cpu);
+    return cpu;
+}
+
+/*
+ * Simulates one clock cycle at the given trace level, returns TRUE once HALT
+ * has retired
+ */
+static APEX_ALWAYS_INLINE int
+APEX_cpu_cycle(APEX_CPU *cpu, const int trace)
+{
+    /* Stages starting this cycle with an instruction, counted unless it is
+     * the cycle HALT retires in, which the clock does not count either */
+    const int busy[5] = {cpu->fetch_has_insn, cpu->decode_has_insn, cpu->execute_has_insn,
+                         cpu->memory_has_insn, cpu->writeback_has_insn};
+    const int retired = cpu->insn_completed;
+    int i;
+
+    if (trace >= TRACE_STAGE)
+    {
+        printf("--------------------------------------------\n");
+        printf("Clock Cycle #: %d\n", cpu->clock);
+        printf("--------------------------------------------\n");
+    }
+
+    if (cpu->ooo.rob)
+    {
+        /* Rename, issue and commit take the place of decode to writeback */
+        cpu->reached_halt = APEX_ooo_cycle(cpu, trace);
+    }
+    else
+    {
+        APEX_writeback(cpu, trace);
+        APEX_memory(cpu, trace);
+        APEX_execute(cpu, trace);
+        APEX_decode(cpu, trace);
+    }
+    APEX_fetch(cpu, trace);
+
+    if (trace >= TRACE_FULL)
+    {
+        print_reg_file(cpu);
+    }
+
+    if (cpu->reached_halt)
+    {
+        return TRUE;
+    }
+    for (i = 0; i < 5; ++i)
+    {
+        cpu->perf.events[PERF_FETCH_BUSY + i] += busy[i] != 0;
+    }
+    cpu->perf.retire_width[cpu->insn_completed - retired]++;
+    APEX_lsq_cycle(&cpu->lsq, &cpu->data_memory);
+    cpu->clock++;
+    return FALSE;
+}
+
+/* What a cycle in which nothing can change leaves as it found it, and the
+ * counters before it */
+typedef struct APEX_IdleState
+{
+    int pc;
+    int has_insn;                  /* One bit per stage, fetch first */
+    int decode_lanes;
+    int buffer_pc;                 /* Fetch buffer head and fill */
+    int buffer_count;
+    long long events[PERF_COUNT];
+} APEX_IdleState;
+
+/*
+ * TRUE if a cycle of the in-order pipeline starting now may find nothing to
+ * do: writeback and execute are empty, memory is empty or still waiting on
+ * the data cache and fetch is not skipping a redirect cycle. Whether decode
+ * and fetch are stalled shows once the cycle ran.
+ */
+static APEX_ALWAYS_INLINE int
+APEX_idle_candidate(const APEX_CPU *cpu)
+{
+    return cpu->idle_skip && !cpu->ooo.rob && !cpu->writeback_has_insn &&
+           !cpu->execute_has_insn && (!cpu->memory_has_insn || cpu->memory_wait > 1) &&
+           !cpu->fetch_from_next_cycle;
+}
+
+static void
+APEX_idle_capture(const APEX_CPU *cpu, APEX_IdleState *state)
+{
+    state->pc = cpu->pc;
+    state->has_insn = cpu->fetch_has_insn | cpu->decode_has_insn << 1 |
+                      cpu->execute_has_insn << 2 | cpu->memory_has_insn << 3 |
+                      cpu->writeback_has_insn << 4;
+    state->decode_lanes = cpu->decode_group.count;
+    state->buffer_pc = cpu->ifetch.buffer.head_pc;
+    state->buffer_count = cpu->ifetch.buffer.count;
+    memcpy(state->events, cpu->perf.events, sizeof(state->events));
+}
+
+/*
+ * Called after a cycle that started as an idle candidate. If it left the
+ * pipeline as it found it, with decode stalled or empty and fetch stalled,
+ * every cycle until the next event would do the same again. The clock then
+ * jumps to that event, no further than limit, and the counters grow by
+ * what this cycle added to them as if each cycle had been simulated. The
+ * events are memory getting its data, a functional unit finishing or
+ * freeing up and a line arriving in the fetch buffer. Buffered stores
+ * drain one a cycle meanwhile.
+ */
+static void
+APEX_cpu_skip_idle(APEX_CPU *cpu, const APEX_IdleState *before, int limit)
+{
+    APEX_IdleState after;
+    int event = limit;
+    int cycles;
+    int i;
+
+    APEX_idle_capture(cpu, &after);
+    if (after.pc != before->pc || after.has_insn != before->has_insn ||
+        after.decode_lanes != before->decode_lanes || after.buffer_pc != before->buffer_pc ||
+        after.buffer_count != before->buffer_count ||
+        after.events[PERF_BTB_ALLOCATIONS] != before->events[PERF_BTB_ALLOCATIONS])
+    {
+        return;
+    }
+
+    if (cpu->memory_has_insn && cpu->clock + cpu->memory_wait - 1 < event)
+    {
+        event = cpu->clock + cpu->memory_wait - 1;
+    }
+    if (APEX_fu_next_event(&cpu->units, cpu->clock) < event)
+    {
+        event = APEX_fu_next_event(&cpu->units, cpu->clock);
+    }
+    if (APEX_ifetch_next_event(&cpu->ifetch, cpu->clock) < event)
+    {
+        event = APEX_ifetch_next_event(&cpu->ifetch, cpu->clock);
+    }
+    cycles = event - cpu->clock;
+    if (cycles <= 0)
+    {
+        return;
+    }
+
+    for (i = 0; i < PERF_COUNT; ++i)
+    {
+        cpu->perf.events[i] += (after.events[i] - before->events[i]) * cycles;
+    }
+    cpu->perf.retire_width[0] += cycles;
+    if (cpu->memory_has_insn)
+    {
+        cpu->memory_wait -= cycles;
+    }
+    APEX_lsq_idle(&cpu->lsq, &cpu->data_memory, cycles);
+    cpu->clock += cycles;
+    cpu->idle_cycles += cycles;
+}
+
+/*
+ * Simulation loop used when nothing is traced. Every stage is inlined with
+ * TRACE_OFF, so this loop carries no formatting calls at all. Cycles in
+ * which nothing can change are jumped over.
+ */
+static int
+APEX_cpu_run_silent(APEX_CPU *cpu, int num_of_cycles)
+{
+    APEX_IdleState state;
+    int idle;
+
+    while (1)
+    {
+        idle = APEX_idle_candidate(cpu);
+        if (idle)
+        {
+            APEX_idle_capture(cpu, &state);
+        }
+        if (APEX_cpu_cycle(cpu, TRACE_OFF))
+        {
+            return TRUE;
+        }
+        if (idle)
+        {
+            APEX_cpu_skip_idle(cpu, &state, num_of_cycles);
+        }
+        if (cpu->clock >= num_of_cycles)
+        {
+            return FALSE;
+        }
+    }
+}
+
+/*
+ * Simulation loop used for per-stage tracing and single stepping, returns
+ * TRUE once HALT has retired
+ */
+static int
+APEX_cpu_run_traced(APEX_CPU *cpu, int num_of_cycles)
+{
+    char user_prompt_val;
+    while(1)
+    {
+        if (cpu->single_step)
+        {
+            printf("Press any key to advance CPU Clock or <q> to quit:\n");
+            user_prompt_val = getchar();
+            if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
             {
-                cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
-                if(stall_flag)
-                {
-                    stall_flag = 0;
-                    cpu->stall_0_check = TRUE;
-                }
-                break;
+                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+                return FALSE;
             }
+        }
+
+        if (APEX_cpu_cycle(cpu, cpu->trace_level))
+        {
+            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            return TRUE;
+        }
+
+        if(!cpu->single_step && cpu->clock>=num_of_cycles){
+            return FALSE;
+        }
+    }
+}
+
+/* Prints the width with the instructions retired per cycle */
+static void
+APEX_width_report(const APEX_CPU *cpu, FILE *out)
+{
+    int i;
 
-            case OPCODE_JALR:
-            {
-                cpu->memory.result_buffer = cpu->memory.pc + 4;
-                cpu->pc = cpu->memory.memory_address;
-                cpu->fetch.has_insn = TRUE;
-                break;
-            }
+    fprintf(out, "APEX_CPU: Width %d, IPC = %.2f, cycles retiring", cpu->width,
+            cpu->clock ? (double)cpu->insn_completed / cpu->clock : 0.0);
+    for (i = 0; i <= cpu->width; ++i)
+    {
+        fprintf(out, "%s %d = %lld", i ? "," : "", i, cpu->perf.retire_width[i]);
+    }
+    fprintf(out, "\n");
+}
 
-            case OPCODE_JUMP:
-            {
-                break;
-            }
+/*
+ * APEX CPU simulation loop, returns TRUE once HALT has retired
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+int
+APEX_cpu_run(APEX_CPU *cpu, int num_of_cycles)
+{
+    int halted;
 
-            case OPCODE_NOP:
-            {
-                break;
-            }
+    APEX_ooo_sync(cpu);
+    if (cpu->single_step || cpu->trace_level >= TRACE_STAGE)
+    {
+        halted = APEX_cpu_run_traced(cpu, num_of_cycles);
+    }
+    else
+    {
+        halted = APEX_cpu_run_silent(cpu, num_of_cycles);
+
+        if (cpu->trace_level >= TRACE_SUMMARY)
+        {
+            printf("APEX_CPU: Simulation %s, cycles = %d instructions = %d\n",
+                   halted ? "Complete" : "Stopped", cpu->clock, cpu->insn_completed);
         }
+    }
 
-        /* Copy data from memory latch to writeback latch*/
-       
-        cpu->writeback = cpu->memory;
-        cpu->memory.has_insn = FALSE;
-        
-        if (ENABLE_DEBUG_MESSAGES)
+    if (halted)
+    {
+        /* Nothing runs after HALT, so buffered stores can go to memory now */
+        APEX_lsq_flush(&cpu->lsq, &cpu->data_memory);
+    }
+
+    if (cpu->trace_level >= TRACE_SUMMARY)
+    {
+        APEX_btb_report(&cpu->btb, stdout);
+        APEX_bpred_report(&cpu->bpred, cpu->clock, cpu->insn_completed, stdout);
+        APEX_bpred_report_targets(&cpu->bpred, stdout);
+        APEX_fu_report(&cpu->units, cpu->clock, cpu->perf.events[PERF_STALL_STRUCTURAL],
+                       stdout);
+        APEX_lsq_report(&cpu->lsq, cpu->perf.events[PERF_STALL_LOAD_USE], stdout);
+        APEX_cache_report(&cpu->dcache, "memory", cpu->perf.events[PERF_STALL_DCACHE],
+                          stdout);
+        APEX_ifetch_report(&cpu->ifetch, cpu->perf.events[PERF_STALL_ICACHE], stdout);
+        APEX_memory_report(&cpu->data_memory, stdout);
+        APEX_width_report(cpu, stdout);
+        if (cpu->idle_cycles)
+        {
+            printf("APEX_CPU: Idle cycles skipped = %lld (%.2f%%)\n", cpu->idle_cycles,
+                   100.0 * cpu->idle_cycles / cpu->clock);
+        }
+        if (cpu->ooo.rob)
         {
-            print_stage_content("Memory", &cpu->memory);
+            APEX_ooo_report(cpu, stdout);
         }
     }
+    return halted;
 }
 
 /*
- * Writeback Stage of APEX Pipeline
+ * Functional fast-forward. Runs instructions at the ISA level, straight from
+ * the register file through their bound handlers, with no latches,
+ * cpu->scoreboard or BTB involved. Stops after num_insns instructions (no limit
+ * when 0), on reaching stop_pc (ignored when negative), at HALT, or at the
+ * end of code memory. The pipeline is then drained so that detailed
+ * simulation continues from cpu->pc with the architectural state left here.
  *
- * Note: You are free to edit this function according to your implementation
+ * Returns the number of instructions executed
  */
-static int
-APEX_writeback(APEX_CPU *cpu)
+int
+APEX_cpu_fast_forward(APEX_CPU *cpu, int num_insns, int stop_pc)
 {
-    if (cpu->writeback.has_insn)
+    CPU_Stage insn;
+    int last_pc = (cpu->code_memory_size - 1) * 4 + 4000;
+    int count = 0;
+
+    /* Memory is accessed directly from here on */
+    APEX_lsq_flush(&cpu->lsq, &cpu->data_memory);
+    memset(&insn, 0, sizeof(insn));
+    while ((num_insns <= 0 || count < num_insns) && cpu->pc != stop_pc &&
+           cpu->pc >= 4000 && cpu->pc <= last_pc)
     {
-       
-        /* Write result to register file based on instruction type */
-        switch (cpu->writeback.opcode)
+        APEX_load_instruction(cpu, &insn, cpu->pc);
+        if (insn.opcode == OPCODE_HALT)
         {
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_XOR:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            {
-                // scoreboard.busy[cpu->writeback.rd] = 0;
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                printf("write back res: %d",cpu->regs[cpu->writeback.rd]);
-                break;
-            }
+            /* Left for the pipeline to retire */
+            break;
+        }
 
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            {
-                // scoreboard.busy[cpu->writeback.rd] = 0;
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
-            }
+        if (insn.ops->operands & OPERAND_READS_RS1)
+        {
+            insn.rs1_value = cpu->regs[insn.rs1];
+        }
+        if (insn.ops->operands & OPERAND_READS_RS2)
+        {
+            insn.rs2_value = cpu->regs[insn.rs2];
+        }
 
-            case OPCODE_MUL:
+        cpu->pc += 4;
+        if (insn.ops->taken)
+        {
+            if (insn.ops->taken(cpu))
             {
-                // scoreboard.busy[cpu->writeback.rd] = 0;
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
+                cpu->pc = insn.pc + insn.imm;
             }
-
-            case OPCODE_DIV:
+        }
+        else
+        {
+            insn.ops->execute(cpu, &insn);
+            if (insn.ops->operands & OPERAND_LOADS)
             {
-                // scoreboard.busy[cpu->writeback.rd] = 0;
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
+                insn.result_buffer = APEX_memory_read(&cpu->data_memory,
+                                                      insn.memory_address);
             }
-
-            case OPCODE_LOAD:
+            else if (insn.ops->operands & OPERAND_STORES)
             {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
+                APEX_memory_write(&cpu->data_memory, insn.memory_address, insn.rs1_value);
             }
-
-            case OPCODE_LOADP:
+            else
             {
-                // scoreboard.busy[cpu->writeback.rs1] = 0;
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->regs[cpu->writeback.rs1] = cpu->writeback.rs1_value;
-                break;
+                insn.ops->memory(cpu, &insn);
             }
+            insn.ops->writeback(cpu, &insn);
 
-            case OPCODE_STORE:
+            /* JUMP and JALR leave their target in memory_address */
+            if (insn.opcode == OPCODE_JUMP || insn.opcode == OPCODE_JALR)
             {
-                break;
+                cpu->pc = insn.memory_address;
             }
+        }
+        count++;
+    }
 
-            case OPCODE_STOREP:
-            {
-                // scoreboard.busy[cpu->writeback.rs2] = 0;
-                cpu->regs[cpu->writeback.rs2] = cpu->writeback.result_buffer;
-                break;
-            }
+    cpu->insn_fast_forwarded += count;
 
-            case OPCODE_MOVC: 
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                // scoreboard.busy[cpu->writeback.rd] = 0;
-                break;
-            }
+    /* Hand over to an empty pipeline with nothing in flight */
+    APEX_reset_pipeline(cpu);
+    cpu->scoreboard.busy = 0;
+    cpu->scoreboard.loads = 0;
+    cpu->stall_flag = 0;
+    cpu->reached_halt = 0;
 
-            case OPCODE_JALR:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
-            }
+    if (cpu->trace_level >= TRACE_SUMMARY)
+    {
+        printf("APEX_CPU: Fast-forwarded %d instructions, PC = %d\n", count, cpu->pc);
+    }
+    return count;
+}
 
-            case OPCODE_JUMP:
-            case OPCODE_CMP:
-            case OPCODE_CML:
-            {
-                break;
-            }
+/*
+ * Checkpoint file layout. The file is this record written as-is followed by
+ * the BTB, predictor, cache and data memory state, so the header also
+ * records the record size to reject files from a build with a different
+ * layout, and the file length and checksum to reject damaged ones. Handler
+ * pointers in the latch slots are not meaningful in the file and are bound
+ * again from the opcode on restore.
+ */
+typedef struct APEX_Checkpoint
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int size;             /* sizeof(APEX_Checkpoint) when written */
+    unsigned int checksum;         /* FNV-1a of the whole file with this field 0 */
+    long long length;              /* Bytes in the whole file */
+    unsigned int code_hash;        /* Program the checkpoint was taken from */
+    int code_memory_size;
+    int pc;
+    int clock;
+    int insn_completed;
+    int regs[REG_FILE_SIZE];
+    int zero_flag;
+    int positive_flag;
+    int negative_flag;
+    int fetch_from_next_cycle;
+    int target_address;
+    int actual_taken;
+    int has_insn[5];               /* fetch, decode, execute, memory, writeback */
+    int latch_slot[5];             /* Slot index each latch points at */
+    int slot_cursor;
+    int width;
+    int group_count[4];            /* decode, execute, memory, writeback */
+    int group_slot[4][APEX_MAX_WIDTH]; /* Slot index of each lane */
+    int memory_wait;
+    CPU_Stage slots[APEX_LATCH_SLOTS];
+    unsigned int scoreboard;
+    unsigned int scoreboard_loads;
+    int stall_flag;
+    APEX_FUnits units;
+    APEX_LSQ lsq;
+    APEX_FetchBuffer fetch_buffer;
+    APEX_PerfCounters perf;
+    int reached_halt;
+} APEX_Checkpoint;
+
+/* FNV-1a hash of the decoded program, ties a checkpoint to its program */
+static unsigned int
+APEX_code_hash(const APEX_CPU *cpu)
+{
+    unsigned int hash = 2166136261u;
+    int fields[5];
+    int i, j;
 
-            case OPCODE_NOP:
-            {
-                break;
-            }
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        fields[0] = cpu->code_memory[i].opcode;
+        fields[1] = cpu->code_memory[i].rd;
+        fields[2] = cpu->code_memory[i].rs1;
+        fields[3] = cpu->code_memory[i].rs2;
+        fields[4] = cpu->code_memory[i].imm;
+        for (j = 0; j < 5; ++j)
+        {
+            hash = (hash ^ (unsigned int)fields[j]) * 16777619u;
         }
+    }
+    return hash;
+}
 
-        cpu->insn_completed++;
-        cpu->writeback.has_insn = FALSE;
+/*
+ * Saves the complete simulator state to a checkpoint file, returns 0 on
+ * success and -1 on failure. The file is written under a temporary name and
+ * renamed, so a run restored from filename can checkpoint over it while its
+ * memory pages are still mapped from the old file.
+ */
+int
+APEX_cpu_checkpoint(const APEX_CPU *cpu, const char *filename)
+{
+    APEX_Checkpoint *ckpt;
+    CPU_Stage *const latches[5] = {cpu->fetch, cpu->decode, cpu->execute,
+                                   cpu->memory, cpu->writeback};
+    const APEX_Group *const groups[4] = {&cpu->decode_group, &cpu->execute_group,
+                                         &cpu->memory_group, &cpu->writeback_group};
+    char *temp;
+    FILE *fp;
+    int fd;
+    int i;
+    int j;
+    int ret = 0;
+
+    if (cpu->ooo.rob)
+    {
+        fprintf(stderr, "APEX_Error: Checkpoints are not supported with the out-of-order "
+                "backend\n");
+        return -1;
+    }
 
-        if (ENABLE_DEBUG_MESSAGES)
+    ckpt = calloc(1, sizeof(APEX_Checkpoint));
+    temp = malloc(strlen(filename) + 8);
+    if (!ckpt || !temp)
+    {
+        free(ckpt);
+        free(temp);
+        return -1;
+    }
+
+    ckpt->magic = APEX_CKPT_MAGIC;
+    ckpt->version = APEX_CKPT_VERSION;
+    ckpt->size = sizeof(APEX_Checkpoint);
+    ckpt->checksum = 0;
+    ckpt->code_hash = APEX_code_hash(cpu);
+    ckpt->code_memory_size = cpu->code_memory_size;
+    ckpt->pc = cpu->pc;
+    ckpt->clock = cpu->clock;
+    ckpt->insn_completed = cpu->insn_completed;
+    memcpy(ckpt->regs, cpu->regs, sizeof(ckpt->regs));
+    ckpt->zero_flag = cpu->zero_flag;
+    ckpt->positive_flag = cpu->positive_flag;
+    ckpt->negative_flag = cpu->negative_flag;
+    ckpt->fetch_from_next_cycle = cpu->fetch_from_next_cycle;
+    ckpt->target_address = cpu->target_address;
+    ckpt->actual_taken = cpu->actual_taken;
+    ckpt->has_insn[0] = cpu->fetch_has_insn;
+    ckpt->has_insn[1] = cpu->decode_has_insn;
+    ckpt->has_insn[2] = cpu->execute_has_insn;
+    ckpt->has_insn[3] = cpu->memory_has_insn;
+    ckpt->has_insn[4] = cpu->writeback_has_insn;
+    for (i = 0; i < 5; ++i)
+    {
+        ckpt->latch_slot[i] = latches[i] - cpu->slots;
+    }
+    ckpt->slot_cursor = cpu->slot_cursor;
+    ckpt->width = cpu->width;
+    ckpt->memory_wait = cpu->memory_wait;
+    for (i = 0; i < 4; ++i)
+    {
+        ckpt->group_count[i] = groups[i]->count;
+        for (j = 0; j < groups[i]->count; ++j)
         {
-            print_stage_content("Writeback", &cpu->writeback);
+            ckpt->group_slot[i][j] = groups[i]->lanes[j] - cpu->slots;
         }
-
-        if (cpu->writeback.opcode == OPCODE_HALT)
+    }
+    memcpy(ckpt->slots, cpu->slots, sizeof(ckpt->slots));
+    for (i = 0; i < APEX_LATCH_SLOTS; ++i)
+    {
+        ckpt->slots[i].ops = NULL;
+    }
+    ckpt->scoreboard = cpu->scoreboard.busy;
+    ckpt->scoreboard_loads = cpu->scoreboard.loads;
+    ckpt->stall_flag = cpu->stall_flag;
+    ckpt->units = cpu->units;
+    ckpt->lsq = cpu->lsq;
+    ckpt->fetch_buffer = cpu->ifetch.buffer;
+    ckpt->perf = cpu->perf;
+    ckpt->reached_halt = cpu->reached_halt;
+
+    sprintf(temp, "%s.XXXXXX", filename);
+    fd = mkstemp(temp);
+    if (fd >= 0)
+    {
+        fchmod(fd, 0644);
+    }
+    fp = fd < 0 ? NULL : fdopen(fd, "w+b");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open checkpoint %s\n", filename);
+        if (fd >= 0)
         {
-            /* Stop the APEX simulator */
-            // return TRUE;
-            reached_halt = 1;
+            close(fd);
+            unlink(temp);
         }
+        free(ckpt);
+        free(temp);
+        return -1;
     }
 
-    /* Default */
-    return 0;
+    /* The length and then the checksum go into the header once the rest
+     * of the file is written */
+    if (fwrite(ckpt, sizeof(APEX_Checkpoint), 1, fp) != 1 ||
+        APEX_btb_save(&cpu->btb, fp) != 0 || APEX_bpred_save(&cpu->bpred, fp) != 0 ||
+        APEX_cache_save(&cpu->dcache, fp) != 0 ||
+        APEX_cache_save(&cpu->ifetch.icache, fp) != 0 ||
+        APEX_memory_save(&cpu->data_memory, fp) != 0 ||
+        (ckpt->length = ftell(fp)) < 0 ||
+        fseek(fp, offsetof(APEX_Checkpoint, length), SEEK_SET) != 0 ||
+        fwrite(&ckpt->length, sizeof(ckpt->length), 1, fp) != 1 || fflush(fp) != 0 ||
+        APEX_hash_file(temp, &ckpt->checksum) != 0 ||
+        fseek(fp, offsetof(APEX_Checkpoint, checksum), SEEK_SET) != 0 ||
+        fwrite(&ckpt->checksum, sizeof(ckpt->checksum), 1, fp) != 1)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write checkpoint %s\n", filename);
+        ret = -1;
+    }
+
+    if (fclose(fp) != 0 || ret != 0 || rename(temp, filename) != 0)
+    {
+        if (ret == 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to write checkpoint %s\n", filename);
+        }
+        unlink(temp);
+        ret = -1;
+    }
+    free(ckpt);
+    free(temp);
+    return ret;
 }
-void display(APEX_CPU *cpu)
+
+/* Reports a checkpoint that does not fit this CPU, returns -1 */
+static int
+APEX_checkpoint_reject(const char *filename, const char *reason)
 {
-    print_stage_content("fetch",&cpu->fetch);
-    print_stage_content("decode",&cpu->decode);
-    print_stage_content("execute",&cpu->execute);
-    print_stage_content("memory",&cpu->memory);
-    print_stage_content("writeback",&cpu->writeback);
-    print_reg_file(cpu);
+    fprintf(stderr, "APEX_Error: Checkpoint %s %s\n", filename, reason);
+    return -1;
 }
+
 /*
- * This function creates and initializes APEX cpu.
- *
- * Note: You are free to edit this function according to your implementation
+ * Checks that the checkpoint mapped at map, length bytes long, is intact
+ * and fits this CPU, and finds where the saved BTB, predictor, data cache,
+ * instruction cache and data memory start and where the last one ends.
+ * Every latch slot, lane and queue entry that later serves as an index is
+ * range checked. Returns 0 on success and -1 after reporting why not.
  */
-APEX_CPU *
-APEX_cpu_init(const char *filename)
+static int
+APEX_checkpoint_check(const APEX_CPU *cpu, const char *map, long length,
+                      const char *filename, long sections[6])
 {
+    static const unsigned int zero = 0;
+    const APEX_Checkpoint *ckpt = (const APEX_Checkpoint *)map;
+    const long checksum_at = offsetof(APEX_Checkpoint, checksum);
+    const CPU_Stage *slot;
+    unsigned int checksum;
+    long section;
     int i;
-    APEX_CPU *cpu;
+    int j;
 
-    if (!filename)
+    if (ckpt->magic != APEX_CKPT_MAGIC)
     {
-        return NULL;
+        fprintf(stderr, "APEX_Error: %s is not a checkpoint of this build\n", filename);
+        return -1;
     }
-
-    cpu = calloc(1, sizeof(APEX_CPU));
-
-    if (!cpu)
+    if (length < (long)offsetof(APEX_Checkpoint, code_hash))
     {
-        return NULL;
+        return APEX_checkpoint_reject(filename, "is truncated");
     }
-
-    
-    btb = calloc(1, sizeof(APEX_CPU));
-
-    if(!btb)
+    if (ckpt->version != APEX_CKPT_VERSION || ckpt->size != sizeof(APEX_Checkpoint))
     {
-        return NULL;
+        fprintf(stderr, "APEX_Error: %s is not a checkpoint of this build\n", filename);
+        return -1;
     }
-
-    /* Initialize PC, Registers and all pipeline stages */
-    cpu->pc = 4000;
-    cpu->clock = 1;
-    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
-    memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
-
-    /* Parse input file and create code memory */
-    cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
-    if (!cpu->code_memory)
+    if (length < (long)sizeof(APEX_Checkpoint) || length < ckpt->length)
     {
-        free(cpu);
-        return NULL;
+        return APEX_checkpoint_reject(filename, "is truncated");
     }
 
-    for( int i=0; i<4; i++)
+    checksum = APEX_fnv1a(2166136261u, map, checksum_at);
+    checksum = APEX_fnv1a(checksum, &zero, sizeof(zero));
+    checksum = APEX_fnv1a(checksum, map + checksum_at + sizeof(zero),
+                          length - checksum_at - sizeof(zero));
+    if (length != ckpt->length || checksum != ckpt->checksum)
     {
-        btb->BTBentry[i].i_address = 0;
-        btb->BTBentry[i].h_bits[0] = 0;
-        btb->BTBentry[i].h_bits[1] = 0;
-        btb->BTBentry[i].t_address = 0;
+        return APEX_checkpoint_reject(filename, "is corrupt");
     }
 
+    if (ckpt->code_memory_size != cpu->code_memory_size ||
+        ckpt->code_hash != APEX_code_hash(cpu))
+    {
+        return APEX_checkpoint_reject(filename, "was taken from a different program");
+    }
 
-    if (ENABLE_DEBUG_MESSAGES)
+    if (ckpt->width != cpu->width)
     {
-        fprintf(stderr,
-                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
-                cpu->code_memory_size);
-        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
-        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
-        printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2",
-               "imm");
+        return APEX_checkpoint_reject(filename, "was taken with a different width");
+    }
 
-        for (i = 0; i < cpu->code_memory_size; ++i)
+    for (i = 0; i < 5; ++i)
+    {
+        if (ckpt->latch_slot[i] < 0 || ckpt->latch_slot[i] >= APEX_LATCH_SLOTS)
         {
-            printf("%-9s %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode_str,
-                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
-                   cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
+            return APEX_checkpoint_reject(filename, "is corrupt");
         }
     }
 
-    /* To start fetch stage */
-    cpu->fetch.has_insn = TRUE;
-    return cpu;
-}
-
-/*
- * APEX CPU simulation loop
- *
- * Note: You are free to edit this function according to your implementation
- */
-void
-APEX_cpu_run(APEX_CPU *cpu, int num_of_cycles)
-{
-    char user_prompt_val;
-    while(1)
+    for (i = 0; i < 4; ++i)
     {
-
-         if (cpu->single_step)
+        for (j = 0; j < APEX_MAX_WIDTH; ++j)
         {
-            printf("Press any key to advance CPU Clock or <q> to quit:\n");
-            user_prompt_val = getchar();
-            if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
+            if (ckpt->group_count[i] < 0 || ckpt->group_count[i] > cpu->width ||
+                ckpt->memory_wait < 0 ||
+                ckpt->group_slot[i][j] < 0 || ckpt->group_slot[i][j] >= APEX_LATCH_SLOTS)
             {
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                break;
+                return APEX_checkpoint_reject(filename, "is corrupt");
             }
         }
+    }
 
-        if (ENABLE_DEBUG_MESSAGES)
+    /* Registers, opcodes and BTB entries the slots index, as
+     * APEX_load_object checks its records */
+    for (i = 0; i < APEX_LATCH_SLOTS; ++i)
+    {
+        slot = &ckpt->slots[i];
+        if (APEX_isa_find(slot->opcode) < 0 || slot->rd >= REG_FILE_SIZE ||
+            slot->rs1 >= REG_FILE_SIZE || slot->rs2 >= REG_FILE_SIZE ||
+            slot->btb_index < 0 || slot->btb_index >= cpu->btb.sets * cpu->btb.ways)
         {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d\n", cpu->clock);
-            printf("--------------------------------------------\n");
+            return APEX_checkpoint_reject(filename, "holds an invalid instruction");
         }
+    }
 
-        if (APEX_writeback(cpu))
+    if (memcmp(ckpt->units.config, cpu->units.config, sizeof(cpu->units.config)) != 0)
+    {
+        return APEX_checkpoint_reject(filename, "was taken with different functional units");
+    }
+    if (ckpt->units.queue_head < 0 || ckpt->units.queue_head >= FU_MAX_INFLIGHT ||
+        ckpt->units.queue_count < 0 || ckpt->units.queue_count > FU_MAX_INFLIGHT)
+    {
+        return APEX_checkpoint_reject(filename, "is corrupt");
+    }
+    for (i = 0; i < ckpt->units.queue_count; ++i)
+    {
+        j = ckpt->units.queue_slot[(ckpt->units.queue_head + i) % FU_MAX_INFLIGHT];
+        if (j < 0 || j >= APEX_LATCH_SLOTS)
         {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-            // break;
+            return APEX_checkpoint_reject(filename, "is corrupt");
         }
+    }
 
-    
+    if (ckpt->lsq.entries != cpu->lsq.entries || ckpt->lsq.count < 0 ||
+        ckpt->lsq.count > ckpt->lsq.entries || ckpt->lsq.head < 0 ||
+        ckpt->lsq.head >= LSQ_MAX_ENTRIES)
+    {
+        return APEX_checkpoint_reject(filename,
+                                      "was taken with a different load/store queue");
+    }
+
+    if (ckpt->fetch_buffer.entries != cpu->ifetch.buffer.entries ||
+        ckpt->fetch_buffer.count < 0 ||
+        ckpt->fetch_buffer.count > ckpt->fetch_buffer.entries ||
+        ckpt->fetch_buffer.head < 0 || ckpt->fetch_buffer.head >= IFETCH_MAX_BUFFER)
+    {
+        return APEX_checkpoint_reject(filename, "was taken with a different fetch buffer");
+    }
 
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
+    sections[0] = sizeof(APEX_Checkpoint);
+    section = APEX_btb_check(&cpu->btb, map + sections[0], length - sections[0]);
+    sections[1] = sections[0] + section;
+    section = section < 0 ? -1 :
+              APEX_bpred_check(&cpu->bpred, map + sections[1], length - sections[1]);
+    if (section < 0)
+    {
+        return APEX_checkpoint_reject(filename, "was taken with a different branch "
+                                      "predictor configuration");
+    }
+    sections[2] = sections[1] + section;
 
-        print_reg_file(cpu);
+    section = APEX_cache_check(&cpu->dcache, map + sections[2], length - sections[2]);
+    if (section < 0)
+    {
+        return APEX_checkpoint_reject(filename, "was taken with a different data cache "
+                                      "configuration");
+    }
+    sections[3] = sections[2] + section;
 
-        if (reached_halt){
-            break;
-        }
-        cpu->clock++;
-        if(!cpu->single_step && cpu->clock>=num_of_cycles){
-            break;
-        }
+    section = APEX_cache_check(&cpu->ifetch.icache, map + sections[3], length - sections[3]);
+    if (section < 0)
+    {
+        return APEX_checkpoint_reject(filename, "was taken with a different instruction "
+                                      "cache configuration");
+    }
+    sections[4] = sections[3] + section;
+
+    section = APEX_memory_check(&cpu->data_memory, map + sections[4], length - sections[4],
+                                sections[4]);
+    if (section < 0)
+    {
+        return APEX_checkpoint_reject(filename, "was taken with a different data memory "
+                                      "size");
+    }
+    sections[5] = sections[4] + section;
+    if (sections[5] != length)
+    {
+        return APEX_checkpoint_reject(filename, "is corrupt");
+    }
+    return 0;
+}
+
+/*
+ * Restores the simulator state from a checkpoint file taken from the same
+ * program with the same BTB and predictor configuration. The file is mapped
+ * and checked in full, and the data memory pages are then mapped
+ * copy-on-write from it rather than copied. Returns 0 on success and -1 on
+ * failure, leaving the CPU untouched on failure.
+ */
+int
+APEX_cpu_restore(APEX_CPU *cpu, const char *filename)
+{
+    const APEX_Checkpoint *ckpt;
+    CPU_Stage **const latches[5] = {&cpu->fetch, &cpu->decode, &cpu->execute,
+                                    &cpu->memory, &cpu->writeback};
+    APEX_Group *const groups[4] = {&cpu->decode_group, &cpu->execute_group,
+                                   &cpu->memory_group, &cpu->writeback_group};
+    struct stat st;
+    long sections[6];
+    const char *map;
+    int fd;
+    int i;
+    int j;
+
+    if (cpu->ooo.rob)
+    {
+        fprintf(stderr, "APEX_Error: Checkpoints are not supported with the out-of-order "
+                "backend\n");
+        return -1;
+    }
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open checkpoint %s\n", filename);
+        return -1;
+    }
 
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(unsigned int))
+    {
+        fprintf(stderr, "APEX_Error: %s is not a checkpoint of this build\n", filename);
+        close(fd);
+        return -1;
     }
 
+    /* The descriptor stays open for the data memory pages */
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "APEX_Error: Unable to map checkpoint %s\n", filename);
+        close(fd);
+        return -1;
+    }
+    ckpt = (const APEX_Checkpoint *)map;
 
+    if (APEX_checkpoint_check(cpu, map, st.st_size, filename, sections) != 0 ||
+        APEX_btb_load(&cpu->btb, map + sections[0]) != 0)
+    {
+        munmap((void *)map, st.st_size);
+        close(fd);
+        return -1;
+    }
+    APEX_bpred_load(&cpu->bpred, map + sections[1]);
+    APEX_cache_load(&cpu->dcache, map + sections[2]);
+    APEX_cache_load(&cpu->ifetch.icache, map + sections[3]);
+    APEX_memory_load(&cpu->data_memory, map + sections[4], sections[4], fd);
+
+    cpu->pc = ckpt->pc;
+    cpu->clock = ckpt->clock;
+    cpu->insn_completed = ckpt->insn_completed;
+    cpu->branch_trace.insn_base = ckpt->insn_completed;
+    memcpy(cpu->regs, ckpt->regs, sizeof(cpu->regs));
+    cpu->zero_flag = ckpt->zero_flag;
+    cpu->positive_flag = ckpt->positive_flag;
+    cpu->negative_flag = ckpt->negative_flag;
+    cpu->fetch_from_next_cycle = ckpt->fetch_from_next_cycle;
+    cpu->target_address = ckpt->target_address;
+    cpu->actual_taken = ckpt->actual_taken;
+    cpu->fetch_has_insn = ckpt->has_insn[0];
+    cpu->decode_has_insn = ckpt->has_insn[1];
+    cpu->execute_has_insn = ckpt->has_insn[2];
+    cpu->memory_has_insn = ckpt->has_insn[3];
+    cpu->writeback_has_insn = ckpt->has_insn[4];
+    memcpy(cpu->slots, ckpt->slots, sizeof(cpu->slots));
+    for (i = 0; i < APEX_LATCH_SLOTS; ++i)
+    {
+        cpu->slots[i].mnemonic = APEX_isa_find(cpu->slots[i].opcode);
+        cpu->slots[i].ops = APEX_handler(cpu->slots[i].opcode);
+    }
+    for (i = 0; i < 5; ++i)
+    {
+        *latches[i] = &cpu->slots[ckpt->latch_slot[i]];
+    }
+    cpu->slot_cursor = ckpt->slot_cursor & (APEX_LATCH_SLOTS - 1);
+    cpu->memory_wait = ckpt->memory_wait;
+    for (i = 0; i < 4; ++i)
+    {
+        groups[i]->count = ckpt->group_count[i];
+        for (j = 0; j < ckpt->group_count[i]; ++j)
+        {
+            groups[i]->lanes[j] = &cpu->slots[ckpt->group_slot[i][j]];
+        }
+    }
+    cpu->scoreboard.busy = ckpt->scoreboard;
+    cpu->scoreboard.loads = ckpt->scoreboard_loads;
+    cpu->stall_flag = ckpt->stall_flag;
+    cpu->units = ckpt->units;
+    cpu->lsq = ckpt->lsq;
+    cpu->ifetch.buffer = ckpt->fetch_buffer;
+    cpu->perf = ckpt->perf;
+    cpu->reached_halt = ckpt->reached_halt;
+
+    munmap((void *)map, st.st_size);
+    close(fd);
+    return 0;
 }
 
 /*
@@ -1809,6 +2466,16 @@ APEX_cpu_run(APEX_CPU *cpu, int num_of_cycles)
 void
 APEX_cpu_stop(APEX_CPU *cpu)
 {
+    if (APEX_btrace_close(&cpu->branch_trace, cpu->insn_completed) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write the branch trace\n");
+    }
+    APEX_ifetch_free(&cpu->ifetch);
+    APEX_cache_free(&cpu->dcache);
+    APEX_memory_free(&cpu->data_memory);
+    APEX_ooo_free(&cpu->ooo);
+    APEX_bpred_free(&cpu->bpred);
+    APEX_btb_free(&cpu->btb);
     free(cpu->code_memory);
     free(cpu);
 }
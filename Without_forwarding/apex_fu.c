@@ -0,0 +1,267 @@
+/*
+ * apex_fu.c
+ * Contains the execute stage functional units: per-class unit reservation
+ * and the queue instructions finish in
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "apex_fu.h"
+#include "apex_isa.h"
+#include "apex_macros.h"
+
+static const char *const fu_names[FU_CLASS_COUNT] = {
+    [FU_ALU] = "alu",
+    [FU_MUL] = "mul",
+    [FU_DIV] = "div",
+    [FU_BRANCH] = "branch",
+    [FU_AGU] = "agu",
+};
+
+/* One single-cycle unit per class, the timing of the original pipeline */
+void
+APEX_fu_defaults(APEX_FUConfig *config)
+{
+    int i;
+
+    for (i = 0; i < FU_CLASS_COUNT; ++i)
+    {
+        config[i].count = 1;
+        config[i].latency = 1;
+        config[i].interval = 1;
+    }
+}
+
+/*
+ * Applies the value of a --fu=<unit>:<count>:<latency>[:<interval>] option
+ * to the configuration of that unit class. The interval defaults to 1, a
+ * fully pipelined unit. Returns 0 on success and -1 if the value is
+ * malformed.
+ */
+int
+APEX_fu_parse(APEX_FUConfig *config, const char *spec)
+{
+    const char *colon = strchr(spec, ':');
+    APEX_FUConfig unit;
+    int fields;
+    int i;
+
+    for (i = 0; colon && i < FU_CLASS_COUNT; ++i)
+    {
+        if (strlen(fu_names[i]) == (size_t)(colon - spec) &&
+            strncmp(spec, fu_names[i], colon - spec) == 0)
+        {
+            break;
+        }
+    }
+    if (!colon || i == FU_CLASS_COUNT)
+    {
+        fprintf(stderr, "APEX_Error: Unknown functional unit in %s\n", spec);
+        return -1;
+    }
+
+    unit.interval = 1;
+    fields = sscanf(colon + 1, "%d:%d:%d", &unit.count, &unit.latency, &unit.interval);
+    if (fields < 2)
+    {
+        fprintf(stderr, "APEX_Error: Functional units are given as "
+                "<unit>:<count>:<latency>[:<interval>], not %s\n", spec);
+        return -1;
+    }
+    config[i] = unit;
+    return 0;
+}
+
+/*
+ * Sets up the functional units with the given configuration of each class.
+ * Returns 0 on success and -1 if a class is out of range.
+ */
+int
+APEX_fu_init(APEX_FUnits *fu, const APEX_FUConfig *config)
+{
+    int i;
+
+    for (i = 0; i < FU_CLASS_COUNT; ++i)
+    {
+        if (config[i].count < 1 || config[i].count > FU_MAX_UNITS ||
+            config[i].latency < 1 || config[i].latency > FU_MAX_LATENCY ||
+            config[i].interval < 1 || config[i].interval > config[i].latency)
+        {
+            fprintf(stderr, "APEX_Error: The %s units need a count of 1 to %d, a latency "
+                    "of 1 to %d and an interval of 1 to the latency\n", fu_names[i],
+                    FU_MAX_UNITS, FU_MAX_LATENCY);
+            return -1;
+        }
+    }
+
+    memset(fu, 0, sizeof(APEX_FUnits));
+    memcpy(fu->config, config, sizeof(fu->config));
+    return 0;
+}
+
+/* Empties every unit, as when the pipeline is flushed for a hand-off */
+void
+APEX_fu_reset(APEX_FUnits *fu)
+{
+    memset(fu->next_issue, 0, sizeof(fu->next_issue));
+    fu->queue_head = 0;
+    fu->queue_count = 0;
+    fu->slot_mask = 0;
+}
+
+int
+APEX_fu_class(int opcode)
+{
+    return APEX_isa_unit(opcode);
+}
+
+const char *
+APEX_fu_name(int fu_class)
+{
+    return fu_names[fu_class];
+}
+
+/* Index of a unit of the class free at clock, -1 if all are busy */
+int
+APEX_fu_free(const APEX_FUnits *fu, int fu_class, int clock)
+{
+    int i;
+
+    for (i = 0; i < fu->config[fu_class].count; ++i)
+    {
+        if (fu->next_issue[fu_class][i] <= clock)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * TRUE if an instruction of the class can issue at clock next to the total
+ * instructions decode has already handed on for that cycle, claimed of them
+ * taking a unit of the same class
+ */
+int
+APEX_fu_accepts(const APEX_FUnits *fu, int fu_class, int clock, int claimed, int total)
+{
+    int free_units = 0;
+    int i;
+
+    if (fu->queue_count + total >= FU_MAX_INFLIGHT)
+    {
+        return FALSE;
+    }
+    for (i = 0; i < fu->config[fu_class].count; ++i)
+    {
+        free_units += fu->next_issue[fu_class][i] <= clock;
+    }
+    return free_units > claimed;
+}
+
+/*
+ * Starts an instruction on a free unit of the class, which the caller has
+ * checked for. Returns the cycles until its result is ready.
+ */
+int
+APEX_fu_reserve(APEX_FUnits *fu, int fu_class, int clock)
+{
+    const APEX_FUConfig *config = &fu->config[fu_class];
+    int unit = APEX_fu_free(fu, fu_class, clock);
+
+    fu->next_issue[fu_class][unit] = clock + config->interval;
+    fu->issued[fu_class]++;
+    fu->busy[fu_class] += config->interval;
+    return config->latency;
+}
+
+/*
+ * Issues the instruction in a latch slot at clock. It can leave for memory
+ * from the cycle its latency ends in.
+ */
+void
+APEX_fu_issue(APEX_FUnits *fu, int fu_class, int slot, int clock)
+{
+    int tail = (fu->queue_head + fu->queue_count) % FU_MAX_INFLIGHT;
+
+    fu->queue_slot[tail] = slot;
+    fu->queue_done[tail] = clock + APEX_fu_reserve(fu, fu_class, clock) - 1;
+    fu->queue_count++;
+    fu->slot_mask |= 1ull << slot;
+}
+
+/*
+ * Takes the oldest instruction out of its unit if it finishes by clock.
+ * Returns its latch slot, or -1 if it is still busy or no unit is in use.
+ */
+int
+APEX_fu_complete(APEX_FUnits *fu, int clock)
+{
+    int slot;
+
+    if (fu->queue_count == 0 || fu->queue_done[fu->queue_head] > clock)
+    {
+        return -1;
+    }
+
+    slot = fu->queue_slot[fu->queue_head];
+    fu->queue_head = (fu->queue_head + 1) % FU_MAX_INFLIGHT;
+    fu->queue_count--;
+    fu->slot_mask &= ~(1ull << slot);
+    return slot;
+}
+
+/*
+ * First clock from clock on in which the units can look different to the
+ * pipeline: the oldest instruction finishing, or the cycle before a busy
+ * unit frees up, when decode asks whether it can issue next cycle. INT_MAX
+ * if neither happens.
+ */
+int
+APEX_fu_next_event(const APEX_FUnits *fu, int clock)
+{
+    int event = INT_MAX;
+    int i;
+    int j;
+
+    if (fu->queue_count && fu->queue_done[fu->queue_head] >= clock)
+    {
+        event = fu->queue_done[fu->queue_head];
+    }
+    for (i = 0; i < FU_CLASS_COUNT; ++i)
+    {
+        for (j = 0; j < fu->config[i].count; ++j)
+        {
+            if (fu->next_issue[i][j] - 1 >= clock && fu->next_issue[i][j] - 1 < event)
+            {
+                event = fu->next_issue[i][j] - 1;
+            }
+        }
+    }
+    return event;
+}
+
+/* Prints the units with their use over clock cycles and the decode stalls
+ * they caused */
+void
+APEX_fu_report(const APEX_FUnits *fu, long long clock, long long stalls, FILE *out)
+{
+    const APEX_FUConfig *config;
+    int i;
+
+    fprintf(out, "APEX_CPU: Units");
+    for (i = 0; i < FU_CLASS_COUNT; ++i)
+    {
+        config = &fu->config[i];
+        fprintf(out, "%s %s %d x %d/%d issued = %lld (%.2f%% busy)", i ? "," : "",
+                fu_names[i], config->count, config->latency, config->interval,
+                fu->issued[i],
+                clock ? 100.0 * fu->busy[i] / ((double)clock * config->count) : 0.0);
+    }
+    fprintf(out, ", structural stalls = %lld\n", stalls);
+}
@@ -0,0 +1,190 @@
+/*
+ * apex_ifetch.c
+ * Contains the fetch stage front end: the L1I in front of code memory with
+ * next-line prefetch, and the fetch buffer that decouples it from decode
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "apex_ifetch.h"
+#include "apex_macros.h"
+
+static const char *const ifetch_names[CACHE_LEVELS] = {"l1i"};
+
+/*
+ * Sets up an empty L1I of the given geometry and replacement policy, with
+ * misses taking miss_latency more cycles, and a fetch buffer of entries
+ * instructions. The front end is off when the L1I has no size. Returns 0
+ * on success and -1 if a value is out of range or memory runs out.
+ */
+int
+APEX_ifetch_init(APEX_IFetch *ifetch, const APEX_CacheConfig *config, int policy,
+                 int miss_latency, int prefetch, int entries)
+{
+    APEX_CacheConfig levels[CACHE_LEVELS];
+
+    memset(ifetch, 0, sizeof(APEX_IFetch));
+    if (miss_latency < 1 || prefetch < 0 || entries < 1 || entries > IFETCH_MAX_BUFFER)
+    {
+        fprintf(stderr, "APEX_Error: The instruction cache needs a miss latency of at "
+                "least 1, a prefetch of 0 or more lines and a fetch buffer of 1 to %d "
+                "entries\n", IFETCH_MAX_BUFFER);
+        return -1;
+    }
+
+    memset(levels, 0, sizeof(levels));
+    levels[0] = *config;
+    ifetch->prefetch = prefetch;
+    ifetch->buffer.entries = entries;
+    return APEX_cache_init(&ifetch->icache, ifetch_names, levels, CACHE_WRITE_BACK, policy,
+                           miss_latency);
+}
+
+void
+APEX_ifetch_free(APEX_IFetch *ifetch)
+{
+    APEX_cache_free(&ifetch->icache);
+}
+
+/* Drops the buffered instructions, as when the pipeline is flushed */
+void
+APEX_ifetch_flush(APEX_IFetch *ifetch)
+{
+    ifetch->buffer.head = 0;
+    ifetch->buffer.count = 0;
+}
+
+/*
+ * Asks the L1I for the line after the buffered instructions when fetch is
+ * at pc, unless the buffer is full or the last line asked for has not
+ * arrived yet. A pc the buffer does not start at was redirected to, and
+ * the instructions down the old path are dropped first. A miss brings the
+ * next lines in along with it. Nothing past last_pc is fetched.
+ */
+void
+APEX_ifetch_fill(APEX_IFetch *ifetch, int pc, int last_pc, int clock)
+{
+    APEX_FetchBuffer *buffer = &ifetch->buffer;
+    const APEX_CacheConfig *config = &ifetch->icache.levels[0].config;
+    int tail;
+    int address;
+    int line_end;
+    int latency;
+    int count;
+    int i;
+
+    if (buffer->count == 0 || buffer->head_pc != pc)
+    {
+        APEX_ifetch_flush(ifetch);
+        buffer->head_pc = pc;
+    }
+
+    tail = (buffer->head + buffer->count) % IFETCH_MAX_BUFFER;
+    address = buffer->head_pc + buffer->count * 4;
+    if (buffer->count == buffer->entries || address > last_pc ||
+        (buffer->count &&
+         buffer->ready[(tail + IFETCH_MAX_BUFFER - 1) % IFETCH_MAX_BUFFER] > clock))
+    {
+        return;
+    }
+
+    latency = APEX_cache_access(&ifetch->icache, address, FALSE);
+
+    /* The rest of the line arrives with it, at least one instruction even
+     * when lines are shorter than one */
+    line_end = (address | (config->line - 1)) + 1;
+    count = (line_end - address + 3) / 4;
+    if (count > buffer->entries - buffer->count)
+    {
+        count = buffer->entries - buffer->count;
+    }
+    if (count > (last_pc - address) / 4 + 1)
+    {
+        count = (last_pc - address) / 4 + 1;
+    }
+    for (i = 0; i < count; ++i)
+    {
+        buffer->ready[(tail + i) % IFETCH_MAX_BUFFER] = clock + latency - 1;
+    }
+    buffer->count += count;
+
+    if (latency > config->latency)
+    {
+        for (i = 0; i < ifetch->prefetch; ++i)
+        {
+            if (line_end + i * config->line > last_pc)
+            {
+                break;
+            }
+            APEX_cache_prefetch(&ifetch->icache, line_end + i * config->line);
+        }
+    }
+}
+
+/* TRUE if the instruction at pc is in the buffer and can go to decode at clock */
+int
+APEX_ifetch_ready(const APEX_IFetch *ifetch, int pc, int clock)
+{
+    const APEX_FetchBuffer *buffer = &ifetch->buffer;
+
+    return buffer->count && buffer->head_pc == pc && buffer->ready[buffer->head] <= clock;
+}
+
+/* Hands the instruction at the head of the buffer to decode */
+void
+APEX_ifetch_advance(APEX_IFetch *ifetch)
+{
+    APEX_FetchBuffer *buffer = &ifetch->buffer;
+
+    buffer->head = (buffer->head + 1) % IFETCH_MAX_BUFFER;
+    buffer->count--;
+    buffer->head_pc += 4;
+}
+
+/*
+ * First clock from clock on in which fetch can find the buffer changed: the
+ * line of its head arriving, so the next instruction is ready, or that of
+ * its tail, so the next line can be asked for. INT_MAX if nothing is on
+ * the way.
+ */
+int
+APEX_ifetch_next_event(const APEX_IFetch *ifetch, int clock)
+{
+    const APEX_FetchBuffer *buffer = &ifetch->buffer;
+    int event = INT_MAX;
+    int ready;
+
+    if (buffer->count == 0)
+    {
+        return event;
+    }
+    ready = buffer->ready[buffer->head];
+    if (ready >= clock)
+    {
+        event = ready;
+    }
+    ready = buffer->ready[(buffer->head + buffer->count - 1) % IFETCH_MAX_BUFFER];
+    if (ready >= clock && ready < event)
+    {
+        event = ready;
+    }
+    return event;
+}
+
+/* Prints the L1I and fetch buffer with the cycles fetch waited on them */
+void
+APEX_ifetch_report(const APEX_IFetch *ifetch, long long stalls, FILE *out)
+{
+    if (ifetch->icache.count == 0)
+    {
+        return;
+    }
+    APEX_cache_report(&ifetch->icache, "fetch", stalls, out);
+    fprintf(out, "APEX_CPU: Fetch buffer %d entries, next-line prefetch %d lines\n",
+            ifetch->buffer.entries, ifetch->prefetch);
+}
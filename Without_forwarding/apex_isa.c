@@ -0,0 +1,108 @@
+/*
+ * apex_isa.c
+ * Contains the lookups into the instruction set table generated from
+ * apex_isa.def, and the disassembler
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "apex_isa.h"
+#include "apex_macros.h"
+
+/*
+ * Entry of the mnemonic of len characters at text, or -1 if there is no
+ * such instruction. One hash and one compare whatever the table holds.
+ */
+int
+APEX_isa_lookup(const char *text, int len)
+{
+    const int index = apex_isa_hash_slots[APEX_isa_hash(ISA_HASH_SEED, text, len)];
+
+    if (index < 0 || strncmp(apex_isa_table[index].mnemonic, text, len) != 0 ||
+        apex_isa_table[index].mnemonic[len] != '\0')
+    {
+        return -1;
+    }
+    return index;
+}
+
+/* Table entry of an interned mnemonic */
+const APEX_IsaEntry *
+APEX_isa_entry(int mnemonic)
+{
+    return &apex_isa_table[mnemonic];
+}
+
+/* Entry of an opcode, or -1 if no instruction has it */
+int
+APEX_isa_find(int opcode)
+{
+    if (opcode < 0 || opcode >= OPCODE_COUNT)
+    {
+        return -1;
+    }
+    return apex_isa_by_opcode[opcode];
+}
+
+/* Functional unit class of an opcode, opcodes without an entry go to the ALU */
+int
+APEX_isa_unit(int opcode)
+{
+    const int index = APEX_isa_find(opcode);
+
+    return index < 0 ? FU_ALU : apex_isa_table[index].unit;
+}
+
+/*
+ * Returns the text of an interned mnemonic
+ */
+const char *
+APEX_mnemonic(int mnemonic)
+{
+    return apex_isa_table[mnemonic].mnemonic;
+}
+
+/*
+ * Returns the mnemonic of an opcode, or NULL if no instruction has it
+ */
+const char *
+APEX_opcode_name(int opcode)
+{
+    const int index = APEX_isa_find(opcode);
+
+    return index < 0 ? NULL : apex_isa_table[index].mnemonic;
+}
+
+/* Prints an instruction the way it is written in assembly, operands
+ * separated by commas */
+void
+APEX_isa_print(int mnemonic, int rd, int rs1, int rs2, int imm)
+{
+    const APEX_IsaEntry *entry = &apex_isa_table[mnemonic];
+    int values[ISA_MAX_OPERANDS];
+    int i;
+
+    for (i = 0; i < ISA_MAX_OPERANDS; ++i)
+    {
+        switch (entry->operands[i])
+        {
+            case ISA_OPERAND_RD:
+                values[i] = rd;
+                break;
+            case ISA_OPERAND_RS1:
+                values[i] = rs1;
+                break;
+            case ISA_OPERAND_RS2:
+                values[i] = rs2;
+                break;
+            default:
+                values[i] = imm;
+                break;
+        }
+    }
+    printf(entry->print_format, values[0], values[1], values[2]);
+}
@@ -0,0 +1,66 @@
+/*
+ * apex_isa.h
+ * Contains the instruction set table declarations. The table itself is
+ * generated from apex_isa.def into apex_isa_gen.c at build time.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_ISA_H_
+#define _APEX_ISA_H_
+
+/* Operands of an instruction in assembly order, as named in apex_isa.def */
+#define ISA_OPERAND_NONE 0x0
+#define ISA_OPERAND_RD 0x1
+#define ISA_OPERAND_RS1 0x2
+#define ISA_OPERAND_RS2 0x3
+#define ISA_OPERAND_IMM 0x4        /* '#<number>' or the address of a label */
+#define ISA_OPERAND_OFFSET 0x5     /* '#<number>' or the distance to a label */
+#define ISA_MAX_OPERANDS 3
+
+/* Slots of the perfect hash over the mnemonics, a power of two */
+#define ISA_HASH_SLOTS 64
+
+/* Everything the assembler, the disassembler and the decoder need to know
+ * about one instruction */
+typedef struct APEX_IsaEntry
+{
+    const char *mnemonic;
+    unsigned char opcode;
+    unsigned char unit;            /* FU_* class */
+    unsigned char operand_count;
+    unsigned char operands[ISA_MAX_OPERANDS]; /* ISA_OPERAND_* */
+    int effects;                   /* OPERAND_* flags, format and extra effects */
+    const char *print_format;      /* printf format of the disassembly */
+} APEX_IsaEntry;
+
+/* Generated tables, see apex_isagen.c */
+extern const APEX_IsaEntry apex_isa_table[];
+extern const signed char apex_isa_by_opcode[];  /* Entry of each opcode, -1 if none */
+extern const signed char apex_isa_hash_slots[]; /* Entry in each hash slot, -1 if none */
+
+/* Hash of a mnemonic. apex_isagen picks the seed that puts every mnemonic
+ * in a slot of its own. */
+static inline unsigned int
+APEX_isa_hash(unsigned int seed, const char *text, int len)
+{
+    unsigned int hash = seed;
+    int i;
+
+    for (i = 0; i < len; ++i)
+    {
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    }
+    return (hash ^ (hash >> 16)) & (ISA_HASH_SLOTS - 1);
+}
+
+int APEX_isa_lookup(const char *text, int len);
+const APEX_IsaEntry *APEX_isa_entry(int mnemonic);
+int APEX_isa_find(int opcode);
+int APEX_isa_unit(int opcode);
+const char *APEX_mnemonic(int mnemonic);
+const char *APEX_opcode_name(int opcode);
+void APEX_isa_print(int mnemonic, int rd, int rs1, int rs2, int imm);
+
+#endif
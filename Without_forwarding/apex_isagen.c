@@ -0,0 +1,379 @@
+/*
+ * apex_isagen.c
+ * Build time generator of the instruction set tables. Reads apex_isa.def,
+ * checks it and writes apex_isa_gen.h with the opcode values and the
+ * effects of each instruction, and apex_isa_gen.c with the instruction
+ * table, the opcode index and the perfect hash over the mnemonics.
+ *
+ * Usage: apex_isagen <header> <source>
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "apex_isa.h"
+
+/* Largest opcode value, opcodes are held in an unsigned char */
+#define ISAGEN_MAX_OPCODE 0xff
+
+/* Entries are indexed with a signed char */
+#define ISAGEN_MAX_ENTRIES 127
+
+/* Seeds tried before giving up on a perfect hash */
+#define ISAGEN_MAX_SEEDS 1000000
+
+typedef struct ISAGen_Format
+{
+    const char *name;
+    int operands[ISA_MAX_OPERANDS];
+} ISAGen_Format;
+
+typedef struct ISAGen_Insn
+{
+    const char *name;
+    int value;
+    const char *mnemonic;
+    const char *format;
+    const char *unit;
+    const char *effects;
+} ISAGen_Insn;
+
+static const ISAGen_Format formats[] = {
+#define APEX_FORMAT(name, first, second, third) \
+    {#name, {ISA_OPERAND_##first, ISA_OPERAND_##second, ISA_OPERAND_##third}},
+#include "apex_isa.def"
+};
+
+static const ISAGen_Insn insns[] = {
+#define APEX_ISA(name, value, mnemonic, format, unit, effects, execute, memory, writeback, \
+                 taken) \
+    {#name, value, mnemonic, #format, #unit, #effects},
+#include "apex_isa.def"
+};
+
+#define ISAGEN_FORMATS (int)(sizeof(formats) / sizeof(formats[0]))
+#define ISAGEN_INSNS (int)(sizeof(insns) / sizeof(insns[0]))
+
+/* Registers each kind of operand reads or writes */
+static const char *const operand_effects[] = {
+    [ISA_OPERAND_NONE] = NULL,
+    [ISA_OPERAND_RD] = "OPERAND_WRITES_RD",
+    [ISA_OPERAND_RS1] = "OPERAND_READS_RS1",
+    [ISA_OPERAND_RS2] = "OPERAND_READS_RS2",
+    [ISA_OPERAND_IMM] = NULL,
+    [ISA_OPERAND_OFFSET] = NULL,
+};
+
+static const char *const operand_names[] = {
+    [ISA_OPERAND_NONE] = "ISA_OPERAND_NONE",
+    [ISA_OPERAND_RD] = "ISA_OPERAND_RD",
+    [ISA_OPERAND_RS1] = "ISA_OPERAND_RS1",
+    [ISA_OPERAND_RS2] = "ISA_OPERAND_RS2",
+    [ISA_OPERAND_IMM] = "ISA_OPERAND_IMM",
+    [ISA_OPERAND_OFFSET] = "ISA_OPERAND_OFFSET",
+};
+
+static const ISAGen_Format *
+find_format(const char *name)
+{
+    int i;
+
+    for (i = 0; i < ISAGEN_FORMATS; ++i)
+    {
+        if (strcmp(formats[i].name, name) == 0)
+        {
+            return &formats[i];
+        }
+    }
+    return NULL;
+}
+
+/* Operands of a format, which must come first with none after the first
+ * NONE. Returns -1 if they do not. */
+static int
+operand_count(const ISAGen_Format *format)
+{
+    int count = 0;
+    int i;
+
+    while (count < ISA_MAX_OPERANDS && format->operands[count] != ISA_OPERAND_NONE)
+    {
+        count++;
+    }
+    for (i = count; i < ISA_MAX_OPERANDS; ++i)
+    {
+        if (format->operands[i] != ISA_OPERAND_NONE)
+        {
+            return -1;
+        }
+    }
+    return count;
+}
+
+/* Checks the description. Returns 0 if it is consistent and -1, after
+ * printing what is wrong, if not. */
+static int
+check_isa(void)
+{
+    const char *p;
+    int i;
+    int j;
+
+    if (ISAGEN_INSNS > ISAGEN_MAX_ENTRIES)
+    {
+        fprintf(stderr, "APEX_Error: apex_isa.def lists more than %d instructions\n",
+                ISAGEN_MAX_ENTRIES);
+        return -1;
+    }
+    for (i = 0; i < ISAGEN_FORMATS; ++i)
+    {
+        if (operand_count(&formats[i]) < 0)
+        {
+            fprintf(stderr, "APEX_Error: Format %s has an operand after NONE\n",
+                    formats[i].name);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < ISAGEN_INSNS; ++i)
+    {
+        if (insns[i].value < 0 || insns[i].value > ISAGEN_MAX_OPCODE)
+        {
+            fprintf(stderr, "APEX_Error: %s has opcode %d outside 0 to %d\n", insns[i].name,
+                    insns[i].value, ISAGEN_MAX_OPCODE);
+            return -1;
+        }
+        if (!find_format(insns[i].format))
+        {
+            fprintf(stderr, "APEX_Error: %s has unknown format %s\n", insns[i].name,
+                    insns[i].format);
+            return -1;
+        }
+        if (insns[i].mnemonic[0] == '\0')
+        {
+            fprintf(stderr, "APEX_Error: %s has no mnemonic\n", insns[i].name);
+            return -1;
+        }
+
+        /* The assembler ends a mnemonic at these, and the disassembly
+         * format must print it as it is */
+        for (p = insns[i].mnemonic; *p; ++p)
+        {
+            if (*p <= ' ' || *p > '~' || strchr(",;:#%\"\\", *p))
+            {
+                fprintf(stderr, "APEX_Error: Mnemonic %s of %s holds '%c'\n",
+                        insns[i].mnemonic, insns[i].name, *p);
+                return -1;
+            }
+        }
+
+        for (j = 0; j < i; ++j)
+        {
+            if (strcmp(insns[i].name, insns[j].name) == 0 ||
+                strcmp(insns[i].mnemonic, insns[j].mnemonic) == 0 ||
+                insns[i].value == insns[j].value)
+            {
+                fprintf(stderr, "APEX_Error: %s and %s share a name, mnemonic or opcode\n",
+                        insns[j].name, insns[i].name);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Finds the first seed that gives every mnemonic a hash slot of its own
+ * and fills in the slots. Returns the seed, or 0 if there is none. */
+static unsigned int
+find_hash_seed(signed char *slots)
+{
+    unsigned int seed;
+    int slot;
+    int i;
+
+    for (seed = 1; seed <= ISAGEN_MAX_SEEDS; ++seed)
+    {
+        memset(slots, -1, ISA_HASH_SLOTS);
+        for (i = 0; i < ISAGEN_INSNS; ++i)
+        {
+            slot = APEX_isa_hash(seed, insns[i].mnemonic, strlen(insns[i].mnemonic));
+            if (slots[slot] >= 0)
+            {
+                break;
+            }
+            slots[slot] = i;
+        }
+        if (i == ISAGEN_INSNS)
+        {
+            return seed;
+        }
+    }
+    return 0;
+}
+
+static int
+max_opcode(void)
+{
+    int max = 0;
+    int i;
+
+    for (i = 0; i < ISAGEN_INSNS; ++i)
+    {
+        if (insns[i].value > max)
+        {
+            max = insns[i].value;
+        }
+    }
+    return max;
+}
+
+static void
+write_header(FILE *out, unsigned int seed)
+{
+    const ISAGen_Format *format;
+    int i;
+    int j;
+
+    fprintf(out, "/*\n * apex_isa_gen.h\n * Generated from apex_isa.def by apex_isagen, "
+            "do not edit\n */\n");
+    fprintf(out, "#ifndef _APEX_ISA_GEN_H_\n#define _APEX_ISA_GEN_H_\n\n");
+
+    fprintf(out, "/* Numeric OPCODE identifiers for instructions */\n");
+    for (i = 0; i < ISAGEN_INSNS; ++i)
+    {
+        fprintf(out, "#define OPCODE_%s 0x%x\n", insns[i].name, insns[i].value);
+    }
+    fprintf(out, "\n/* One past the largest opcode value, sizes the handler table */\n");
+    fprintf(out, "#define OPCODE_COUNT 0x%x\n\n", max_opcode() + 1);
+    fprintf(out, "/* Instructions in the table */\n#define ISA_COUNT %d\n\n", ISAGEN_INSNS);
+    fprintf(out, "/* Seed of the perfect hash over the mnemonics */\n");
+    fprintf(out, "#define ISA_HASH_SEED %uu\n\n", seed);
+
+    fprintf(out, "/* OPERAND_* flags of each instruction, the registers its format names\n"
+            " * and its other effects */\n");
+    for (i = 0; i < ISAGEN_INSNS; ++i)
+    {
+        format = find_format(insns[i].format);
+        fprintf(out, "#define ISA_EFFECTS_%s (", insns[i].name);
+        for (j = 0; j < ISA_MAX_OPERANDS; ++j)
+        {
+            if (operand_effects[format->operands[j]])
+            {
+                fprintf(out, "%s | ", operand_effects[format->operands[j]]);
+            }
+        }
+        fprintf(out, "%s)\n", insns[i].effects);
+    }
+    fprintf(out, "\n#endif\n");
+}
+
+static void
+write_source(FILE *out, const signed char *slots)
+{
+    const ISAGen_Format *format;
+    int count;
+    int index;
+    int i;
+    int j;
+
+    fprintf(out, "/*\n * apex_isa_gen.c\n * Generated from apex_isa.def by apex_isagen, "
+            "do not edit\n */\n");
+    fprintf(out, "#include \"apex_isa.h\"\n#include \"apex_macros.h\"\n\n");
+
+    fprintf(out, "const APEX_IsaEntry apex_isa_table[ISA_COUNT] = {\n");
+    for (i = 0; i < ISAGEN_INSNS; ++i)
+    {
+        format = find_format(insns[i].format);
+        count = operand_count(format);
+        fprintf(out, "    {\"%s\", OPCODE_%s, FU_%s, %d, {", insns[i].mnemonic, insns[i].name,
+                insns[i].unit, count);
+        for (j = 0; j < ISA_MAX_OPERANDS; ++j)
+        {
+            fprintf(out, "%s%s", j ? ", " : "", operand_names[format->operands[j]]);
+        }
+        fprintf(out, "},\n     ISA_EFFECTS_%s, \"%s", insns[i].name, insns[i].mnemonic);
+        for (j = 0; j < count; ++j)
+        {
+            fprintf(out, format->operands[j] <= ISA_OPERAND_RS2 ? ",R%%d" : ",#%%d");
+        }
+        fprintf(out, "%s\"},\n", count ? " " : "");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "const signed char apex_isa_by_opcode[OPCODE_COUNT] = {");
+    for (i = 0; i <= max_opcode(); ++i)
+    {
+        index = -1;
+        for (j = 0; j < ISAGEN_INSNS; ++j)
+        {
+            if (insns[j].value == i)
+            {
+                index = j;
+            }
+        }
+        fprintf(out, "%s%d,", i % 16 ? " " : "\n    ", index);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "const signed char apex_isa_hash_slots[ISA_HASH_SLOTS] = {");
+    for (i = 0; i < ISA_HASH_SLOTS; ++i)
+    {
+        fprintf(out, "%s%d,", i % 16 ? " " : "\n    ", slots[i]);
+    }
+    fprintf(out, "\n};\n");
+}
+
+int
+main(int argc, char const *argv[])
+{
+    signed char slots[ISA_HASH_SLOTS];
+    unsigned int seed;
+    FILE *header;
+    FILE *source;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s <header> <source>\n", argv[0]);
+        return 1;
+    }
+    if (check_isa() != 0)
+    {
+        return 1;
+    }
+    seed = find_hash_seed(slots);
+    if (!seed)
+    {
+        fprintf(stderr, "APEX_Error: No perfect hash of the mnemonics in %d slots\n",
+                ISA_HASH_SLOTS);
+        return 1;
+    }
+
+    header = fopen(argv[1], "w");
+    source = fopen(argv[2], "w");
+    if (!header || !source)
+    {
+        if (header)
+        {
+            fclose(header);
+        }
+        if (source)
+        {
+            fclose(source);
+        }
+        fprintf(stderr, "APEX_Error: Unable to write %s and %s\n", argv[1], argv[2]);
+        return 1;
+    }
+    write_header(header, seed);
+    write_source(source, slots);
+    if (fclose(header) != 0 || fclose(source) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s and %s\n", argv[1], argv[2]);
+        remove(argv[1]);
+        remove(argv[2]);
+        return 1;
+    }
+    return 0;
+}
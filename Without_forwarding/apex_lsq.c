@@ -0,0 +1,144 @@
+/*
+ * apex_lsq.c
+ * Contains the load/store queue: a store buffer in front of data memory
+ * with store-to-load forwarding
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "apex_lsq.h"
+
+/*
+ * Sets up an empty store buffer of the given number of entries. Returns 0
+ * on success and -1 if the size is out of range.
+ */
+int
+APEX_lsq_init(APEX_LSQ *lsq, int entries)
+{
+    if (entries < 1 || entries > LSQ_MAX_ENTRIES)
+    {
+        fprintf(stderr, "APEX_Error: The load/store queue needs 1 to %d entries\n",
+                LSQ_MAX_ENTRIES);
+        return -1;
+    }
+
+    memset(lsq, 0, sizeof(APEX_LSQ));
+    lsq->entries = entries;
+    return 0;
+}
+
+/* Index of the youngest buffered store to address, -1 if there is none */
+int
+APEX_lsq_find(const APEX_LSQ *lsq, int address)
+{
+    int index;
+    int i;
+
+    for (i = lsq->count - 1; i >= 0; --i)
+    {
+        index = (lsq->head + i) % LSQ_MAX_ENTRIES;
+        if (lsq->stores[index].address == address)
+        {
+            return index;
+        }
+    }
+    return -1;
+}
+
+/* Writes the oldest buffered store to data memory */
+static void
+APEX_lsq_drain(APEX_LSQ *lsq, APEX_Memory *memory)
+{
+    const APEX_StoreEntry *store = &lsq->stores[lsq->head];
+
+    APEX_memory_write(memory, store->address, store->data);
+    lsq->head = (lsq->head + 1) % LSQ_MAX_ENTRIES;
+    lsq->count--;
+}
+
+/* Reads address for a load, forwarding from the youngest older store */
+int
+APEX_lsq_load(APEX_LSQ *lsq, int address, APEX_Memory *memory)
+{
+    int index = APEX_lsq_find(lsq, address);
+
+    lsq->loads++;
+    lsq->port_busy = TRUE;
+    if (index >= 0)
+    {
+        lsq->forwarded++;
+        return lsq->stores[index].data;
+    }
+    return APEX_memory_read(memory, address);
+}
+
+/*
+ * Buffers a store. When the buffer is full the oldest store is written to
+ * make room, taking the memory port it would otherwise have used.
+ */
+void
+APEX_lsq_store(APEX_LSQ *lsq, int address, int data, APEX_Memory *memory)
+{
+    APEX_StoreEntry *store;
+
+    if (lsq->count == lsq->entries)
+    {
+        APEX_lsq_drain(lsq, memory);
+        lsq->full_drains++;
+    }
+
+    store = &lsq->stores[(lsq->head + lsq->count) % LSQ_MAX_ENTRIES];
+    store->address = address;
+    store->data = data;
+    lsq->count++;
+    lsq->stores_buffered++;
+    lsq->port_busy = TRUE;
+}
+
+/* Ends a cycle, writing the oldest store if no load or store used the port */
+void
+APEX_lsq_cycle(APEX_LSQ *lsq, APEX_Memory *memory)
+{
+    if (!lsq->port_busy && lsq->count)
+    {
+        APEX_lsq_drain(lsq, memory);
+    }
+    lsq->port_busy = FALSE;
+}
+
+/* Ends cycles cycles in which nothing used the port at once, writing the
+ * oldest store in each while there are any */
+void
+APEX_lsq_idle(APEX_LSQ *lsq, APEX_Memory *memory, int cycles)
+{
+    while (cycles-- > 0 && lsq->count)
+    {
+        APEX_lsq_drain(lsq, memory);
+    }
+    lsq->port_busy = FALSE;
+}
+
+/* Writes every buffered store, leaving data memory up to date */
+void
+APEX_lsq_flush(APEX_LSQ *lsq, APEX_Memory *memory)
+{
+    while (lsq->count)
+    {
+        APEX_lsq_drain(lsq, memory);
+    }
+}
+
+/* Prints the buffer size, its use and the load-use stalls of the run */
+void
+APEX_lsq_report(const APEX_LSQ *lsq, long long load_use, FILE *out)
+{
+    fprintf(out, "APEX_CPU: LSQ %d store entries, loads = %lld forwarded = %lld (%.2f%%) "
+            "stores = %lld full drains = %lld load-use stalls = %lld\n", lsq->entries,
+            lsq->loads, lsq->forwarded,
+            lsq->loads ? 100.0 * lsq->forwarded / lsq->loads : 0.0, lsq->stores_buffered,
+            lsq->full_drains, load_use);
+}
@@ -12,46 +12,208 @@
 #define FALSE 0x0
 #define TRUE 0x1
 
-/* Integers */
+/* Words of data memory when --data-memory is not given, and the largest
+ * allowed */
 #define DATA_MEMORY_SIZE 4096
+#define MEMORY_MAX_WORDS (1 << 28)
+
+/* Data memory is tracked in pages of 4 KB, and mapped in huge pages of
+ * 2 MB with --huge-pages=on */
+#define MEMORY_PAGE_SHIFT 10
+#define MEMORY_PAGE_WORDS (1 << MEMORY_PAGE_SHIFT)
+#define MEMORY_PAGE_BYTES (MEMORY_PAGE_WORDS * 4)
+#define MEMORY_HUGE_PAGE_BYTES (2 << 20)
+
+/* Backing of the data memory mapping */
+#define MEMORY_HUGE_OFF 0x0
+#define MEMORY_HUGE_TLB 0x1       /* Huge pages reserved by the system */
+#define MEMORY_HUGE_THP 0x2       /* Base pages the kernel may merge into huge ones */
+
+/* What --memory-checksum does once the run stops */
+#define MEMORY_CHECKSUM_OFF 0x0
+#define MEMORY_CHECKSUM_SHOW 0x1
+#define MEMORY_CHECKSUM_CHECK 0x2 /* Fail the run unless it matches */
+
+/* Bench mode: timed repetitions of each job and allowed slowdown */
+#define BENCH_DEFAULT_REPEATS 5
+#define BENCH_DEFAULT_TOLERANCE 5
 
 /* Size of integer register file */
 #define REG_FILE_SIZE 32
 
-#define BTB_SIZE 4
-
-/* Numeric OPCODE identifiers for instructions */
-#define OPCODE_ADD 0x0
-#define OPCODE_SUB 0x1
-#define OPCODE_MUL 0x2
-#define OPCODE_DIV 0x3
-#define OPCODE_AND 0x4
-#define OPCODE_OR 0x5
-#define OPCODE_XOR 0x6
-#define OPCODE_MOVC 0x7
-#define OPCODE_LOAD 0x8
-#define OPCODE_STORE 0x9
-#define OPCODE_ADDL 0x10
-#define OPCODE_SUBL 0x11
-#define OPCODE_LOADP 0x12
-#define OPCODE_STOREP 0x13
-#define OPCODE_CMP 0x14
-#define OPCODE_CML 0x15
-#define OPCODE_NOP 0x16
-#define OPCODE_BP 0x17
-#define OPCODE_BNP 0x18
-#define OPCODE_BN 0x19
-#define OPCODE_BNN 0x20
-#define OPCODE_JUMP 0x21
-#define OPCODE_JALR 0x22
-#define OPCODE_BZ 0xa
-#define OPCODE_BNZ 0xb
-#define OPCODE_HALT 0xc
-
-
-
-/* Set this flag to 1 to enable debug messages */
-#define ENABLE_DEBUG_MESSAGES 1
+/* BTB geometry used when --btb-sets and --btb-ways are not given, four
+ * entries fully associative */
+#define BTB_DEFAULT_SETS 1
+#define BTB_DEFAULT_WAYS 4
+
+/* BTB replacement policies, selected with --btb-replace=<policy> */
+#define BTB_REPLACE_LRU 0x0
+#define BTB_REPLACE_PLRU 0x1   /* Tree pseudo-LRU, needs a power of two ways */
+#define BTB_REPLACE_RANDOM 0x2
+#define BTB_REPLACE_FIFO 0x3
+
+/* Branch direction predictors, selected with --bpred=<kind> */
+#define BPRED_BTB 0x0          /* 2-bit state kept in each BTB entry */
+#define BPRED_BIMODAL 0x1
+#define BPRED_GSHARE 0x2
+#define BPRED_TOURNAMENT 0x3   /* Bimodal and gshare with a per-branch chooser */
+#define BPRED_TAGE 0x4         /* Bimodal base with tagged geometric history tables */
+#define BPRED_PERCEPTRON 0x5
+
+/* Predictor table rows used when --bpred-entries is not given */
+#define BPRED_DEFAULT_ENTRIES 4096
+
+/* Tagged tables of the TAGE predictor */
+#define BPRED_TAGE_TABLES 4
+
+/* Branches a predictor tracks between fetch and execute, a power of two
+ * larger than the number of instructions in between, reorder buffer included */
+#define APEX_BPRED_INFLIGHT 128
+
+/* Return address stack and indirect target predictor sizes used when
+ * --ras-entries and --itp-entries are not given, 0 turns either off */
+#define RAS_DEFAULT_ENTRIES 8
+#define ITP_DEFAULT_ENTRIES 256
+
+/* Where a register jump's predicted target came from */
+#define TARGET_NONE 0x0
+#define TARGET_RAS 0x1
+#define TARGET_ITP 0x2
+
+/* Cycles a JUMP or JALR loses when execute redirects fetch */
+#define TARGET_REDIRECT_PENALTY 2
+
+/* Pipeline backends, selected with --backend=<kind> */
+#define BACKEND_INORDER 0x0
+#define BACKEND_OOO 0x1        /* Rename, issue queue and reorder buffer */
+
+/* Out-of-order backend sizes used when --rob-entries, --iq-entries and
+ * --prf-entries are not given. The reorder buffer holds at most
+ * APEX_BPRED_INFLIGHT - 8 instructions, so every branch in it keeps its
+ * predictor record. */
+#define OOO_DEFAULT_ROB_ENTRIES 32
+#define OOO_DEFAULT_IQ_ENTRIES 16
+#define OOO_DEFAULT_PRF_ENTRIES 64
+
+/* The condition flags are renamed as one more architectural register */
+#define OOO_FLAGS_REG REG_FILE_SIZE
+#define OOO_ARCH_REGS (REG_FILE_SIZE + 1)
+#define OOO_MAX_DESTS 3         /* Registers one instruction can write */
+
+/* Reorder buffer entry states */
+#define OOO_WAITING 0x0        /* In the issue queue */
+#define OOO_EXECUTING 0x1
+#define OOO_DONE 0x2           /* Result written, ready to commit */
+
+/* Cycles a load spends reading memory after its address unit is done */
+#define OOO_MEMORY_LATENCY 1
+
+/* Functional unit classes of the execute stage, each configured with
+ * --fu=<unit>:<count>:<latency>[:<interval>] */
+#define FU_ALU 0x0             /* Arithmetic, logic, compares and MOVC */
+#define FU_MUL 0x1
+#define FU_DIV 0x2
+#define FU_BRANCH 0x3          /* Conditional branches, JUMP and JALR */
+#define FU_AGU 0x4             /* Address generation of loads and stores */
+#define FU_CLASS_COUNT 5
+
+/* Limits of a class, and of the instructions in flight in all units */
+#define FU_MAX_UNITS 8
+#define FU_MAX_LATENCY 64
+#define FU_MAX_INFLIGHT 16
+
+/* Store buffer entries between the memory stage and data memory used when
+ * --lsq-entries is not given, and the largest allowed */
+#define LSQ_DEFAULT_ENTRIES 8
+#define LSQ_MAX_ENTRIES 64
+
+/* Data cache levels in front of data memory, configured with --l1d and
+ * --l2. Without --l1d the memory stage reads data memory in one cycle. */
+#define CACHE_L1D 0x0
+#define CACHE_L2 0x1
+#define CACHE_LEVELS 2
+
+/* Cache write policies, selected with --cache-write=<policy> */
+#define CACHE_WRITE_BACK 0x0      /* Write-allocate, dirty lines written when evicted */
+#define CACHE_WRITE_THROUGH 0x1   /* No write-allocate, stores go on to the next level */
+
+/* Cycles data memory takes behind the last cache level when --mem-latency
+ * is not given */
+#define CACHE_DEFAULT_MEMORY_LATENCY 20
+
+/* Instruction cache in front of code memory, configured with --l1i. Without
+ * it fetch reads code memory in the cycle it asks. The defaults are the
+ * cycles a miss takes beyond the hit latency, the lines after a miss that are
+ * prefetched and the entries of the fetch buffer decode is fed from. */
+#define IFETCH_DEFAULT_MISS_LATENCY 10
+#define IFETCH_DEFAULT_PREFETCH 1
+#define IFETCH_DEFAULT_BUFFER 8
+#define IFETCH_MAX_BUFFER 32
+
+/* Instructions fetched, decoded and retired per cycle, set with --width */
+#define APEX_MAX_WIDTH 4
+
+/* Micro-op slots shared by the lanes of the five pipeline latches and the
+ * instructions in flight in the functional units, a power of two */
+#define APEX_LATCH_SLOTS 64
+
+/* Opcode values, OPCODE_COUNT and the tables behind them are generated from
+ * apex_isa.def at build time */
+#include "apex_isa_gen.h"
+
+/* Register operands an opcode reads and writes, these build the source and
+ * destination register masks of each instruction */
+#define OPERAND_READS_RS1 0x1
+#define OPERAND_READS_RS2 0x2
+#define OPERAND_WRITES_RD 0x4
+#define OPERAND_WRITES_RS1 0x8
+#define OPERAND_WRITES_RS2 0x10
+#define OPERAND_READS_FLAGS 0x20  /* Branch conditions and partial flag updates */
+#define OPERAND_WRITES_FLAGS 0x40
+#define OPERAND_LOADS 0x80        /* Reads data memory in the memory stage */
+#define OPERAND_STORES 0x100      /* Writes data memory, with rs1 as the data */
+
+/* Flag effects named in apex_isa.def */
+#define ISA_SETS_FLAGS OPERAND_WRITES_FLAGS
+#define ISA_UPDATES_FLAGS (OPERAND_READS_FLAGS | OPERAND_WRITES_FLAGS)
+
+
+
+/* Checkpoint file identification, bump the version when the layout changes */
+#define APEX_CKPT_MAGIC 0x54504B43 /* "CKPT" */
+#define APEX_CKPT_VERSION 13
+
+/* Branch stream written with --branch-trace, records buffered per write */
+#define APEX_BTRACE_MAGIC 0x54535242 /* "BRST" */
+#define APEX_BTRACE_VERSION 1
+#define APEX_BTRACE_BUFFER 4096
+
+/* Assembled program written by the assemble mode and --code-cache, and the
+ * suffix of the cached copy next to its source */
+#define APEX_OBJECT_MAGIC 0x4F585041 /* "APXO" */
+#define APEX_OBJECT_VERSION 1
+#define APEX_OBJECT_SUFFIX ".apexo"
+
+/* Runtime trace levels, selected with --trace=<level> */
+#define TRACE_OFF 0x0     /* No output while simulating */
+#define TRACE_SUMMARY 0x1 /* Cycle and instruction counts at the end of a run */
+#define TRACE_STAGE 0x2   /* Per-cycle stage contents */
+#define TRACE_FULL 0x3    /* Stage contents, register file, BTB and debug messages */
+
+/* Formats of the --perf-report file, selected with --perf-format=<format> */
+#define PERF_FORMAT_JSON 0x0
+#define PERF_FORMAT_CSV 0x1
+
+/* Trace level used when --trace is not given */
+#define DEFAULT_TRACE_LEVEL TRACE_FULL
+
+/* Stage functions are forced inline into each run loop, so the loop that runs
+ * with TRACE_OFF is compiled without any of the formatting calls */
+#if defined(__GNUC__)
+#define APEX_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define APEX_ALWAYS_INLINE inline
+#endif
 
 /* Set this flag to 1 to enable cycle single-step mode */
 #define ENABLE_SINGLE_STEP 1
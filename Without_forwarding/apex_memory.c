@@ -0,0 +1,602 @@
+/*
+ * apex_memory.c
+ * Contains the paged data memory: an anonymous mapping of the configured
+ * address space, allocated by the kernel a page at a time on first touch,
+ * with the pages written to tracked for listing and checkpoints, and the
+ * images it is loaded from and dumped to
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "apex_memory.h"
+#include "apex_macros.h"
+
+static const char *const memory_backings[] = {
+    [MEMORY_HUGE_OFF] = "base pages",
+    [MEMORY_HUGE_TLB] = "huge pages",
+    [MEMORY_HUGE_THP] = "transparent huge pages",
+};
+
+/* Start of the memory state in a checkpoint, followed by the index of every
+ * touched page and then, from the next multiple of MEMORY_PAGE_BYTES in the
+ * file, their MEMORY_PAGE_WORDS words each. The alignment lets a restore
+ * map the pages from the file. */
+typedef struct APEX_MemoryState
+{
+    int size;
+    int pages_touched;
+    long long out_of_range;
+} APEX_MemoryState;
+
+/*
+ * Maps the value of a --huge-pages=<on|off> option to MEMORY_HUGE_OFF or
+ * MEMORY_HUGE_TLB, returns -1 if the value is unknown
+ */
+int
+APEX_memory_parse_huge(const char *name)
+{
+    if (strcmp(name, "off") == 0)
+    {
+        return MEMORY_HUGE_OFF;
+    }
+    if (strcmp(name, "on") == 0)
+    {
+        return MEMORY_HUGE_TLB;
+    }
+    return -1;
+}
+
+/*
+ * Reserves an address space of size words, all reading as 0. With huge
+ * set to MEMORY_HUGE_TLB it is backed by huge pages if the system has
+ * enough reserved, and otherwise asks for transparent huge pages. Returns 0
+ * on success and -1 if the size is out of range or the mapping fails.
+ */
+int
+APEX_memory_init(APEX_Memory *memory, int size, int huge)
+{
+    void *map = MAP_FAILED;
+    size_t bytes;
+
+    memset(memory, 0, sizeof(APEX_Memory));
+    if (size < 1 || size > MEMORY_MAX_WORDS)
+    {
+        fprintf(stderr, "APEX_Error: The data memory needs 1 to %d words\n",
+                MEMORY_MAX_WORDS);
+        return -1;
+    }
+
+    memory->size = size;
+    memory->pages = (size + MEMORY_PAGE_WORDS - 1) >> MEMORY_PAGE_SHIFT;
+    bytes = (size_t)memory->pages * MEMORY_PAGE_WORDS * sizeof(int);
+    memory->mapped = bytes;
+
+    if (huge != MEMORY_HUGE_OFF)
+    {
+        memory->mapped = (bytes + MEMORY_HUGE_PAGE_BYTES - 1) &
+                         ~(size_t)(MEMORY_HUGE_PAGE_BYTES - 1);
+#ifdef MAP_HUGETLB
+        /* Reserved up front, so a shortage fails here and not on a touch */
+        map = mmap(NULL, memory->mapped, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        memory->huge = MEMORY_HUGE_TLB;
+#endif
+    }
+    if (map == MAP_FAILED)
+    {
+        map = mmap(NULL, memory->mapped, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        memory->huge = MEMORY_HUGE_OFF;
+#ifdef MADV_HUGEPAGE
+        if (map != MAP_FAILED && huge != MEMORY_HUGE_OFF &&
+            madvise(map, memory->mapped, MADV_HUGEPAGE) == 0)
+        {
+            memory->huge = MEMORY_HUGE_THP;
+        }
+#endif
+    }
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "APEX_Error: Unable to map %d words of data memory\n", size);
+        memory->mapped = 0;
+        return -1;
+    }
+
+    memory->words = map;
+    memory->touched = calloc(memory->pages, sizeof(unsigned char));
+    if (!memory->touched)
+    {
+        APEX_memory_free(memory);
+        return -1;
+    }
+    return 0;
+}
+
+void
+APEX_memory_free(APEX_Memory *memory)
+{
+    if (memory->words)
+    {
+        munmap(memory->words, memory->mapped);
+    }
+    free(memory->touched);
+    memory->words = NULL;
+    memory->touched = NULL;
+}
+
+/* Zeroes every touched page, leaving the address space as after init */
+void
+APEX_memory_clear(APEX_Memory *memory)
+{
+    int i;
+
+    for (i = 0; i < memory->pages; ++i)
+    {
+        if (memory->touched[i])
+        {
+            memset(memory->words + ((size_t)i << MEMORY_PAGE_SHIFT), 0,
+                   MEMORY_PAGE_WORDS * sizeof(int));
+            memory->touched[i] = FALSE;
+        }
+    }
+    memory->pages_touched = 0;
+    memory->out_of_range = 0;
+}
+
+/*
+ * First address from address on holding a non-zero word, -1 if there is
+ * none. Pages never written to are skipped whole.
+ */
+int
+APEX_memory_next(const APEX_Memory *memory, int address)
+{
+    int end;
+
+    if (address < 0)
+    {
+        address = 0;
+    }
+    while (address < memory->size)
+    {
+        end = ((address >> MEMORY_PAGE_SHIFT) + 1) << MEMORY_PAGE_SHIFT;
+        if (end > memory->size)
+        {
+            end = memory->size;
+        }
+        if (!memory->touched[address >> MEMORY_PAGE_SHIFT])
+        {
+            address = end;
+            continue;
+        }
+        for (; address < end; ++address)
+        {
+            if (memory->words[address])
+            {
+                return address;
+            }
+        }
+    }
+    return -1;
+}
+
+/* Marks the pages holding the first words of the address space touched */
+static void
+APEX_memory_touch_prefix(APEX_Memory *memory, long words)
+{
+    int i;
+
+    for (i = 0; i < (words + MEMORY_PAGE_WORDS - 1) >> MEMORY_PAGE_SHIFT; ++i)
+    {
+        if (!memory->touched[i])
+        {
+            memory->touched[i] = TRUE;
+            memory->pages_touched++;
+        }
+    }
+}
+
+/*
+ * Places a binary image of words, address 0 first, at the start of the
+ * address space. The file is mapped copy-on-write over it, so nothing is
+ * copied until the program writes to a page. Huge pages cannot take a
+ * file mapping and get the image read into them instead.
+ */
+static int
+APEX_memory_map_binary(APEX_Memory *memory, int fd, const char *filename, long bytes)
+{
+    void *map;
+    char *dest = (char *)memory->words;
+    ssize_t got;
+    long done;
+
+    if (bytes % sizeof(int) != 0 || bytes / (long)sizeof(int) > memory->size)
+    {
+        fprintf(stderr, "APEX_Error: Data image %s is not a whole number of words within "
+                "the %d words of data memory\n", filename, memory->size);
+        return -1;
+    }
+
+    if (memory->huge != MEMORY_HUGE_TLB)
+    {
+        map = mmap(memory->words, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                   fd, 0);
+        if (map != MAP_FAILED)
+        {
+            APEX_memory_touch_prefix(memory, bytes / sizeof(int));
+            return 0;
+        }
+    }
+
+    for (done = 0; done < bytes; done += got)
+    {
+        got = read(fd, dest + done, bytes - done);
+        if (got <= 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to read data image %s\n", filename);
+            return -1;
+        }
+    }
+    APEX_memory_touch_prefix(memory, bytes / sizeof(int));
+    return 0;
+}
+
+/*
+ * Writes the <address>:<value> lines of a text image, as written by
+ * APEX_memory_dump. Numbers are read as C integer literals, so 0x gives
+ * hexadecimal, and blank lines and everything after a # are skipped.
+ */
+static int
+APEX_memory_read_text(APEX_Memory *memory, FILE *fp, const char *filename)
+{
+    char line[256];
+    char *p;
+    char *end;
+    long address;
+    long value;
+    int number = 0;
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        number++;
+        p = strchr(line, '#');
+        if (p)
+        {
+            *p = '\0';
+        }
+        for (p = line; isspace((unsigned char)*p); ++p)
+        {
+        }
+        if (*p == '\0')
+        {
+            continue;
+        }
+
+        address = strtol(p, &end, 0);
+        if (end == p || *end != ':')
+        {
+            fprintf(stderr, "APEX_Error: Line %d of data image %s is not "
+                    "<address>:<value>\n", number, filename);
+            return -1;
+        }
+        p = end + 1;
+        value = strtol(p, &end, 0);
+        while (isspace((unsigned char)*end))
+        {
+            end++;
+        }
+        if (end == p || *end != '\0')
+        {
+            fprintf(stderr, "APEX_Error: Line %d of data image %s is not "
+                    "<address>:<value>\n", number, filename);
+            return -1;
+        }
+        if (address < 0 || address >= memory->size)
+        {
+            fprintf(stderr, "APEX_Error: Line %d of data image %s is outside the %d words "
+                    "of data memory\n", number, filename, memory->size);
+            return -1;
+        }
+        APEX_memory_write(memory, (int)address, (int)value);
+    }
+    return 0;
+}
+
+/*
+ * Loads the initial contents of data memory from filename, either a binary
+ * image of native words from address 0 on or a text image of
+ * <address>:<value> lines. A file with a NUL byte in its first 4 KB is
+ * taken as binary. Returns 0 on success and -1 if the file cannot be read
+ * or does not fit.
+ */
+int
+APEX_memory_load_image(APEX_Memory *memory, const char *filename)
+{
+    char head[4096];
+    struct stat st;
+    ssize_t got;
+    FILE *fp;
+    int fd;
+    int ret;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open data image %s\n", filename);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    got = pread(fd, head, sizeof(head), 0);
+    if (got < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to read data image %s\n", filename);
+        close(fd);
+        return -1;
+    }
+    if (memchr(head, '\0', got))
+    {
+        ret = APEX_memory_map_binary(memory, fd, filename, st.st_size);
+        close(fd);
+        return ret;
+    }
+
+    fp = fdopen(fd, "r");
+    if (!fp)
+    {
+        close(fd);
+        return -1;
+    }
+    ret = APEX_memory_read_text(memory, fp, filename);
+    fclose(fp);
+    return ret;
+}
+
+/*
+ * Writes every non-zero word as an <address>:<value> line, the text image
+ * APEX_memory_load_image reads back. Returns 0 on success and -1 if the
+ * file cannot be written.
+ */
+int
+APEX_memory_dump(const APEX_Memory *memory, const char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+    int ret = 0;
+    int i;
+
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open data dump %s\n", filename);
+        return -1;
+    }
+
+    fprintf(fp, "# APEX data memory, %d words\n", memory->size);
+    for (i = APEX_memory_next(memory, 0); i >= 0; i = APEX_memory_next(memory, i + 1))
+    {
+        fprintf(fp, "%d:%d\n", i, memory->words[i]);
+    }
+
+    if (ferror(fp))
+    {
+        ret = -1;
+    }
+    if (fclose(fp) != 0 || ret != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write data dump %s\n", filename);
+        ret = -1;
+    }
+    return ret;
+}
+
+/*
+ * FNV-1a hash of the address and value of every non-zero word, so it only
+ * depends on what the program left in memory and not on the pages it
+ * touched or the size of the address space
+ */
+unsigned int
+APEX_memory_checksum(const APEX_Memory *memory)
+{
+    unsigned int hash = 2166136261u;
+    int word[2];
+    int i;
+    int j;
+
+    for (i = APEX_memory_next(memory, 0); i >= 0; i = APEX_memory_next(memory, i + 1))
+    {
+        word[0] = i;
+        word[1] = memory->words[i];
+        for (j = 0; j < (int)sizeof(word); ++j)
+        {
+            hash = (hash ^ ((const unsigned char *)word)[j]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+/* Prints the address space, how much of it was touched and the accesses
+ * that fell outside it */
+void
+APEX_memory_report(const APEX_Memory *memory, FILE *out)
+{
+    fprintf(out, "APEX_CPU: Data memory %d words in %s, pages touched = %d of %d "
+            "(%lld KB), out-of-range accesses = %lld\n", memory->size,
+            memory_backings[memory->huge], memory->pages_touched, memory->pages,
+            (long long)memory->pages_touched * MEMORY_PAGE_WORDS * (long long)sizeof(int) / 1024,
+            memory->out_of_range);
+}
+
+/* Bytes of padding from offset in a checkpoint to the page data */
+static long
+APEX_memory_padding(long offset)
+{
+    return (MEMORY_PAGE_BYTES - offset % MEMORY_PAGE_BYTES) % MEMORY_PAGE_BYTES;
+}
+
+/*
+ * Appends the touched pages to a checkpoint, returns 0 on success and -1
+ * if the write fails
+ */
+int
+APEX_memory_save(const APEX_Memory *memory, FILE *fp)
+{
+    static const char zeros[MEMORY_PAGE_BYTES];
+    APEX_MemoryState state;
+    long offset;
+    int i;
+
+    memset(&state, 0, sizeof(state));
+    state.size = memory->size;
+    state.pages_touched = memory->pages_touched;
+    state.out_of_range = memory->out_of_range;
+    if (fwrite(&state, sizeof(state), 1, fp) != 1)
+    {
+        return -1;
+    }
+    for (i = 0; i < memory->pages; ++i)
+    {
+        if (memory->touched[i] && fwrite(&i, sizeof(int), 1, fp) != 1)
+        {
+            return -1;
+        }
+    }
+
+    offset = ftell(fp);
+    if (offset < 0 ||
+        fwrite(zeros, 1, APEX_memory_padding(offset), fp) != (size_t)APEX_memory_padding(offset))
+    {
+        return -1;
+    }
+    for (i = 0; i < memory->pages; ++i)
+    {
+        if (memory->touched[i] &&
+            fwrite(memory->words + ((size_t)i << MEMORY_PAGE_SHIFT), sizeof(int),
+                   MEMORY_PAGE_WORDS, fp) != MEMORY_PAGE_WORDS)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Checks that data, found at offset in its checkpoint, holds memory saved
+ * by APEX_memory_save from an address space of the same size. Returns its
+ * length or -1.
+ */
+long
+APEX_memory_check(const APEX_Memory *memory, const void *data, long size, long offset)
+{
+    APEX_MemoryState state;
+    long length;
+    int previous = -1;
+    int page;
+    int i;
+
+    if (size < (long)sizeof(APEX_MemoryState))
+    {
+        return -1;
+    }
+    memcpy(&state, data, sizeof(state));
+    if (state.size != memory->size || state.pages_touched < 0 ||
+        state.pages_touched > memory->pages ||
+        size - (long)sizeof(APEX_MemoryState) < state.pages_touched * (long)sizeof(int))
+    {
+        return -1;
+    }
+
+    /* Saved in ascending order, so each page appears once */
+    length = sizeof(APEX_MemoryState);
+    for (i = 0; i < state.pages_touched; ++i)
+    {
+        memcpy(&page, (const char *)data + length, sizeof(int));
+        if (page <= previous || page >= memory->pages)
+        {
+            return -1;
+        }
+        previous = page;
+        length += sizeof(int);
+    }
+
+    length += APEX_memory_padding(offset + length) +
+              state.pages_touched * (long)MEMORY_PAGE_BYTES;
+    return length <= size ? length : -1;
+}
+
+/*
+ * Places count pages from first on. They are mapped copy-on-write from fd
+ * at offset, so nothing is read until the program touches a page, unless
+ * fd is -1, the memory is in huge pages or the system pages do not fit;
+ * then they are copied from data.
+ */
+static void
+APEX_memory_place(APEX_Memory *memory, int first, int count, const char *data, int fd,
+                  long offset)
+{
+    int *dest = memory->words + ((size_t)first << MEMORY_PAGE_SHIFT);
+    size_t bytes = (size_t)count * MEMORY_PAGE_BYTES;
+
+    if (fd >= 0 && memory->huge != MEMORY_HUGE_TLB &&
+        mmap(dest, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset) !=
+        MAP_FAILED)
+    {
+        return;
+    }
+    memcpy(dest, data, bytes);
+}
+
+/*
+ * Loads memory that passed APEX_memory_check over a cleared address space.
+ * data is the mapping of the checkpoint open as fd at offset, and runs of
+ * consecutive pages are mapped from it in one go.
+ */
+void
+APEX_memory_load(APEX_Memory *memory, const void *data, long offset, int fd)
+{
+    const char *indices = (const char *)data + sizeof(APEX_MemoryState);
+    const char *pages;
+    APEX_MemoryState state;
+    long length;
+    int first;
+    int page;
+    int i;
+    int j;
+
+    APEX_memory_clear(memory);
+    memcpy(&state, data, sizeof(state));
+    length = sizeof(APEX_MemoryState) + state.pages_touched * (long)sizeof(int);
+    length += APEX_memory_padding(offset + length);
+    pages = (const char *)data + length;
+
+    for (i = 0; i < state.pages_touched; i = j)
+    {
+        memcpy(&first, indices + i * sizeof(int), sizeof(int));
+        for (j = i + 1; j < state.pages_touched; ++j)
+        {
+            memcpy(&page, indices + j * sizeof(int), sizeof(int));
+            if (page != first + (j - i))
+            {
+                break;
+            }
+        }
+        APEX_memory_place(memory, first, j - i, pages + (long)i * MEMORY_PAGE_BYTES, fd,
+                          offset + length + (long)i * MEMORY_PAGE_BYTES);
+        for (page = first; page < first + (j - i); ++page)
+        {
+            memory->touched[page] = TRUE;
+        }
+    }
+    memory->pages_touched = state.pages_touched;
+    memory->out_of_range = state.out_of_range;
+}
@@ -0,0 +1,85 @@
+/*
+ * apex_memory.h
+ * Contains the paged data memory declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_MEMORY_H_
+#define _APEX_MEMORY_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "apex_macros.h"
+
+/* Word addressed data memory of size words. The whole address space is one
+ * anonymous mapping the kernel backs a page at a time on first touch, and
+ * the pages written to are tracked so they can be listed without scanning
+ * the rest. Reads and writes outside the address space are counted and
+ * read as 0 or dropped. */
+typedef struct APEX_Memory
+{
+    int *words;                    /* NULL until APEX_memory_init */
+    unsigned char *touched;        /* One flag per page written to */
+    size_t mapped;                 /* Bytes of the mapping */
+    int size;                      /* Words of address space, from --data-memory */
+    int pages;                     /* Of MEMORY_PAGE_WORDS words */
+    int pages_touched;
+    int huge;                      /* One of MEMORY_HUGE_* */
+    long long out_of_range;        /* Accesses outside the address space */
+} APEX_Memory;
+
+int APEX_memory_parse_huge(const char *name);
+int APEX_memory_init(APEX_Memory *memory, int size, int huge);
+void APEX_memory_free(APEX_Memory *memory);
+void APEX_memory_clear(APEX_Memory *memory);
+int APEX_memory_next(const APEX_Memory *memory, int address);
+int APEX_memory_load_image(APEX_Memory *memory, const char *filename);
+int APEX_memory_dump(const APEX_Memory *memory, const char *filename);
+unsigned int APEX_memory_checksum(const APEX_Memory *memory);
+void APEX_memory_report(const APEX_Memory *memory, FILE *out);
+int APEX_memory_save(const APEX_Memory *memory, FILE *fp);
+long APEX_memory_check(const APEX_Memory *memory, const void *data, long size, long offset);
+void APEX_memory_load(APEX_Memory *memory, const void *data, long offset, int fd);
+
+/* TRUE if address is inside the address space, one unsigned compare */
+static inline int
+APEX_memory_contains(const APEX_Memory *memory, int address)
+{
+    return (unsigned int)address < (unsigned int)memory->size;
+}
+
+/* Word at address, 0 outside the address space */
+static inline int
+APEX_memory_read(APEX_Memory *memory, int address)
+{
+    if (!APEX_memory_contains(memory, address))
+    {
+        memory->out_of_range++;
+        return 0;
+    }
+    return memory->words[address];
+}
+
+/* Writes the word at address, marking its page touched */
+static inline void
+APEX_memory_write(APEX_Memory *memory, int address, int value)
+{
+    const int page = address >> MEMORY_PAGE_SHIFT;
+
+    if (!APEX_memory_contains(memory, address))
+    {
+        memory->out_of_range++;
+        return;
+    }
+    if (!memory->touched[page])
+    {
+        memory->touched[page] = TRUE;
+        memory->pages_touched++;
+    }
+    memory->words[address] = value;
+}
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * apex_perf.h
+ * Contains the pipeline event counters and the end-of-run report
+ * declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_PERF_H_
+#define _APEX_PERF_H_
+
+#include "apex_macros.h"
+
+struct APEX_CPU;
+
+/* Events counted by the pipeline, indices into APEX_PerfCounters.events */
+#define PERF_FETCH_BUSY 0          /* Cycles a stage started with an instruction */
+#define PERF_DECODE_BUSY 1
+#define PERF_EXECUTE_BUSY 2
+#define PERF_MEMORY_BUSY 3
+#define PERF_WRITEBACK_BUSY 4
+#define PERF_STALL_SCOREBOARD 5    /* Decode held on a register with a write in flight */
+#define PERF_STALL_LOAD_USE 6      /* Decode held on a result a load is fetching */
+#define PERF_STALL_REDIRECT 7      /* Fetch idle while it is redirected */
+#define PERF_BTB_ALLOCATIONS 8
+#define PERF_PREDICTED_TAKEN 9     /* Conditional branches fetched down the taken path */
+#define PERF_ACTUAL_TAKEN 10
+#define PERF_FLUSH_BRANCH 11       /* Mispredicted branches squashing fetch and decode */
+#define PERF_FLUSH_JUMP 12         /* JUMP and JALR squashing fetch and decode */
+#define PERF_STALL_ROB_FULL 13     /* Rename held by the out-of-order backend */
+#define PERF_STALL_IQ_FULL 14
+#define PERF_STALL_FREE_LIST 15
+#define PERF_FLUSH_SQUASHED 16     /* Instructions removed from the reorder buffer */
+#define PERF_ROB_OCCUPANCY 17      /* Reorder buffer entries in use, summed over cycles */
+#define PERF_IQ_OCCUPANCY 18
+#define PERF_STALL_STRUCTURAL 19   /* Decode held while no functional unit is free */
+#define PERF_STALL_UNIT_RESULT 20  /* Decode held on a result still in a functional unit */
+#define PERF_STALL_DCACHE 21       /* Memory stage held waiting on the data cache */
+#define PERF_STALL_ICACHE 22       /* Fetch idle waiting on the instruction cache */
+#define PERF_COUNT 23
+
+typedef struct APEX_PerfCounters
+{
+    long long events[PERF_COUNT];
+    long long retired[OPCODE_COUNT]; /* Instructions retired per opcode */
+    long long retire_width[APEX_MAX_WIDTH + 1]; /* Cycles retiring 0, 1, .. instructions */
+} APEX_PerfCounters;
+
+int APEX_perf_parse_format(const char *format);
+int APEX_perf_write(const struct APEX_CPU *cpu, const char *filename, int format);
+
+#endif
@@ -0,0 +1,23 @@
+; Regression check for DIV by zero on a path the program never takes. The
+; out-of-order backend executes the DIV after the slow MUL feeding the BZ
+; lets fetch run past it, so the divide must not trap. The last trip
+; divides by zero for real, which gives -1.
+        MOVC R1,#0              ; divisor
+        MOVC R2,#5              ; dividend
+        MOVC R6,#16             ; trips left
+        MOVC R7,#0              ; result pointer
+loop:
+        MOVC R3,#0
+        MUL R3,R3,R2            ; slow zero, the branch resolves late
+        BZ skip                 ; always taken
+        NOP
+        DIV R4,R2,R1            ; wrong path only
+        STORE R4,R7,#64
+skip:
+        STORE R6,R7,#0
+        ADDL R7,R7,#1
+        SUBL R6,R6,#1
+        BNZ loop
+        DIV R4,R2,R1            ; 5 / 0
+        STORE R4,R7,#0
+        HALT
@@ -0,0 +1,27 @@
+; Pointer chase: 256 nodes at 0, node i holding the index of the next node
+; (i * 97 + 1) mod 256, a single cycle through all of them. The chase walks
+; 2048 links counting into R9 and stores the node it ends on and the sum of
+; the nodes visited at 512.
+        MOVC R1,#0              ; node
+        MOVC R2,#1              ; its successor
+        MOVC R5,#256            ; nodes left
+        MOVC R3,#255
+fill:
+        STORE R2,R1,#0
+        ADDL R1,R1,#1
+        ADDL R2,R2,#97
+        AND R2,R2,R3
+        SUBL R5,R5,#1
+        BNZ fill
+        MOVC R4,#0              ; current node
+        MOVC R5,#2048           ; links left
+        MOVC R9,#0              ; sum
+chase:
+        LOAD R4,R4,#0
+        ADD R9,R9,R4
+        SUBL R5,R5,#1
+        BNZ chase
+        MOVC R6,#512
+        STORE R4,R6,#0
+        STORE R9,R6,#1
+        HALT
@@ -11,6 +11,7 @@
 #include <string.h>
 
 #include "apex_cpu.h"
+#include "apex_batch.h"
 
 int
 main(int argc, char const *argv[])
@@ -18,23 +19,75 @@ main(int argc, char const *argv[])
     int choice;
     int n;
     int l;
+    int i;
+    APEX_Config config;
 
     APEX_CPU *cpu;
     
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", 2.0);
-    n = atoi(argv[3]);
-    if (argc != 4)
+    if (argc < 4)
     {
-        fprintf(stderr, "APEX_Help: Usage %s <input_file> simulate <n>\n", argv[0]);
+        fprintf(stderr, "APEX_Help: Usage %s <input_file> simulate <n> "
+                "[--trace=off|summary|stage|full] [--fast-forward=<insns>] "
+                "[--ff-until=<pc>] [--restore=<file>] [--checkpoint=<file>]\n",
+                argv[0]);
+        fprintf(stderr, "APEX_Help:       %s <manifest> batch|scale <threads> "
+                "[options]\n", argv[0]);
+        fprintf(stderr, "APEX_Help:       %s <manifest> bench <repeats> "
+                "[--bench-variant=<name>] [--bench-baseline=<csv>] "
+                "[--bench-tolerance=<percent>] [options]\n", argv[0]);
+        fprintf(stderr, "APEX_Help:       %s <input_file> assemble <object_file>\n",
+                argv[0]);
         exit(1);
     }
+    n = atoi(argv[3]);
+    APEX_config_init(&config);
 
+    for (i = 4; i < argc; ++i)
+    {
+        if (APEX_config_option(&config, argv[i]) != 0)
+        {
+            exit(1);
+        }
+    }
+
+    /* Batch modes run every job of a manifest on n threads, 0 for all cores */
+    if (strcmp(argv[2], "batch") == 0)
+    {
+        return APEX_batch_run(argv[1], n, &config, stdout) == 0 ? 0 : 1;
+    }
+    if (strcmp(argv[2], "scale") == 0)
+    {
+        return APEX_batch_scaling(argv[1], n, &config, stdout) == 0 ? 0 : 1;
+    }
+
+    /* Bench mode times n repetitions of the manifest on this build */
+    if (strcmp(argv[2], "bench") == 0)
+    {
+        return APEX_batch_bench(argv[1], n, &config, stdout) == 0 ? 0 : 1;
+    }
+
+    /* Assemble mode writes the program as an object file and stops */
+    if (strcmp(argv[2], "assemble") == 0)
+    {
+        return APEX_assemble(argv[1], argv[3]) == 0 ? 0 : 1;
+    }
+
+cpu = NULL;
 while (1)
 {
-     cpu = APEX_cpu_init(argv[1]);
+     /* Every menu choice simulates again on a fresh CPU */
+     if (cpu)
+     {
+         APEX_cpu_stop(cpu);
+     }
+     cpu = APEX_cpu_init(argv[1], &config);
             if((strcmp(argv[2],"simulate")) == 0)
             {
-                APEX_cpu_run(cpu,n);
+                if (cpu && APEX_simulate(cpu, &config, n) < 0)
+                {
+                    exit(1);
+                }
             }
         if (!cpu)
         {
@@ -46,7 +99,11 @@ while (1)
     fprintf(stderr, "2. Display\n");
     fprintf(stderr, "3. Show Memory Address\n");
     fprintf(stderr, "4. Exit\n");
-    scanf("%d", &choice);
+    /* Input that runs out, as when the program came on stdin, exits */
+    if (scanf("%d", &choice) != 1)
+    {
+        choice = 4;
+    }
     switch(choice)
     {
         // case 1: 
@@ -98,13 +155,14 @@ while (1)
         {
             if(cpu!=NULL)
             {
+            /* Show memory with the stores still in the store buffer */
+            APEX_lsq_flush(&cpu->lsq, &cpu->data_memory);
             display(cpu);
-            for(int i=0;i<4096;i++)
+            /* Only the pages that were written to can hold non-zero words */
+            for(int i = APEX_memory_next(&cpu->data_memory, 0); i >= 0;
+                i = APEX_memory_next(&cpu->data_memory, i + 1))
             {
-                if(cpu->data_memory[i] != 0)
-                    {
-                        printf("\nMEM[%d] = %d\n",i, cpu->data_memory[i]);
-                    }
+                printf("\nMEM[%d] = %d\n",i, cpu->data_memory.words[i]);
             }
             }
             else
@@ -121,7 +179,16 @@ while (1)
             {
                 printf("Enter the location:\n");
                 scanf("%d", &l);
-                printf("MEM[%d] = %d",l,cpu->data_memory[l]);
+                APEX_lsq_flush(&cpu->lsq, &cpu->data_memory);
+                if (APEX_memory_contains(&cpu->data_memory, l))
+                {
+                    printf("MEM[%d] = %d",l,cpu->data_memory.words[l]);
+                }
+                else
+                {
+                    fprintf(stderr, "APEX_Error: MEM[%d] is outside the %d words of data "
+                            "memory\n", l, cpu->data_memory.size);
+                }
             }
             else
             {
@@ -132,6 +199,7 @@ while (1)
 
         case 4:
         {
+            APEX_cpu_stop(cpu);
             exit(0);
         }
     }